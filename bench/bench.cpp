@@ -0,0 +1,458 @@
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "../include/pipeline.hpp"
+#include "../include/params.hpp"
+#include "../include/detection.hpp"
+#include "../include/classifier.hpp"
+#include "../include/track.hpp"
+#include "../include/odometry.hpp"
+#include "../include/lidar.hpp"
+#include "../include/lidar_odometry.hpp"
+#include "../include/debug_sink.hpp"
+#include "../include/workspace.hpp"
+#include "json.hpp"
+
+using json = nlohmann::json;
+
+// Micro-benchmarks of the pipeline stages on the frames and scans in data/
+// plus synthetic scaled-up inputs. Results are written as JSON so two runs
+// (e.g. two releases) can be diffed, and --compare fails on regressions.
+
+struct BenchOptions
+{
+    std::string configPath = "config/default_params.json";
+    std::string dataDir = "data";
+    std::string outputPath = "output/bench_results.json";
+    std::string comparePath;
+    std::string filter;
+    double minTime = 0.5;   // Seconds per benchmark
+    int minIterations = 5;
+    double threshold = 0.1; // Allowed p50 slowdown in --compare, as a fraction
+};
+
+struct Benchmark
+{
+    std::string name;
+    std::function<void()> body;
+};
+
+static json runBenchmark(const Benchmark &benchmark, const BenchOptions &options)
+{
+    // One untimed run to warm up caches and lazily built state
+    benchmark.body();
+
+    std::vector<double> samples;
+    auto start = std::chrono::steady_clock::now();
+    while (samples.size() < static_cast<size_t>(options.minIterations) ||
+           std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() < options.minTime)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        benchmark.body();
+        samples.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count());
+    }
+
+    std::sort(samples.begin(), samples.end());
+    double sum = 0.0;
+    for (double s : samples)
+        sum += s;
+    auto percentile = [&](double p)
+    { return samples[std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()))]; };
+
+    json result;
+    result["name"] = benchmark.name;
+    result["iterations"] = samples.size();
+    result["mean_us"] = sum / samples.size();
+    result["p50_us"] = percentile(0.5);
+    result["p95_us"] = percentile(0.95);
+    result["min_us"] = samples.front();
+    result["max_us"] = samples.back();
+    return result;
+}
+
+// Synthetic cone masks: `count` cone-shaped blobs on a grid over the lower
+// part of the frame, far enough apart not to be merged
+static cv::Mat syntheticConeMask(const cv::Size &size, int count)
+{
+    cv::Mat mask = cv::Mat::zeros(size, CV_8UC1);
+    int columns = static_cast<int>(std::ceil(std::sqrt(count * 2.0)));
+    int rows = (count + columns - 1) / columns;
+    int cellWidth = size.width / columns;
+    int cellHeight = size.height / 2 / rows;
+
+    for (int i = 0; i < count; ++i)
+    {
+        cv::Point origin((i % columns) * cellWidth + cellWidth / 2, size.height / 2 + (i / columns) * cellHeight + cellHeight / 4);
+        int w = std::max(4, cellWidth / 6), h = std::max(8, cellHeight / 2);
+        std::vector<cv::Point> cone = {{origin.x, origin.y}, {origin.x + w / 2, origin.y + h}, {origin.x - w / 2, origin.y + h}};
+        cv::fillConvexPoly(mask, cone, cv::Scalar(255));
+    }
+    return mask;
+}
+
+// One track edge of `count` cones along a gentle curve from the bottom of the
+// frame to the top, the worst case for the greedy chain (everything connects)
+static std::vector<Cone> syntheticTrackEdge(const cv::Size &size, int count, int offset, std::mt19937 &rng)
+{
+    std::uniform_real_distribution<float> jitter(-2.0f, 2.0f);
+    std::vector<Cone> cones(count);
+    for (int i = 0; i < count; ++i)
+    {
+        float t = static_cast<float>(i) / count;
+        float x = size.width / 2 + offset + 0.15f * size.width * std::sin(t * 3.0f) + jitter(rng);
+        float y = size.height * (1.0f - t) - 1.0f + jitter(rng);
+        cones[i].center = cv::Point(static_cast<int>(x), static_cast<int>(std::max(0.0f, y)));
+        cones[i].boundingBox = cv::Rect(cones[i].center - cv::Point(4, 8), cv::Size(8, 16));
+    }
+    std::shuffle(cones.begin(), cones.end(), rng);
+    return cones;
+}
+
+// Packed x/y/z records a PointCloudView can point into
+struct SyntheticCloud
+{
+    std::vector<float> xyz;
+    PointCloudView view;
+
+    void attach()
+    {
+        const uint8_t *base = reinterpret_cast<const uint8_t *>(xyz.data());
+        view = PointCloudView();
+        view.size = xyz.size() / 3;
+        view.x.base = base;
+        view.y.base = base + sizeof(float);
+        view.z.base = base + 2 * sizeof(float);
+        view.x.stride = view.y.stride = view.z.stride = 3 * sizeof(float);
+    }
+};
+
+// Ground plane 1.5 m below the sensor, two walls and rows of cones within
+// 30 m, `points` points in total; `forward` shifts the scene towards the sensor
+static SyntheticCloud syntheticCloud(size_t points, float forward, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    const float groundZ = -1.5f;
+    const int coneCount = 40;
+    const int pointsPerCone = 60;
+
+    SyntheticCloud cloud;
+    cloud.xyz.reserve(points * 3);
+    auto add = [&](float x, float y, float z)
+    {
+        cloud.xyz.push_back(x - forward);
+        cloud.xyz.push_back(y);
+        cloud.xyz.push_back(z);
+    };
+
+    for (int c = 0; c < coneCount; ++c)
+    {
+        float cx = 3.0f + (c / 2) * 1.3f;
+        float cy = c % 2 ? 1.8f : -1.8f;
+        for (int i = 0; i < pointsPerCone; ++i)
+        {
+            float h = unit(rng) * 0.325f;
+            float r = 0.11f * (1.0f - h / 0.325f);
+            float a = unit(rng) * 6.2832f;
+            add(cx + r * std::cos(a), cy + r * std::sin(a), groundZ + h);
+        }
+    }
+
+    size_t remaining = points - std::min(points, static_cast<size_t>(coneCount * pointsPerCone));
+    for (size_t i = 0; i < remaining; ++i)
+    {
+        float u = unit(rng);
+        if (i % 5 == 0)
+            add(2.0f + 38.0f * u, i % 2 ? 8.0f : -8.0f, groundZ + 3.0f * unit(rng)); // Walls
+        else
+            add(1.0f + 39.0f * u, -8.0f + 16.0f * unit(rng), groundZ + 0.01f * (unit(rng) - 0.5f));
+    }
+
+    cloud.attach();
+    return cloud;
+}
+
+static std::vector<Benchmark> makeBenchmarks(const BenchOptions &options)
+{
+    std::vector<Benchmark> benchmarks;
+    const PipelineParams &params = getPipelineParams();
+
+    cv::Mat frame1 = cv::imread(options.dataDir + "/frame_1.png");
+    cv::Mat frame2 = cv::imread(options.dataDir + "/frame_2.png");
+    if (frame1.empty() || frame2.empty())
+        std::cerr << "Warning: " << options.dataDir << "/frame_1.png or frame_2.png missing, skipping the camera benchmarks" << std::endl;
+    else
+    {
+        cv::Mat frame4k, frame4k2;
+        cv::resize(frame1, frame4k, cv::Size(3840, 2160));
+        cv::resize(frame2, frame4k2, cv::Size(3840, 2160));
+
+        struct Input
+        {
+            std::string name;
+            cv::Mat frame, next;
+        };
+        for (const Input &input : {Input{"frame_1", frame1, frame2}, Input{"4k", frame4k, frame4k2}})
+        {
+            cv::Mat hsv;
+            cv::cvtColor(input.frame, hsv, cv::COLOR_BGR2HSV);
+            CarMasks carMasks = getCarMasks(input.frame.size(), params.carMask);
+            ColourMaskConfig blue = getColourMask(BLUE);
+            cv::Mat blueMask = detectColour(hsv, blue, carMasks.car, false, false, params.colorDetection);
+            HsvLut lut = buildHsvLut(params.roadMask);
+            ConeDetectionResult cones = detectConesFromImage(input.frame);
+            int width = input.frame.cols;
+
+            benchmarks.push_back({"detectColour/blue/" + input.name, [=]()
+                                  { detectColour(hsv, blue, carMasks.car, false, false, params.colorDetection); }});
+            benchmarks.push_back({"detectColours/lut/" + input.name, [=]()
+                                  { detectColours(hsv, lut, carMasks.car, params.colorDetection); }});
+            benchmarks.push_back({"identifyCones/blue/" + input.name, [=]()
+                                  { identifyCones(blueMask, params.coneDetection.blue.verticalMergeThreshold, params.coneDetection.horizontalMergeThreshold,
+                                                  params.coneDetection.maxBoundingBoxArea, params.coneDetection.minBoundingBoxArea); }});
+            benchmarks.push_back({"connectCones/blue/" + input.name, [=]()
+                                  { connectCones(cones.blueCones, width, params.trackDrawing.maxConeDistance, params.trackDrawing.verticalPenaltyFactor); }});
+            benchmarks.push_back({"calcOdometry/" + input.name, [=]()
+                                  { calcOdometry(input.frame, input.next, carMasks.valid, params.odometry); }});
+
+            // Ratio test, pose from the best 200 matches with PROSAC
+            OdometryParams robust = params.odometry;
+            robust.matchFilter = "ratio";
+            robust.estimator = "prosac";
+            robust.maxPoseMatches = 200;
+            benchmarks.push_back({"calcOdometry/robust/" + input.name, [=]()
+                                  { calcOdometry(input.frame, input.next, carMasks.valid, robust); }});
+            benchmarks.push_back({"pipeline/detect_and_edges/" + input.name, [=]()
+                                  {
+                                      ConeDetectionResult detected = detectConesFromImage(input.frame);
+                                      buildTrackEdges(detected, width);
+                                  }});
+
+            // Coarse-to-fine detection at half and quarter size, own buffers
+            for (int level = 1; level <= 2; ++level)
+            {
+                PipelineParams pyramid = params;
+                pyramid.pyramid.level = level;
+                auto workspace = std::make_shared<DetectionWorkspace>();
+                benchmarks.push_back({"pipeline/detect_pyramid" + std::to_string(level) + "/" + input.name, [=]()
+                                      { detectConesFromImage(input.frame, pyramid, lut, carMasks, *workspace); }});
+            }
+
+            // OpenCL backend on frames uploaded beforehand, as the stream does;
+            // skipped without a device
+            PipelineParams opencl = params;
+            opencl.acceleration.backend = "opencl";
+            if (useDevice(opencl.acceleration))
+            {
+                auto workspace = std::make_shared<DetectionWorkspace>();
+                auto odometry = std::make_shared<VisualOdometry>(params.odometry);
+                cv::UMat device = uploadFrame(input.frame, opencl.acceleration);
+                cv::UMat deviceNext = uploadFrame(input.next, opencl.acceleration);
+                benchmarks.push_back({"pipeline/detect_opencl/" + input.name, [=]()
+                                      { detectConesFromImage(input.frame, opencl, lut, carMasks, *workspace, nullptr, device); }});
+                benchmarks.push_back({"calcOdometry/opencl/" + input.name, [=]()
+                                      {
+                                          odometry->reset();
+                                          odometry->process(input.frame, carMasks.valid, device);
+                                          odometry->process(input.next, carMasks.valid, deviceNext);
+                                      }});
+            }
+        }
+    }
+
+    // Synthetic cone counts well above what a real frame has
+    {
+        cv::Size size(3840, 2160);
+        cv::Mat mask = syntheticConeMask(size, 240);
+        std::mt19937 rng(7);
+        std::vector<Cone> edge = syntheticTrackEdge(size, 240, -size.width / 8, rng);
+
+        benchmarks.push_back({"identifyCones/synthetic_240/4k", [=]()
+                              { identifyCones(mask, params.coneDetection.verticalMergeThreshold, params.coneDetection.horizontalMergeThreshold,
+                                              params.coneDetection.maxBoundingBoxArea, params.coneDetection.minBoundingBoxArea); }});
+        benchmarks.push_back({"connectCones/synthetic_240/4k", [=]()
+                              { connectCones(edge, size.width, params.trackDrawing.maxConeDistance, params.trackDrawing.verticalPenaltyFactor); }});
+    }
+
+    // LIDAR: the scans in data/ plus a synthetic 100k point scene. Clouds are
+    // shared_ptrs so the lambdas keep the mappings alive
+    auto cones = std::make_shared<MappedPcdFile>();
+    if (cones->open(options.dataDir + "/cones.pcd"))
+    {
+        auto detector = std::make_shared<LidarConeDetector>(params.lidar);
+        benchmarks.push_back({"lidar/detect/cones.pcd", [=]()
+                              { detector->detect(cones->view()); }});
+    }
+    else
+        std::cerr << "Warning: " << options.dataDir << "/cones.pcd missing, skipping its benchmark" << std::endl;
+
+    auto first = std::make_shared<MappedPcdFile>();
+    auto second = std::make_shared<MappedPcdFile>();
+    if (first->open(options.dataDir + "/first.pcd") && second->open(options.dataDir + "/second.pcd"))
+    {
+        benchmarks.push_back({"lidar/odometry/first_second", [=]()
+                              {
+                                  LidarOdometry odometry(params.lidarOdometry);
+                                  odometry.process(first->view());
+                                  odometry.process(second->view());
+                              }});
+    }
+    else
+        std::cerr << "Warning: " << options.dataDir << "/first.pcd or second.pcd missing, skipping the LIDAR odometry benchmark" << std::endl;
+
+    {
+        auto cloud = std::make_shared<SyntheticCloud>(syntheticCloud(100000, 0.0f, 1));
+        auto moved = std::make_shared<SyntheticCloud>(syntheticCloud(100000, 0.3f, 2));
+        auto detector = std::make_shared<LidarConeDetector>(params.lidar);
+        benchmarks.push_back({"lidar/detect/synthetic_100k", [=]()
+                              { detector->detect(cloud->view); }});
+        benchmarks.push_back({"lidar/odometry/synthetic_100k", [=]()
+                              {
+                                  LidarOdometry odometry(params.lidarOdometry);
+                                  odometry.process(cloud->view);
+                                  odometry.process(moved->view);
+                              }});
+    }
+
+    return benchmarks;
+}
+
+// Prints the p50 change per benchmark against `baseline`; true if none got
+// slower by more than the threshold
+static bool compareResults(const json &results, const json &baseline, double threshold)
+{
+    bool ok = true;
+    std::cout << "\n=== COMPARISON (p50) ===" << std::endl;
+    for (const auto &current : results["benchmarks"])
+    {
+        auto previous = std::find_if(baseline["benchmarks"].begin(), baseline["benchmarks"].end(), [&](const json &b)
+                                     { return b["name"] == current["name"]; });
+        if (previous == baseline["benchmarks"].end())
+        {
+            std::cout << "  " << current["name"].get<std::string>() << ": new" << std::endl;
+            continue;
+        }
+
+        double before = (*previous)["p50_us"], after = current["p50_us"];
+        double change = before > 0.0 ? after / before - 1.0 : 0.0;
+        bool regressed = change > threshold;
+        ok = ok && !regressed;
+        std::cout << "  " << current["name"].get<std::string>() << ": " << before << " -> " << after << " us ("
+                  << (change >= 0 ? "+" : "") << change * 100.0 << "%)" << (regressed ? "  REGRESSION" : "") << std::endl;
+    }
+    return ok;
+}
+
+// Whole argument as a number, false on anything else (e.g. "abc" or "0.5s")
+static bool parseDouble(const char *text, double &value)
+{
+    char *end = nullptr;
+    double parsed = std::strtod(text, &end);
+    if (end == text || *end != '\0')
+        return false;
+    value = parsed;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool parsed = true;
+        if (arg == "--config" && i + 1 < argc)
+            options.configPath = argv[++i];
+        else if (arg == "--data" && i + 1 < argc)
+            options.dataDir = argv[++i];
+        else if (arg == "--output" && i + 1 < argc)
+            options.outputPath = argv[++i];
+        else if (arg == "--compare" && i + 1 < argc)
+            options.comparePath = argv[++i];
+        else if (arg == "--filter" && i + 1 < argc)
+            options.filter = argv[++i];
+        else if (arg == "--min-time" && i + 1 < argc)
+            parsed = parseDouble(argv[++i], options.minTime);
+        else if (arg == "--threshold" && i + 1 < argc)
+            parsed = parseDouble(argv[++i], options.threshold);
+        else
+            parsed = false;
+        if (!parsed)
+        {
+            std::cout << "Usage: " << argv[0] << " [--config params.json] [--data dir] [--output results.json] [--filter substring]"
+                      << " [--min-time seconds] [--compare baseline.json] [--threshold fraction]" << std::endl;
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    // Fixed config (not current_params.json) so runs are comparable, and no
+    // debug drawing or logging in the timed code
+    initializePipelineParams(options.configPath);
+    DebugSink::instance().setRendering(false);
+    DebugSink::instance().setLogging(false);
+    cv::setRNGSeed(0);
+
+    json results;
+    results["version"] = 1;
+    results["config"] = options.configPath;
+    results["threads"] = cv::getNumThreads();
+    results["minTime"] = options.minTime;
+    results["benchmarks"] = json::array();
+
+    for (const auto &benchmark : makeBenchmarks(options))
+    {
+        if (!options.filter.empty() && benchmark.name.find(options.filter) == std::string::npos)
+            continue;
+
+        json result = runBenchmark(benchmark, options);
+        std::cout << benchmark.name << ": p50 " << result["p50_us"].get<double>() << " us, p95 " << result["p95_us"].get<double>()
+                  << " us (" << result["iterations"].get<size_t>() << " iterations)" << std::endl;
+        results["benchmarks"].push_back(result);
+    }
+
+    std::error_code ec;
+    std::filesystem::path parent = std::filesystem::path(options.outputPath).parent_path();
+    if (!parent.empty())
+        std::filesystem::create_directories(parent, ec);
+
+    std::ofstream file(options.outputPath);
+    if (file)
+    {
+        file << results.dump(2) << std::endl;
+        std::cout << "Saved benchmark results to: " << options.outputPath << std::endl;
+    }
+    else
+        std::cerr << "Error: Could not write benchmark results: " << options.outputPath << std::endl;
+
+    if (!options.comparePath.empty())
+    {
+        std::ifstream baselineFile(options.comparePath);
+        if (!baselineFile)
+        {
+            std::cerr << "Error: Could not open baseline: " << options.comparePath << std::endl;
+            return 1;
+        }
+
+        json baseline;
+        try
+        {
+            baselineFile >> baseline;
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Error: Could not parse baseline: " << e.what() << std::endl;
+            return 1;
+        }
+        return compareResults(results, baseline, options.threshold) ? 0 : 1;
+    }
+    return 0;
+}
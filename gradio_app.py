@@ -5,7 +5,9 @@ Provides interactive parameter tuning and visualization.
 """
 
 import json
+import select
 import subprocess
+import threading
 from pathlib import Path
 
 import gradio as gr
@@ -46,51 +48,103 @@ def save_current_params(params_dict):
         json.dump(params_dict, f, indent=2)
 
 
-def run_pipeline(step="all"):
-    """Run the C++ pipeline with specified step."""
+class PipelineServer:
+    """Long-lived `driverless serve` process, so runs skip process startup,
+    OpenCV init and image decoding. Restarted automatically if it dies."""
+
+    def __init__(self, cmd=("./build/driverless", "serve")):
+        self.cmd = list(cmd)
+        self.proc = None
+        self.lock = threading.Lock()
+
+    def _ensure_running(self):
+        if self.proc is None or self.proc.poll() is not None:
+            self.proc = subprocess.Popen(
+                self.cmd,
+                stdin=subprocess.PIPE,
+                stdout=subprocess.PIPE,
+                stderr=subprocess.DEVNULL,
+                text=True,
+                bufsize=1,
+            )
+
+    def request(self, payload, timeout=30):
+        with self.lock:
+            self._ensure_running()
+            self.proc.stdin.write(json.dumps(payload) + "\n")
+            self.proc.stdin.flush()
+
+            ready, _, _ = select.select([self.proc.stdout], [], [], timeout)
+            if not ready:
+                # Wedged mid-request, the next call starts a fresh process
+                self.proc.kill()
+                self.proc = None
+                raise subprocess.TimeoutExpired(self.cmd, timeout)
+
+            line = self.proc.stdout.readline()
+            if not line:
+                self.proc = None
+                raise RuntimeError("pipeline server exited")
+            return json.loads(line)
+
+
+pipeline_server = PipelineServer()
+
+# Map the CLI step names to the server's
+SERVER_STEPS = {"1": "detect", "2": "track", "3": "odometry"}
+
+
+def load_outputs():
+    """Load the output images and JSON written by the pipeline."""
+    cones_img = None
+    odometry_img = None
+    json_file = None
+
     try:
-        # Ensure output directory exists
-        OUTPUT_DIR.mkdir(parents=True, exist_ok=True)
+        if (OUTPUT_DIR / "detected_cones.png").exists():
+            cones_img = Image.open(OUTPUT_DIR / "detected_cones.png")
+    except Exception as e:
+        print(f"Warning: Could not load detected_cones.png: {e}")
+
+    try:
+        if (OUTPUT_DIR / "odometry_matches.png").exists():
+            odometry_img = Image.open(OUTPUT_DIR / "odometry_matches.png")
+    except Exception as e:
+        print(f"Warning: Could not load odometry_matches.png: {e}")
 
-        cmd = ["./build/driverless"]
-        if step != "all":
-            cmd.append(step)
+    try:
+        if (OUTPUT_DIR / "detected_cones.json").exists():
+            json_file = str(OUTPUT_DIR / "detected_cones.json")
+    except Exception as e:
+        print(f"Warning: Could not access detected_cones.json: {e}")
 
-        result = subprocess.run(cmd, capture_output=True, text=True, timeout=30)
+    return cones_img, odometry_img, json_file
 
-        if result.returncode == 0:
-            # Load output images
-            cones_img = None
-            odometry_img = None
-            json_file = None
 
-            try:
-                if (OUTPUT_DIR / "detected_cones.png").exists():
-                    cones_img = Image.open(OUTPUT_DIR / "detected_cones.png")
-            except Exception as e:
-                print(f"Warning: Could not load detected_cones.png: {e}")
+def run_pipeline(step="all", params=None):
+    """Run the C++ pipeline with specified step on the resident server."""
+    try:
+        # Ensure output directory exists
+        OUTPUT_DIR.mkdir(parents=True, exist_ok=True)
 
-            try:
-                if (OUTPUT_DIR / "odometry_matches.png").exists():
-                    odometry_img = Image.open(OUTPUT_DIR / "odometry_matches.png")
-            except Exception as e:
-                print(f"Warning: Could not load odometry_matches.png: {e}")
+        payload = {"cmd": "run", "step": SERVER_STEPS.get(step, step)}
+        if params is not None:
+            payload["params"] = params
 
-            try:
-                if (OUTPUT_DIR / "detected_cones.json").exists():
-                    json_file = str(OUTPUT_DIR / "detected_cones.json")
-            except Exception as e:
-                print(f"Warning: Could not access detected_cones.json: {e}")
+        result = pipeline_server.request(payload, timeout=30)
 
+        if result.get("ok"):
+            cones_img, odometry_img, json_file = load_outputs()
             return (
-                f"✅ Pipeline step '{step}' completed successfully!\n\n{result.stdout}",
+                f"✅ Pipeline step '{step}' completed successfully in "
+                f"{result.get('elapsed_ms', 0):.0f} ms!\n\n{result.get('log', '')}",
                 cones_img,
                 odometry_img,
                 json_file,
             )
         else:
             return (
-                f"❌ Pipeline failed with code {result.returncode}\n\n{result.stderr}",
+                f"❌ Pipeline failed: {result.get('error', 'unknown error')}\n\n{result.get('log', '')}",
                 None,
                 None,
                 None,
@@ -244,8 +298,8 @@ def save_and_run_pipeline(
     # Save to current params (NEVER touch default_params.json)
     save_current_params(params)
 
-    # Run the pipeline (C++ will read from current_params.json)
-    output, cones_img, odometry_img, json_file = run_pipeline("all")
+    # Run the pipeline; the resident server takes the new params directly
+    output, cones_img, odometry_img, json_file = run_pipeline("all", params)
 
     # Return all outputs for display + show results page
     return (
@@ -0,0 +1,77 @@
+#ifndef CALIBRATION_HPP
+#define CALIBRATION_HPP
+
+#include <opencv2/opencv.hpp>
+#include <array>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "classifier.hpp"
+#include "detection.hpp"
+#include "params.hpp"
+#include "utils.hpp"
+
+// Online refit of the cone colour ranges from tracker-verified cones, for
+// light that drifts away from the built-in thresholds (e.g. cloud cover).
+// The detection thread only adds pixels to per-range histograms; refitting
+// the ranges and rebuilding the LUT happen on a background thread, which hands
+// the new LUT to `publish`, so detection never waits for a rebuild.
+// Each refit moves the hue bounds and the saturation/value lower bounds a
+// step towards percentiles of the sampled pixels, within maxDrift of the
+// built-in ranges.
+class ColourCalibrator
+{
+public:
+    using PublishCallback = std::function<void(std::shared_ptr<const HsvLut>)>;
+
+    ColourCalibrator(const CalibrationParams &params, const RoadMaskParams &roadMask, PublishCallback publish);
+    ~ColourCalibrator();
+
+    ColourCalibrator(const ColourCalibrator &) = delete;
+    ColourCalibrator &operator=(const ColourCalibrator &) = delete;
+
+    // Samples the cones with a tracker id that were seen in at least
+    // minTrackAge consecutive calls; call once per frame
+    void addSamples(const cv::Mat &frame, const ConeDetectionResult &cones);
+
+    // Ends the background thread once it is done publishing; later samples
+    // are taken but never refitted. Whoever retires the calibrator calls it,
+    // so the last reference can't end up on the thread being joined
+    void stop();
+
+    // Current ranges, orange, blue, yellow
+    std::vector<ColourMaskConfig> ranges() const;
+    int refits() const;
+
+private:
+    struct RangeHistogram
+    {
+        std::array<uint32_t, 256> h = {}, s = {}, v = {};
+        uint32_t count = 0;
+    };
+
+    void sampleCone(const cv::Mat &frame, const Cone &cone, int colour, const std::vector<ColourMaskConfig> &current, std::vector<std::vector<RangeHistogram>> &histograms) const;
+    void worker();
+    bool refit(); // With the lock held; true if any range moved
+
+    CalibrationParams params;
+    RoadMaskParams roadMask;
+    PublishCallback publish;
+    std::vector<ColourMaskConfig> defaults;
+    std::unordered_map<int, int> trackAges; // Detection thread only
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<ColourMaskConfig> current;
+    std::vector<std::vector<RangeHistogram>> histograms; // Per colour, per range
+    int refitCount = 0;
+    bool pending = false;
+    bool stopping = false;
+    std::thread thread;
+};
+
+#endif // CALIBRATION_HPP
@@ -0,0 +1,76 @@
+#ifndef CENTERLINE_HPP
+#define CENTERLINE_HPP
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "detection.hpp"
+#include "params.hpp"
+#include "track.hpp"
+#include "json.hpp"
+
+using json = nlohmann::json;
+
+struct PathPoint
+{
+    cv::Point2f position; // Same coordinates as the cones (image or bird's-eye pixels)
+    float curvature = 0.0f; // 1/px, positive for right-hand bends as seen in the image
+    float width = 0.0f;     // Distance between the two cones (or cone and edge) it sits between
+};
+
+// Middle of the track, ordered from the car outwards
+struct Centerline
+{
+    std::vector<PathPoint> points;
+    int recomputed = 0; // Midpoints that had to be rebuilt in the last update
+    bool valid() const { return points.size() >= 2; }
+};
+
+json centerlineToJson(const Centerline &centerline);
+
+// Draws the centerline as a white polyline
+void drawCenterline(cv::Mat &image, const Centerline &centerline);
+
+// Builds the centerline from the ordered blue and yellow edges. The longer
+// edge is the reference: each of its cones is paired with the closest point of
+// the other edge's polyline and the midpoints are joined in edge order;
+// curvature is the Menger curvature of consecutive midpoints.
+// Between updates the builder keeps, per midpoint, the inputs it came from: a
+// midpoint is only rebuilt when its reference cone or its closest segment
+// moved, or a segment that moved is now at least as close; curvature is only
+// redone next to rebuilt midpoints. The result is the same as a full rebuild.
+class CenterlineBuilder
+{
+public:
+    explicit CenterlineBuilder(const CenterlineParams &params = CenterlineParams());
+
+    const Centerline &update(const ConeDetectionResult &cones, const TrackEdges &edges);
+    const Centerline &centerline() const { return path; }
+    void reset();
+
+private:
+    struct Midpoint
+    {
+        cv::Point2f reference;
+        int segment = -1; // Closest segment of the other edge, -1 if none within maxTrackWidth
+        cv::Point2f position;
+        float width = 0.0f;
+        float distance = 0.0f; // Squared width, compared as computeMidpoint() does
+    };
+
+    bool reusable(size_t i) const;
+    Midpoint computeMidpoint(const cv::Point2f &reference) const;
+    float segmentDistance(const cv::Point2f &reference, size_t segment) const;
+
+    CenterlineParams params;
+    std::vector<cv::Point2f> reference, other;           // Current edges
+    std::vector<cv::Point2f> previousOther;              // Other edge of the last update
+    std::vector<int> movedSegments;                      // Segments of the other edge with a moved end
+    std::vector<bool> segmentMoved;
+    std::vector<Midpoint> midpoints, previousMidpoints;  // One per reference cone
+    bool previousBlueReference = true;
+    size_t previousReferenceSize = 0; // Reference cones of the last update
+    bool previousDropped = false;     // Whether the last update left a midpoint out
+    Centerline path;
+};
+
+#endif // CENTERLINE_HPP
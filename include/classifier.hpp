@@ -0,0 +1,73 @@
+#ifndef CLASSIFIER_HPP
+#define CLASSIFIER_HPP
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "utils.hpp"
+#include "params.hpp"
+
+class FrameWorkspace;
+class DeviceWorkspace;
+
+// Bit flags stored per pixel in the label image; a pixel can match several colours
+enum ColourLabel : uchar
+{
+    LABEL_NONE = 0,
+    LABEL_ROAD = 1 << 0,
+    LABEL_ORANGE = 1 << 1,
+    LABEL_BLUE = 1 << 2,
+    LABEL_YELLOW = 1 << 3
+};
+
+// Separable HSV lookup table: every colour range is a box in HSV space, so a
+// pixel is inside range r iff bit r is set in all three per-channel tables.
+// The AND of the three gives the matched ranges, which rangeLabels maps to
+// label flags. 1KB in total, so it stays in L1 while classifying a frame.
+struct HsvLut
+{
+    static const int maxRanges = 8;
+
+    uchar h[256] = {};
+    uchar s[256] = {};
+    uchar v[256] = {};
+    uchar rangeLabels[256] = {};
+    int rangeCount = 0;
+
+    inline uchar classify(uchar hue, uchar sat, uchar val) const
+    {
+        return rangeLabels[h[hue] & s[sat] & v[val]];
+    }
+};
+
+// Add all ranges of a colour under the given label; returns false if the LUT is full
+bool addColourToLut(HsvLut &lut, const ColourMaskConfig &cfg, uchar label);
+
+// LUT for the road mask plus the orange, blue and yellow cone colours
+HsvLut buildHsvLut(const RoadMaskParams &roadMask);
+// Same with other cone ranges, e.g. calibrated ones; orange, blue, yellow order
+HsvLut buildHsvLut(const RoadMaskParams &roadMask, const std::vector<ColourMaskConfig> &coneColours);
+
+// Single pass over an HSV image writing one label image; pixels set in negMask get LABEL_NONE
+void classifyColours(const cv::Mat &hsvImage, const HsvLut &lut, const cv::Mat &negMask, cv::Mat &labels);
+
+struct ColourMasks
+{
+    cv::Mat road;
+    cv::Mat orange;
+    cv::Mat blue;
+    cv::Mat yellow;
+};
+
+// Fused replacement for the four detectColour calls: classify once, then
+// clean up the road mask and cut it out of the cone masks
+ColourMasks detectColours(const cv::Mat &hsvImage, const HsvLut &lut, const cv::Mat &negMask, const ColorDetectionParams &params = ColorDetectionParams());
+// Same with the label image, masks and kernel taken from `workspace`; the
+// returned masks are views into it, valid until its next detectColours call
+ColourMasks detectColours(const cv::Mat &hsvImage, const HsvLut &lut, const cv::Mat &negMask, const ColorDetectionParams &params, FrameWorkspace &workspace);
+// OpenCL backend on a device HSV image: the same table lookup (per-channel
+// cv::LUT) and cleanup, on the device. Only the cone masks are downloaded,
+// into views of `workspace`; `road` stays on the device and comes back empty
+ColourMasks detectColours(const cv::UMat &hsvImage, const HsvLut &lut, const cv::UMat &negMask, const ColorDetectionParams &params,
+                          DeviceWorkspace &device, FrameWorkspace &workspace);
+
+#endif // CLASSIFIER_HPP
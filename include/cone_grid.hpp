@@ -0,0 +1,67 @@
+#ifndef CONE_GRID_HPP
+#define CONE_GRID_HPP
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <vector>
+
+// Uniform grid of cone indices over an image. With cells at least as large
+// as a search distance, everything closer than it to a point is in the 3x3
+// cells around that point. Points outside the image go to the border cells.
+class ConeGrid
+{
+public:
+    ConeGrid() = default;
+    ConeGrid(const cv::Size &size, int cellWidth, int cellHeight) { reset(size, cellWidth, cellHeight); }
+
+    // Empties the grid for a new layout; cell lists keep their capacity, so a
+    // reused grid stops allocating once it has seen its largest frame
+    void reset(const cv::Size &size, int cellWidth, int cellHeight)
+    {
+        this->cellWidth = std::max(1, cellWidth);
+        this->cellHeight = std::max(1, cellHeight);
+        cols = size.width / this->cellWidth + 1;
+        rows = size.height / this->cellHeight + 1;
+        if (cells.size() < static_cast<size_t>(cols * rows))
+            cells.resize(cols * rows);
+        for (auto &cell : cells)
+            cell.clear();
+    }
+
+    int cellOf(const cv::Point &p) const
+    {
+        int cx = std::clamp(p.x / cellWidth, 0, cols - 1);
+        int cy = std::clamp(p.y / cellHeight, 0, rows - 1);
+        return cy * cols + cx;
+    }
+
+    void insert(int cell, int cone) { cells[cell].push_back(cone); }
+
+    void remove(int cell, int cone)
+    {
+        auto &list = cells[cell];
+        list.erase(std::find(list.begin(), list.end(), cone));
+    }
+
+    // Calls f(coneIndex) for every cone in the 3x3 cells around p
+    template <typename F>
+    void forNeighbours(const cv::Point &p, F f) const
+    {
+        int cell = cellOf(p);
+        int cx = cell % cols, cy = cell / cols;
+        for (int y = std::max(0, cy - 1); y <= std::min(rows - 1, cy + 1); ++y)
+        {
+            for (int x = std::max(0, cx - 1); x <= std::min(cols - 1, cx + 1); ++x)
+            {
+                for (int cone : cells[y * cols + x])
+                    f(cone);
+            }
+        }
+    }
+
+private:
+    int cellWidth = 1, cellHeight = 1, cols = 1, rows = 1;
+    std::vector<std::vector<int>> cells; // At least cols * rows, the rest stay empty
+};
+
+#endif // CONE_GRID_HPP
@@ -0,0 +1,90 @@
+#ifndef CONE_IO_HPP
+#define CONE_IO_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "detection.hpp"
+
+// JSON export, kept for the Gradio UI
+void saveConeDetectionToJson(const ConeDetectionResult &result, const std::string &filepath);
+ConeDetectionResult loadConeDetectionFromJson(const std::string &filepath);
+
+// Binary format used for handing cones between stages: a fixed header followed
+// by the orange, blue and yellow records back to back. Little-endian, no parsing
+// needed: a mapped file or shared memory block can be read in place.
+struct PackedConeHeader
+{
+    char magic[4];      // "CONE"
+    uint32_t version;   // packedConeVersion
+    uint32_t counts[3]; // Orange, blue, yellow
+};
+
+struct PackedCone
+{
+    int32_t x;
+    int32_t y;
+    int32_t bboxX;
+    int32_t bboxY;
+    int32_t bboxWidth;
+    int32_t bboxHeight;
+    float positionX; // Metres, LIDAR cones only
+    float positionY;
+    float positionZ;
+    int32_t id; // Cone::id, -1 for untracked cones
+};
+
+static_assert(sizeof(PackedConeHeader) == 20, "PackedConeHeader must stay 20 bytes");
+static_assert(sizeof(PackedCone) == 40, "PackedCone must stay 40 bytes");
+
+const uint32_t packedConeVersion = 3;
+
+enum ConeColour
+{
+    CONE_ORANGE = 0,
+    CONE_BLUE = 1,
+    CONE_YELLOW = 2
+};
+
+// Serialize into a caller-provided buffer (e.g. shared memory); returns the
+// number of bytes written, or 0 if `capacity` is too small
+size_t packConeDetection(const ConeDetectionResult &result, void *buffer, size_t capacity);
+size_t packedConeDetectionSize(const ConeDetectionResult &result);
+
+// Zero-copy view over a packed buffer; only valid while the buffer is
+struct ConeDetectionView
+{
+    const PackedCone *cones[3] = {nullptr, nullptr, nullptr};
+    size_t counts[3] = {0, 0, 0};
+
+    // Validates the header and record counts against `size`
+    bool attach(const void *buffer, size_t size);
+    ConeDetectionResult toResult() const;
+};
+
+// Read-only memory mapping of a binary cone file
+class MappedConeFile
+{
+public:
+    MappedConeFile() = default;
+    ~MappedConeFile();
+
+    MappedConeFile(const MappedConeFile &) = delete;
+    MappedConeFile &operator=(const MappedConeFile &) = delete;
+
+    bool open(const std::string &filepath);
+    void close();
+
+    const ConeDetectionView &view() const { return coneView; }
+
+private:
+    void *data = nullptr;
+    size_t size = 0;
+    ConeDetectionView coneView;
+};
+
+void saveConeDetectionToBinary(const ConeDetectionResult &result, const std::string &filepath);
+ConeDetectionResult loadConeDetectionFromBinary(const std::string &filepath);
+
+#endif // CONE_IO_HPP
@@ -0,0 +1,71 @@
+#ifndef CONE_TRACKER_HPP
+#define CONE_TRACKER_HPP
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "detection.hpp"
+#include "params.hpp"
+
+// Constant-velocity Kalman filter along one image axis, in pixels and frames
+struct AxisFilter
+{
+    cv::Vec2d state;        // Position, velocity
+    cv::Matx22d covariance;
+
+    void init(double position, double measurementNoise);
+    void predict(double processNoise);
+    void update(double position, double measurementNoise);
+};
+
+// Multi-object cone tracker in image space. Every track filters the cone
+// center with a constant-velocity Kalman filter per axis; detections are
+// assigned per colour, closest first and within gateDistance of the
+// prediction, and the ones left over start new tracks. IDs stay with a cone
+// for as long as it is followed.
+class ConeTracker
+{
+public:
+    explicit ConeTracker(const TrackerParams &params = TrackerParams());
+
+    // Moves every track one frame ahead; call once per frame before update()
+    void predict();
+
+    // Full-frame detection is due every fullDetectionInterval frames, and
+    // whenever nothing is tracked
+    bool needsFullDetection() const;
+
+    // Predicted boxes of all tracks (ids set), e.g. to seed the detection ROI
+    ConeDetectionResult predictedCones() const;
+
+    // Disjoint windows around the predicted boxes, clipped to `size`; local
+    // re-detection only needs to look inside them
+    std::vector<cv::Rect> searchWindows(const cv::Size &size) const;
+
+    // Assigns the frame's detections to the tracks and returns them with their
+    // ids set. `fullFrame` restarts the full detection interval.
+    ConeDetectionResult update(const ConeDetectionResult &detections, bool fullFrame);
+
+    void reset();
+    size_t trackCount() const { return tracks.size(); }
+
+private:
+    struct Track
+    {
+        int id = -1;
+        int colour = 0;
+        AxisFilter x, y;
+        cv::Point boxOffset; // Bbox top-left relative to the center, from the last detection
+        cv::Size boxSize;
+        int missed = 0;
+    };
+
+    Cone predictedCone(const Track &track) const;
+    void startTrack(const Cone &cone, int colour);
+
+    TrackerParams params;
+    std::vector<Track> tracks;
+    int nextId = 0;
+    int framesSinceFull = 0;
+};
+
+#endif // CONE_TRACKER_HPP
@@ -0,0 +1,58 @@
+#ifndef DEBUG_SINK_HPP
+#define DEBUG_SINK_HPP
+
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+// Everything that is only there for a human watching: debug drawings (track
+// lines, feature matches) and per-item log lines (e.g. discarded contours).
+// Both are on by default; `stream --headless` switches them off at runtime,
+// and a DRIVERLESS_HEADLESS build compiles them out altogether.
+class DebugSink
+{
+public:
+    static DebugSink &instance();
+
+    bool rendering() const { return renderEnabled.load(std::memory_order_relaxed); }
+    bool logging() const { return logEnabled.load(std::memory_order_relaxed); }
+    void setRendering(bool enabled) { renderEnabled.store(enabled, std::memory_order_relaxed); }
+    void setLogging(bool enabled) { logEnabled.store(enabled, std::memory_order_relaxed); }
+
+    // Not owned, must outlive the sink's use; std::cout by default
+    void setLogStream(std::ostream &stream) { out = &stream; }
+    std::ostream &log() { return *out; }
+
+    // One whole line, safe from several threads (detection runs per-colour tasks)
+    void writeLine(const std::string &line);
+
+private:
+    std::atomic<bool> renderEnabled{true};
+    std::atomic<bool> logEnabled{true};
+    std::ostream *out = &std::cout;
+    std::mutex mutex;
+};
+
+// DEBUG_RENDER() guards drawing code, DEBUG_LOG(a << b) writes one line; with
+// DRIVERLESS_HEADLESS (CMake option, off by default) they are constant false
+// and nothing, so the guarded code is dropped by the compiler
+#ifdef DRIVERLESS_HEADLESS
+#define DEBUG_RENDER() false
+#define DEBUG_LOG(message) ((void)0)
+#else
+#define DEBUG_RENDER() (DebugSink::instance().rendering())
+#define DEBUG_LOG(message)                                    \
+    do                                                        \
+    {                                                         \
+        if (DebugSink::instance().logging())                  \
+        {                                                     \
+            std::ostringstream debugLine;                     \
+            debugLine << message;                             \
+            DebugSink::instance().writeLine(debugLine.str()); \
+        }                                                     \
+    } while (0)
+#endif
+
+#endif // DEBUG_SINK_HPP
@@ -5,13 +5,36 @@
 #ifndef DETECTION_HPP
 #define DETECTION_HPP
 
+class FrameWorkspace;
+
 struct Cone
 {
     cv::Rect boundingBox;
     cv::Point center;
+    cv::Point3f position; // Metres in the LIDAR frame, zero for camera-only cones
+    int id = -1;          // Set by the ConeTracker, -1 for untracked cones
 };
 
-cv::Mat detectColour(const cv::Mat &image, ColourMaskConfig cfg, const cv::Mat &negMask, bool dilate = false, bool erode = false, const ColorDetectionParams &params = ColorDetectionParams());
-std::vector<Cone> identifyCones(const cv::Mat &mask, const cv::Mat &image, int vThreshold = 20, int hThreshold = 4, int maxArea = 1000, int minArea = 20);
+// Structure to hold intermediate cone detection results
+struct ConeDetectionResult
+{
+    std::vector<Cone> orangeCones;
+    std::vector<Cone> blueCones;
+    std::vector<Cone> yellowCones;
+};
+
+cv::Mat detectColour(const cv::Mat &image, const ColourMaskConfig &cfg, const cv::Mat &negMask, bool dilate = false, bool erode = false, const ColorDetectionParams &params = ColorDetectionParams());
+// Same into `mask`, with the scratch image and kernel from `workspace`
+void detectColour(const cv::Mat &image, const ColourMaskConfig &cfg, const cv::Mat &negMask, bool dilate, bool erode, const ColorDetectionParams &params, FrameWorkspace &workspace, cv::Mat &mask);
+// Part of the frame cone detection runs on, full width; `previous` (may be
+// null) drives the "cones" mode, which falls back to the static rows without it
+cv::Rect getDetectionRoi(const cv::Size &size, const RoiParams &params, const ConeDetectionResult *previous = nullptr);
+
+// Contours of `mask` become cone parts, parts closer than the thresholds are
+// merged into one cone. Parts and cones are drawn into `debugImage` if given
+std::vector<Cone> identifyCones(const cv::Mat &mask, int vThreshold = 20, int hThreshold = 4, int maxArea = 1000, int minArea = 20, cv::Mat *debugImage = nullptr);
+// Same into `cones` (cleared first, must not be workspace.parts), with the
+// contours, parts and merge grid from `workspace`
+void identifyCones(const cv::Mat &mask, int vThreshold, int hThreshold, int maxArea, int minArea, FrameWorkspace &workspace, std::vector<Cone> &cones, cv::Mat *debugImage = nullptr);
 
 #endif // DETECTION_HPP
@@ -0,0 +1,32 @@
+#ifndef DEVICE_HPP
+#define DEVICE_HPP
+
+#include <opencv2/opencv.hpp>
+#include "params.hpp"
+
+// OpenCL backend through OpenCV's transparent API: a frame is uploaded once
+// as a cv::UMat and the same device copy feeds colour masking, morphology
+// and ORB. Only what the host-only steps need comes back (the cone masks for
+// findContours, keypoints and descriptors for matching and the pose solver).
+// OpenCV runs any UMat call without an OpenCL kernel on the CPU by itself.
+
+// Whether `params` selects the OpenCL backend and a device is available
+bool useDevice(const AccelerationParams &params);
+
+// Device copy of `frame` shared by all stages of one frame; empty on the CPU backend
+cv::UMat uploadFrame(const cv::Mat &frame, const AccelerationParams &params);
+
+// Device copy of a host image that rarely changes (the cached car masks),
+// uploaded again only when a different image is passed in. Keeps a
+// reference to the host image, so a new one can't reuse its address
+class DeviceImageCache
+{
+public:
+    const cv::UMat &get(const cv::Mat &host);
+
+private:
+    cv::Mat source;
+    cv::UMat device;
+};
+
+#endif // DEVICE_HPP
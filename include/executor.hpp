@@ -0,0 +1,144 @@
+#ifndef EXECUTOR_HPP
+#define EXECUTOR_HPP
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "pipeline.hpp"
+#include "params.hpp"
+#include "trajectory.hpp"
+
+// Spin for a while, then yield, then sleep; keeps idle stages from burning a full core
+inline void queueBackoff(int &spins)
+{
+    if (++spins < 64)
+        return;
+    if (spins < 256)
+        std::this_thread::yield();
+    else
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+}
+
+// Bounded lock-free single-producer / single-consumer ring buffer
+// Each queue connects exactly two pipeline stages, so SPSC is all we need
+template <typename T>
+class SpscQueue
+{
+public:
+    // Holds at least one item; a signed capacity so a bad depth can't wrap around
+    explicit SpscQueue(int capacity) : slots(static_cast<size_t>(std::max(capacity, 1)) + 1) {}
+
+    // Moves from `item` only on success
+    bool tryPush(T &item)
+    {
+        size_t head = writeIndex.load(std::memory_order_relaxed);
+        size_t next = (head + 1) % slots.size();
+        if (next == readIndex.load(std::memory_order_acquire))
+            return false;
+
+        slots[head] = std::move(item);
+        writeIndex.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T &item)
+    {
+        size_t tail = readIndex.load(std::memory_order_relaxed);
+        if (tail == writeIndex.load(std::memory_order_acquire))
+            return false;
+
+        item = std::move(slots[tail]);
+        readIndex.store((tail + 1) % slots.size(), std::memory_order_release);
+        return true;
+    }
+
+    // Blocks while the queue is full
+    void push(T item)
+    {
+        int spins = 0;
+        while (!tryPush(item))
+            queueBackoff(spins);
+    }
+
+    // Blocks while the queue is empty; returns false once closed and drained
+    bool pop(T &item)
+    {
+        int spins = 0;
+        while (!tryPop(item))
+        {
+            // The producer closes after its last push, so one more try drains it
+            if (closedFlag.load(std::memory_order_acquire))
+                return tryPop(item);
+            queueBackoff(spins);
+        }
+        return true;
+    }
+
+    void close() { closedFlag.store(true, std::memory_order_release); }
+
+private:
+    std::vector<T> slots;
+    alignas(64) std::atomic<size_t> writeIndex{0};
+    alignas(64) std::atomic<size_t> readIndex{0};
+    std::atomic<bool> closedFlag{false};
+};
+
+// Everything produced for one frame as it flows through the stages
+struct FrameResult
+{
+    int index = -1;
+    std::shared_ptr<const PipelineSnapshot> snapshot; // Parameters taken at submit, pinned by every stage
+    cv::Mat frame;
+    cv::UMat deviceFrame; // Uploaded once for the OpenCL backend, read by detection and odometry; empty on the CPU
+    ConeDetectionResult cones;
+    TrackEdges edges; // Indices into cones.blueCones / cones.yellowCones
+    Centerline centerline;
+    cv::Mat trackImage; // Empty without debug rendering
+    OdometryResult odometry; // Motion since the previous frame, invalid for the first one
+    TrajectoryPoint pose;    // Accumulated pose after this frame
+    cv::Mat odometryImage;   // Empty for the first frame of a sequence
+};
+
+// Runs detection, track drawing and odometry on three threads connected by
+// bounded queues, so frame N+1 is detected while frame N is being drawn and
+// odometry runs on frames N-1/N; throughput follows the slowest stage
+class PipelinedExecutor
+{
+public:
+    using ResultCallback = std::function<void(FrameResult &)>;
+
+    // `onResult` is called on the odometry thread, in frame order
+    PipelinedExecutor(const ExecutorParams &params, ResultCallback onResult);
+    ~PipelinedExecutor();
+
+    PipelinedExecutor(const PipelinedExecutor &) = delete;
+    PipelinedExecutor &operator=(const PipelinedExecutor &) = delete;
+
+    // Blocks while the detection queue is full; the executor takes ownership of `frame`
+    void submit(int index, cv::Mat frame);
+
+    // Flushes all in-flight frames and joins the stage threads
+    void finish();
+
+private:
+    void detectionStage();
+    void trackStage();
+    void odometryStage();
+
+    ExecutorParams params;
+    ResultCallback onResult;
+
+    SpscQueue<FrameResult> detectionQueue;
+    SpscQueue<FrameResult> trackQueue;
+    SpscQueue<FrameResult> odometryQueue;
+
+    std::vector<std::thread> threads;
+    bool finished = false;
+};
+
+#endif // EXECUTOR_HPP
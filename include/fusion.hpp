@@ -0,0 +1,43 @@
+#ifndef FUSION_HPP
+#define FUSION_HPP
+
+#include <opencv2/opencv.hpp>
+#include "classifier.hpp"
+#include "detection.hpp"
+#include "params.hpp"
+
+// Pinhole projection of LIDAR points with the odometry camera intrinsics and
+// the extrinsic from FusionParams
+class LidarCameraProjection
+{
+public:
+    LidarCameraProjection(const CameraIntrinsics &intrinsics, const FusionParams &params);
+
+    cv::Point3d toCamera(const cv::Point3f &lidarPoint) const;
+
+    // False for points behind (or right at) the camera
+    bool project(const cv::Point3f &lidarPoint, cv::Point2f &pixel) const;
+
+    // Inverse for points on the horizontal plane z = groundZ (LIDAR frame):
+    // false if the pixel's ray doesn't hit it in front of the camera
+    bool backProjectToGround(const cv::Point2f &pixel, float groundZ, cv::Point3f &lidarPoint) const;
+
+    // Image box of a cone standing at `base` (LIDAR frame), empty when any
+    // corner is behind the camera
+    cv::Rect coneBox(const cv::Point3f &base, float width, float height) const;
+
+private:
+    CameraIntrinsics intrinsics;
+    cv::Matx33d R;
+    cv::Vec3d t;
+};
+
+// Colours LIDAR cones from small image patches: each cone's projected box is
+// classified with the colour LUT (car pixels excluded) and the cone takes the
+// most frequent cone colour. Cones keep their metric position and get the
+// image box/center; cones outside the image are dropped, cones without enough
+// coloured pixels keep the LIDAR guess if keepUncoloured is set.
+ConeDetectionResult fuseLidarCones(const cv::Mat &img, const ConeDetectionResult &lidarCones, const LidarCameraProjection &projection,
+                                   const HsvLut &lut, const cv::Mat &carMask, const FusionParams &params);
+
+#endif // FUSION_HPP
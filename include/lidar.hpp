@@ -0,0 +1,69 @@
+#ifndef LIDAR_HPP
+#define LIDAR_HPP
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <vector>
+#include "detection.hpp"
+#include "params.hpp"
+#include "pcd.hpp"
+
+// Top-down canvas the LIDAR cones' center/bbox refer to: x (forward) points up,
+// y (left) points left, the sensor sits at the bottom center
+const cv::Size lidarBirdsEyeSize(640, 480);
+
+cv::Point2f lidarToBirdsEye(float x, float y, const LidarParams &params);
+
+// Packs signed voxel/grid cell coordinates into one sortable key, 21 bits each
+uint64_t lidarGridKey(int ix, int iy, int iz);
+
+// n·p + d = 0 with a unit normal pointing up; height() is the signed distance
+struct GroundPlane
+{
+    cv::Vec3f normal = cv::Vec3f(0, 0, 1);
+    float d = 0.0f;
+    bool valid = false;
+
+    float height(const cv::Point3f &p) const { return normal[0] * p.x + normal[1] * p.y + normal[2] * p.z + d; }
+};
+
+// Cone detector for one LIDAR scan: range crop, RANSAC ground plane, voxel
+// grid downsampling and Euclidean clustering over an xy grid index.
+// Buffers are kept between scans, so a detector per stream avoids reallocating.
+class LidarConeDetector
+{
+public:
+    explicit LidarConeDetector(const LidarParams &params = LidarParams());
+
+    // Cones carry their base position in the sensor frame (metres) and a
+    // center/bbox on the bird's-eye canvas. LIDAR has no colour: clusters
+    // taller than largeConeHeight are orange, the rest blue on the left (y > 0)
+    // and yellow on the right, as on a standard track.
+    ConeDetectionResult detect(const PointCloudView &cloud);
+
+    const GroundPlane &groundPlane() const { return ground; }
+    // Downsampled above-ground points of the last scan
+    const std::vector<cv::Point3f> &obstaclePoints() const { return voxels; }
+
+private:
+    void cropPoints(const PointCloudView &cloud);
+    bool fitGroundPlane();
+    void removeGround();
+    void downsample();
+    void cluster();
+    ConeDetectionResult classifyClusters() const;
+
+    LidarParams params;
+    GroundPlane ground;
+
+    std::vector<std::vector<cv::Point3f>> chunks; // Per-thread crop output
+    std::vector<cv::Point3f> points;              // Cropped scan
+    std::vector<float> heights;                   // Above the ground plane
+    std::vector<cv::Point3f> obstacles;           // Above-ground points
+    std::vector<cv::Point3f> voxels;              // Voxel centroids of the obstacles
+    std::vector<std::pair<uint64_t, int>> keys;   // Voxel or grid cell key, point index
+    std::vector<int> parent;                      // Union-find over the voxels
+    std::vector<std::vector<int>> clusters;
+};
+
+#endif // LIDAR_HPP
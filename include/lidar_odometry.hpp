@@ -0,0 +1,95 @@
+#ifndef LIDAR_ODOMETRY_HPP
+#define LIDAR_ODOMETRY_HPP
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "odometry.hpp"
+#include "params.hpp"
+#include "pcd.hpp"
+#include "trajectory.hpp"
+
+// Nearest-neighbour index over a voxel hash. Cells are twice the search radius,
+// so the neighbours of a point are always in the 2x2x2 cells around it.
+class VoxelHashIndex
+{
+public:
+    void build(const std::vector<cv::Point3f> &points, float searchRadius);
+    void clear();
+    bool empty() const { return sorted.empty(); }
+
+    // Index of the nearest point within `maxDistance` (at most the search
+    // radius the index was built with), -1 if there is none
+    int nearest(const cv::Point3f &p, float maxDistance) const;
+
+    // All points within `maxDistance` (at most the search radius)
+    void radiusSearch(const cv::Point3f &p, float maxDistance, std::vector<int> &indices) const;
+
+    // Points in cell order, nearest() returns indices into this
+    const std::vector<cv::Point3f> &points() const { return sorted; }
+
+private:
+    float radius = 1.0f;
+    float inv = 0.5f;
+    std::vector<cv::Point3f> sorted;
+    std::vector<std::pair<uint64_t, int>> keys;
+    std::unordered_map<uint64_t, std::pair<int, int>> cells; // Key -> [begin, end) in sorted
+};
+
+struct IcpIteration
+{
+    double milliseconds = 0.0;
+    int correspondences = 0;
+    double rmse = 0.0;                   // Metres, over the correspondences
+    double correspondenceDistance = 0.0; // Search radius used in this iteration
+};
+
+// Scan-to-scan LIDAR odometry: point-to-plane ICP (Gauss-Newton on the
+// downsampled scans) against the previous scan, coarse to fine: the
+// correspondence radius is halved each time the alignment settles. The
+// downsampled scan, its index and normals are built once and reused as the
+// target for the next scan.
+class LidarOdometry
+{
+public:
+    explicit LidarOdometry(const LidarOdometryParams &params = LidarOdometryParams());
+
+    // Same convention as VisualOdometry, x_curr = R * x_prev + t, but with t
+    // in metres; invalid for the first scan or when ICP doesn't converge
+    OdometryResult process(const PointCloudView &cloud);
+
+    // Motion expected for the next scan in the same convention (e.g. from wheel
+    // speed); replaces the configured guess for one call
+    void setInitialGuess(const cv::Matx33d &R, const cv::Vec3d &t);
+
+    // Per-iteration timing and residuals of the last alignment
+    const std::vector<IcpIteration> &lastIterations() const { return iterations; }
+
+    void reset();
+    bool hasPreviousScan() const { return !target.empty(); }
+
+private:
+    void downsample(const PointCloudView &cloud);
+    void estimateNormals(const VoxelHashIndex &index, std::vector<cv::Vec3f> &normals) const;
+    // False unless an update settles at minCorrespondenceDistance within maxIterations
+    bool align(Pose &alignment);
+
+    LidarOdometryParams params;
+    std::vector<std::pair<uint64_t, int>> voxelKeys;
+    std::vector<cv::Point3f> filtered; // Valid points of the current scan
+    std::vector<cv::Point3f> scan;     // Voxel centroids of the current scan
+    std::vector<int> matches;          // Target index per scan point, -1 if none
+    VoxelHashIndex target;
+    VoxelHashIndex current;
+    std::vector<cv::Vec3f> targetNormals; // Zero where the neighbourhood is too sparse
+    std::vector<cv::Vec3f> currentNormals;
+
+    // Maps current scan points into the previous scan's frame
+    Pose lastAlignment;
+    Pose guess;
+    bool haveGuess = false;
+    std::vector<IcpIteration> iterations;
+};
+
+#endif // LIDAR_ODOMETRY_HPP
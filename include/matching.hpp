@@ -0,0 +1,44 @@
+#ifndef MATCHING_HPP
+#define MATCHING_HPP
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+enum MatcherBackend
+{
+    MATCHER_BRUTE_FORCE, // Exhaustive Hamming, O(N*M)
+    MATCHER_FLANN_LSH,   // Locality sensitive hashing over the binary descriptors
+    MATCHER_GRID         // Only compares keypoints near their predicted position
+};
+
+// "bruteforce", "flann_lsh" or "grid"; unknown names fall back to brute force
+MatcherBackend parseMatcherBackend(const std::string &name);
+
+enum MatchFilter
+{
+    MATCH_FILTER_DISTANCE,   // Global heuristic: within a multiple of the best distance of the frame
+    MATCH_FILTER_RATIO,      // Lowe's ratio test between the two nearest candidates
+    MATCH_FILTER_CROSS_CHECK // Mutual nearest neighbours only
+};
+
+// "distance", "ratio" or "cross_check"; unknown names fall back to distance
+MatchFilter parseMatchFilter(const std::string &name);
+
+// Nearest matches that pass the ratio test; a lone candidate is kept
+void keepRatioMatches(const std::vector<std::vector<cv::DMatch>> &knnMatches, float ratio, std::vector<cv::DMatch> &matches);
+
+// Drops the matches of `matches` that aren't also the nearest in the
+// reverse direction (`backward` matched train to query)
+void keepMutualMatches(std::vector<cv::DMatch> &matches, const std::vector<cv::DMatch> &backward);
+
+// Matches every query keypoint against the train keypoints within `searchRadius`
+// pixels of its predicted position H * p. Train keypoints are bucketed into a
+// uniform grid of `cellSize` pixels, so each query only looks at a few cells.
+// ratio > 0 applies the ratio test against the second best candidate in the window
+void matchInGrid(const std::vector<cv::KeyPoint> &queryKeypoints, const cv::Mat &queryDescriptors,
+                 const std::vector<cv::KeyPoint> &trainKeypoints, const cv::Mat &trainDescriptors,
+                 const cv::Matx33d &prediction, float cellSize, float searchRadius,
+                 std::vector<cv::DMatch> &matches, float ratio = 0.0f);
+
+#endif // MATCHING_HPP
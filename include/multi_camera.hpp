@@ -0,0 +1,59 @@
+#ifndef MULTI_CAMERA_HPP
+#define MULTI_CAMERA_HPP
+
+#include <opencv2/opencv.hpp>
+#include <memory>
+#include <vector>
+#include "classifier.hpp"
+#include "detection.hpp"
+#include "fusion.hpp"
+#include "params.hpp"
+#include "utils.hpp"
+#include "workspace.hpp"
+
+// Step 1 for several synchronized cameras in one process. Every camera keeps
+// its own parameters, colour table, car masks and workspace; a batch runs the
+// cameras as parallel tasks on the shared OpenCV pool. Cone bases are
+// back-projected onto the ground plane of the LIDAR frame and merged across
+// overlapping views, so the result has the same form as LIDAR cones: metric
+// positions plus center/bbox on the bird's-eye canvas.
+class MultiCameraPipeline
+{
+public:
+    // `cameras` in frame order; `params` (and the bird's-eye scale from `lidar`)
+    // come from the main config
+    MultiCameraPipeline(const std::vector<PipelineParams> &cameras, const MultiCameraParams &params, const LidarParams &lidar);
+
+    size_t cameraCount() const { return cameras.size(); }
+
+    // One frame per camera, taken at the same time; empty frames are skipped.
+    // Not for concurrent calls, each batch reuses the cameras' buffers
+    ConeDetectionResult process(const std::vector<cv::Mat> &frames);
+
+    // Image-space detections of each camera in the last batch
+    const ConeDetectionResult &cameraDetections(size_t camera) const { return cameras[camera]->detections; }
+
+private:
+    struct Camera
+    {
+        Camera(const PipelineParams &params);
+
+        PipelineParams params;
+        HsvLut lut;
+        LidarCameraProjection projection;
+        CarMasks carMasks; // For carMaskSize, rebuilt when the frame size changes
+        cv::Size carMaskSize;
+        DetectionWorkspace workspace;
+        ConeDetectionResult detections;
+        ConeDetectionResult placed; // Same cones on the ground, LIDAR frame
+    };
+
+    void placeOnGround(Camera &camera) const;
+    ConeDetectionResult merge() const;
+
+    MultiCameraParams params;
+    LidarParams lidar;
+    std::vector<std::unique_ptr<Camera>> cameras;
+};
+
+#endif // MULTI_CAMERA_HPP
@@ -2,8 +2,73 @@
 #define ODOMETRY_HPP
 
 #include <opencv2/opencv.hpp>
+#include <vector>
 #include "params.hpp"
+#include "matching.hpp"
+#include "device.hpp"
 
-cv::Mat calcOdometry(const cv::Mat &prevFrame, const cv::Mat &currFrame, cv::Mat negMask, const OdometryParams &params = OdometryParams());
+// Relative motion from the previous frame to the current one
+struct OdometryResult
+{
+    bool valid = false; // False for the first frame or when too few matches or pose inliers survive
+    cv::Mat R;
+    cv::Mat t; // Unit length, monocular odometry has no scale
+    int inliers = 0;
+    std::vector<cv::DMatch> matches; // Good matches, query = previous frame, train = current frame
+};
+
+// Stateful visual odometry for sequences: keeps the previous frame's keypoints
+// and descriptors plus one ORB instance, so every frame is described only once
+class VisualOdometry
+{
+public:
+    explicit VisualOdometry(const OdometryParams &params = OdometryParams());
+
+    // Describes `frame` and estimates the motion since the previous call
+    // featureMask: where keypoints may be detected, usually CarMasks::valid
+    // deviceFrame: device copy of `frame` (OpenCL backend), ORB then runs on it
+    OdometryResult process(const cv::Mat &frame, const cv::Mat &featureMask, const cv::UMat &deviceFrame = cv::UMat());
+
+    // Matches between the last two processed frames, empty until there are two
+    // and when debug rendering is off
+    cv::Mat drawLastMatches() const;
+
+    // Forget the previous frame, e.g. after a cut in the sequence
+    void reset();
+
+    bool hasPreviousFrame() const { return !prev.image.empty(); }
+
+private:
+    struct FrameFeatures
+    {
+        cv::Mat image; // Only kept for visualization
+        std::vector<cv::KeyPoint> keypoints;
+        cv::Mat descriptors;
+    };
+
+    void matchFeatures(std::vector<cv::DMatch> &matches);
+    void matchGrid(const cv::Matx33d &prediction, std::vector<cv::DMatch> &matches) const;
+    void matchExhaustive(std::vector<cv::DMatch> &matches);
+    void filterByDistance(const std::vector<cv::DMatch> &matches);
+
+    OdometryParams params;
+    cv::Ptr<cv::ORB> orb;
+    MatcherBackend backend;
+    MatchFilter filter;
+    cv::Ptr<cv::DescriptorMatcher> matcher; // Brute force or FLANN-LSH, unused by the grid backend
+    cv::Matx33d intrinsics;
+    cv::Matx33d lastRotation = cv::Matx33d::eye(); // Constant-velocity prior for the grid matcher
+    cv::Vec3d lastTranslation;                      // With lastRotation, the prior of priorGateThreshold
+    bool hasPrior = false;
+    DeviceImageCache deviceMask;                    // featureMask for ORB on the device
+
+    FrameFeatures prev;
+    FrameFeatures curr;
+    OdometryResult last;
+};
+
+// One-shot odometry between two frames; returns the match visualization
+// and optionally the estimated motion through `result`
+cv::Mat calcOdometry(const cv::Mat &prevFrame, const cv::Mat &currFrame, const cv::Mat &featureMask, const OdometryParams &params = OdometryParams(), OdometryResult *result = nullptr);
 
 #endif // ODOMETRY_HPP
@@ -5,6 +5,7 @@
 #include "json.hpp"
 #include <fstream>
 #include <iostream>
+#include <vector>
 
 using json = nlohmann::json;
 
@@ -15,6 +16,9 @@ struct ColorDetectionParams
     int erosionIterations = 1;
     int dilationIterations = 2;
     int morphKernelSize = 2;
+    bool parallelColours = true;  // Orange, blue and yellow cleanup and cone extraction as parallel tasks
+    int morphologyTiles = 0;      // Row bands per mask cleanup: 0 = one per thread from tiledMinPixels up, 1 = untiled
+    int tiledMinPixels = 1000000; // Smallest mask (ROI) the automatic mode splits into bands
 };
 
 struct ConeColorParams
@@ -43,12 +47,42 @@ struct RoadMaskParams
     cv::Scalar hsvUpper = cv::Scalar(179, 70, 190);
 };
 
+// Car polygon in fractions of the image width/height; only valid while the camera mount is fixed
+struct CarMaskParams
+{
+    std::vector<cv::Point2f> polygon = {
+        {0.05f, 1.0f}, {0.1f, 0.9f}, {0.28f, 0.9f}, {0.38f, 0.68f}, {0.62f, 0.68f}, {0.72f, 0.9f}, {0.9f, 0.9f}, {0.95f, 1.0f}};
+};
+
+// Rows colour detection runs on, in fractions of the image height; cones never
+// show up above the horizon
+struct RoiParams
+{
+    std::string mode = "none"; // "none" (full frame, as before ROIs), "static" or "cones" (follows the previous frame's cones)
+    float top = 0.38f;
+    float bottom = 1.0f;
+    float margin = 0.05f;      // "cones": kept above the highest previous cone
+};
+
+// Coarse-to-fine detection: candidates are found on a subsampled copy of the
+// ROI, then the normal full-resolution detection runs only in windows around them
+struct PyramidParams
+{
+    int level = 0;         // 0 = off (full resolution), 1 = half, 2 = quarter size
+    int refineMargin = 10; // Full-resolution pixels added around each candidate
+};
+
 struct TrackDrawingParams
 {
     int maxConeDistance = 150;
     float verticalPenaltyFactor = 3.5f;
 };
 
+struct CenterlineParams
+{
+    float maxTrackWidth = 400.0f; // Pixels; cones paired further apart than this are not across the track
+};
+
 struct CameraIntrinsics
 {
     double fx = 387.3502807617188;
@@ -69,6 +103,146 @@ struct OdometryParams
     double ransacThreshold = 1.0;
     double matchDistanceMultiplier = 2.0;
     double matchDistanceMinimum = 30.0;
+
+    int orbFeatures = 500;
+    std::string matcher = "bruteforce"; // "bruteforce", "flann_lsh" or "grid"
+    float gridCellSize = 32.0f;         // Pixels per cell for the grid matcher
+    float gridSearchRadius = 48.0f;     // Pixels around the predicted position
+    int minGridMatches = 30;            // Fewer grid matches fall back to exhaustive matching
+
+    std::string matchFilter = "distance"; // "distance" (multiplier x min distance), "ratio" or "cross_check"
+    float ratioThreshold = 0.8f;          // Ratio test: best / second best distance must be below this
+    int minPoseMatches = 5;               // Fewer filtered matches skip the pose estimation (at least 5)
+    int maxPoseMatches = 0;               // Only the best matches go into the pose estimation, 0 = all
+    std::string estimator = "ransac";     // "ransac" or "prosac" (best matches sampled first, OpenCV 4.5+)
+    int ransacMaxIterations = 1000;       // Cap on the adaptive iteration count
+    double priorGateThreshold = 0.0;      // Pixels; > 0 drops matches off the previous motion's epipolar lines first
+};
+
+struct TrajectoryParams
+{
+    std::string scaleSource = "none";  // "none" (unit steps), "wheel" (constant wheelSpeed) or "cones"
+    double frameInterval = 1.0 / 30.0; // Seconds between frames
+    double coneHeight = 0.325;         // Metres, small track cone
+    double wheelSpeed = 0.0;           // m/s for "wheel", a constant stand-in: nothing feeds in measured speed
+};
+
+struct ExecutorParams
+{
+    bool enabled = false;                    // Use the multi-threaded executor in streaming mode
+    int queueDepth = 4;                      // Frames buffered between consecutive stages, at least 1
+    bool pinThreads = false;                 // Pin each stage thread to a core (Linux only)
+    std::vector<int> stageCores = {0, 1, 2}; // Cores for detection, tracking and odometry
+};
+
+struct LidarParams
+{
+    float minRange = 1.0f;                // Metres, drops hits on the car itself
+    float maxRange = 30.0f;
+    float maxGroundZ = 0.0f;              // Ground candidates lie below the sensor
+    int ransacIterations = 64;
+    float groundThreshold = 0.05f;        // Max distance from the ground plane (m)
+    float maxGroundTilt = 15.0f;          // Degrees between the plane normal and z
+    float voxelSize = 0.05f;
+    float clusterTolerance = 0.2f;        // Max xy gap between points of one cone (m)
+    int minClusterPoints = 3;
+    int maxClusterPoints = 400;
+    float minConeHeight = 0.1f;           // Above the ground plane
+    float maxConeHeight = 0.6f;
+    float maxConeWidth = 0.4f;
+    float largeConeHeight = 0.4f;         // Taller clusters are big orange cones
+    float birdsEyePixelsPerMetre = 12.0f; // Cone center/bbox are drawn top-down at this scale
+};
+
+struct LidarOdometryParams
+{
+    float voxelSize = 0.2f;                 // Scans are downsampled to this grid before ICP
+    float maxCorrespondenceDistance = 1.0f; // Metres, first ICP iterations
+    float minCorrespondenceDistance = 0.25f; // Halved down to this one as the alignment settles
+    float normalRadius = 0.5f;              // Neighbourhood for the target normals
+    int maxIterations = 30;
+    double convergenceThreshold = 1e-3;     // Radius shrinks (or ICP stops) once an update is smaller
+    int minCorrespondences = 100;
+    std::string initialGuess = "constant_velocity"; // "identity" or "constant_velocity"
+};
+
+struct TrackerParams
+{
+    bool enabled = false;          // Track cones across frames in streaming mode
+    int fullDetectionInterval = 5; // Full-frame detection every N frames, windows around the tracks in between
+    float gateDistance = 30.0f;    // Pixels between a prediction and the detection it may take
+    int searchMargin = 24;         // Pixels added around a predicted box for local re-detection
+    int maxMissedFrames = 3;       // Frames a track survives without a detection
+    float processNoise = 4.0f;     // Acceleration variance (px^2 per frame^4)
+    float measurementNoise = 9.0f; // Detection center variance (px^2)
+};
+
+struct CalibrationParams
+{
+    bool enabled = false;        // Refit the cone colour ranges online from tracked cones
+    int minTrackAge = 3;         // Frames a cone must have been tracked before its pixels count
+    int minSamples = 2000;       // Pixels per colour range before it is refitted
+    float learningRate = 0.3f;   // How far each refit moves the bounds towards the fitted ones
+    float lowPercentile = 0.02f; // Fitted bounds ignore this share of the samples on each side
+    float highPercentile = 0.98f;
+    int hueTolerance = 5;        // Pixels this far outside the current range are still sampled
+    int satValTolerance = 40;
+    int maxDrift = 30;           // Bounds never move further than this from the built-in ranges
+};
+
+struct FusionParams
+{
+    // LIDAR to camera: the axes are swapped first (LIDAR x forward, y left,
+    // z up to camera x right, y down, z forward), then rotated by roll/pitch/yaw
+    // about the camera x/y/z axes and moved by translation (metres, camera frame)
+    std::vector<double> rollPitchYaw = {0.0, 0.0, 0.0}; // Degrees
+    std::vector<double> translation = {0.0, 0.0, 0.0};
+    float coneWidth = 0.23f;   // Metres, box projected around each cluster
+    float coneHeight = 0.325f;
+    int patchMargin = 6;       // Pixels added around the projected box
+    int minColourPixels = 15;  // Classified pixels needed to colour a cone
+    bool keepUncoloured = true; // Keep the LIDAR colour guess when the patch has too few pixels
+};
+
+// Synchronized cameras processed as one batch. Each camera has its own config
+// file (masks, ROI, colours, odometry.cameraIntrinsics and the fusion
+// extrinsic); cone bases are put on the ground plane of the LIDAR frame and
+// merged where the views overlap
+struct MultiCameraParams
+{
+    std::vector<std::string> cameras; // Config file per camera, in frame order; empty = this config for every frame
+    float groundZ = -1.5f;            // Ground plane height in the LIDAR frame (m)
+    float maxRange = 30.0f;           // Cones placed further away than this are dropped
+    float mergeDistance = 0.5f;       // Same-colour cones of different cameras closer than this are one cone
+};
+
+// Where the image stages run. "opencl" moves colour masking, morphology and
+// ORB onto the GPU through OpenCV's transparent API (cv::UMat); without an
+// OpenCL device everything stays on the CPU
+struct AccelerationParams
+{
+    std::string backend = "cpu"; // "cpu" or "opencl"
+};
+
+// Live parameter changes: with watchConfig the config file is polled and
+// reloaded when it changes; frames already running keep the old values
+struct HotReloadParams
+{
+    bool watchConfig = false;
+    int pollIntervalMs = 500;
+};
+
+// Recorded logs (include/recording.hpp) and their offline replay. The replay
+// cuts the log into segments of segmentLength frames that run as parallel
+// tasks; the cut only depends on the log, so the outputs don't change with
+// the number of cores
+struct ReplayParams
+{
+    std::string frameEncoding = "png"; // How `record` stores frames: "png", "jpg" or "raw"
+    int segmentLength = 200;           // Frames per segment, 0 = the whole log in one
+    int threads = 0;                   // Worker threads, 0 = OpenCV's default
+    float coneTolerance = 2.0f;        // Pixels a cone may move before it differs from the baseline
+    double poseTolerance = 1e-3;       // Translation difference counted as a changed pose
 };
 
 // Main configuration structure
@@ -80,154 +254,468 @@ struct PipelineParams
     ColorDetectionParams colorDetection;
     ConeDetectionParams coneDetection;
     RoadMaskParams roadMask;
+    CarMaskParams carMask;
+    RoiParams roi;
+    PyramidParams pyramid;
     TrackDrawingParams trackDrawing;
+    CenterlineParams centerline;
     OdometryParams odometry;
-
-    // Load from JSON file
-    static PipelineParams loadFromFile(const std::string &filepath)
+    TrajectoryParams trajectory;
+    ExecutorParams executor;
+    LidarParams lidar;
+    LidarOdometryParams lidarOdometry;
+    TrackerParams tracker;
+    CalibrationParams calibration;
+    FusionParams fusion;
+    MultiCameraParams multiCamera;
+    AccelerationParams acceleration;
+    HotReloadParams hotReload;
+    ReplayParams replay;
+
+    // Parse from an already loaded JSON object; missing keys keep their defaults
+    static PipelineParams fromJson(const json &j)
     {
         PipelineParams params;
 
-        try
+        // Parse color detection
+        if (j.contains("colorDetection"))
         {
-            std::ifstream file(filepath);
-            if (!file.is_open())
+            auto &cd = j["colorDetection"];
+            if (cd.contains("erosionIterations"))
+                params.colorDetection.erosionIterations = cd["erosionIterations"];
+            if (cd.contains("dilationIterations"))
+                params.colorDetection.dilationIterations = cd["dilationIterations"];
+            if (cd.contains("morphKernelSize"))
+                params.colorDetection.morphKernelSize = cd["morphKernelSize"];
+            if (cd.contains("parallelColours"))
+                params.colorDetection.parallelColours = cd["parallelColours"];
+            if (cd.contains("morphologyTiles"))
+                params.colorDetection.morphologyTiles = cd["morphologyTiles"];
+            if (cd.contains("tiledMinPixels"))
+                params.colorDetection.tiledMinPixels = cd["tiledMinPixels"];
+        }
+
+        // Parse cone detection
+        if (j.contains("coneDetection"))
+        {
+            auto &cone = j["coneDetection"];
+            if (cone.contains("minBoundingBoxArea"))
+                params.coneDetection.minBoundingBoxArea = cone["minBoundingBoxArea"];
+            if (cone.contains("maxBoundingBoxArea"))
+                params.coneDetection.maxBoundingBoxArea = cone["maxBoundingBoxArea"];
+            if (cone.contains("verticalMergeThreshold"))
+                params.coneDetection.verticalMergeThreshold = cone["verticalMergeThreshold"];
+            if (cone.contains("horizontalMergeThreshold"))
+                params.coneDetection.horizontalMergeThreshold = cone["horizontalMergeThreshold"];
+
+            // Orange cones
+            if (cone.contains("orange"))
             {
-                std::cerr << "Warning: Could not open config file: " << filepath << std::endl;
-                std::cerr << "Using default parameters" << std::endl;
-                return params;
+                auto &orange = cone["orange"];
+                if (orange.contains("maxBoundingBoxArea"))
+                    params.coneDetection.orange.maxBoundingBoxArea = orange["maxBoundingBoxArea"];
+                if (orange.contains("verticalMergeThreshold"))
+                    params.coneDetection.orange.verticalMergeThreshold = orange["verticalMergeThreshold"];
+                if (orange.contains("horizontalMergeThreshold"))
+                    params.coneDetection.orange.horizontalMergeThreshold = orange["horizontalMergeThreshold"];
+                if (orange.contains("keepClosestN"))
+                    params.coneDetection.orange.keepClosestN = orange["keepClosestN"];
             }
 
-            json j;
-            file >> j;
-
-            // Parse color detection
-            if (j.contains("colorDetection"))
+            // Blue cones
+            if (cone.contains("blue"))
             {
-                auto &cd = j["colorDetection"];
-                if (cd.contains("erosionIterations"))
-                    params.colorDetection.erosionIterations = cd["erosionIterations"];
-                if (cd.contains("dilationIterations"))
-                    params.colorDetection.dilationIterations = cd["dilationIterations"];
-                if (cd.contains("morphKernelSize"))
-                    params.colorDetection.morphKernelSize = cd["morphKernelSize"];
+                auto &blue = cone["blue"];
+                if (blue.contains("verticalMergeThreshold"))
+                    params.coneDetection.blue.verticalMergeThreshold = blue["verticalMergeThreshold"];
             }
 
-            // Parse cone detection
-            if (j.contains("coneDetection"))
+            // Yellow cones
+            if (cone.contains("yellow"))
             {
-                auto &cone = j["coneDetection"];
-                if (cone.contains("minBoundingBoxArea"))
-                    params.coneDetection.minBoundingBoxArea = cone["minBoundingBoxArea"];
-                if (cone.contains("maxBoundingBoxArea"))
-                    params.coneDetection.maxBoundingBoxArea = cone["maxBoundingBoxArea"];
-                if (cone.contains("verticalMergeThreshold"))
-                    params.coneDetection.verticalMergeThreshold = cone["verticalMergeThreshold"];
-                if (cone.contains("horizontalMergeThreshold"))
-                    params.coneDetection.horizontalMergeThreshold = cone["horizontalMergeThreshold"];
-
-                // Orange cones
-                if (cone.contains("orange"))
-                {
-                    auto &orange = cone["orange"];
-                    if (orange.contains("maxBoundingBoxArea"))
-                        params.coneDetection.orange.maxBoundingBoxArea = orange["maxBoundingBoxArea"];
-                    if (orange.contains("verticalMergeThreshold"))
-                        params.coneDetection.orange.verticalMergeThreshold = orange["verticalMergeThreshold"];
-                    if (orange.contains("horizontalMergeThreshold"))
-                        params.coneDetection.orange.horizontalMergeThreshold = orange["horizontalMergeThreshold"];
-                    if (orange.contains("keepClosestN"))
-                        params.coneDetection.orange.keepClosestN = orange["keepClosestN"];
-                }
-
-                // Blue cones
-                if (cone.contains("blue"))
-                {
-                    auto &blue = cone["blue"];
-                    if (blue.contains("verticalMergeThreshold"))
-                        params.coneDetection.blue.verticalMergeThreshold = blue["verticalMergeThreshold"];
-                }
-
-                // Yellow cones
-                if (cone.contains("yellow"))
-                {
-                    auto &yellow = cone["yellow"];
-                    if (yellow.contains("verticalMergeThreshold"))
-                        params.coneDetection.yellow.verticalMergeThreshold = yellow["verticalMergeThreshold"];
-                }
+                auto &yellow = cone["yellow"];
+                if (yellow.contains("verticalMergeThreshold"))
+                    params.coneDetection.yellow.verticalMergeThreshold = yellow["verticalMergeThreshold"];
             }
+        }
 
-            // Parse road mask
-            if (j.contains("roadMask"))
+        // Parse road mask
+        if (j.contains("roadMask"))
+        {
+            auto &road = j["roadMask"];
+            if (road.contains("hsvLower") && road["hsvLower"].is_array() && road["hsvLower"].size() == 3)
             {
-                auto &road = j["roadMask"];
-                if (road.contains("hsvLower") && road["hsvLower"].is_array() && road["hsvLower"].size() == 3)
-                {
-                    params.roadMask.hsvLower = cv::Scalar(
-                        road["hsvLower"][0].get<int>(),
-                        road["hsvLower"][1].get<int>(),
-                        road["hsvLower"][2].get<int>());
-                }
-                if (road.contains("hsvUpper") && road["hsvUpper"].is_array() && road["hsvUpper"].size() == 3)
-                {
-                    params.roadMask.hsvUpper = cv::Scalar(
-                        road["hsvUpper"][0].get<int>(),
-                        road["hsvUpper"][1].get<int>(),
-                        road["hsvUpper"][2].get<int>());
-                }
+                params.roadMask.hsvLower = cv::Scalar(
+                    road["hsvLower"][0].get<int>(),
+                    road["hsvLower"][1].get<int>(),
+                    road["hsvLower"][2].get<int>());
             }
+            if (road.contains("hsvUpper") && road["hsvUpper"].is_array() && road["hsvUpper"].size() == 3)
+            {
+                params.roadMask.hsvUpper = cv::Scalar(
+                    road["hsvUpper"][0].get<int>(),
+                    road["hsvUpper"][1].get<int>(),
+                    road["hsvUpper"][2].get<int>());
+            }
+        }
 
-            // Parse track drawing
-            if (j.contains("trackDrawing"))
+        // Parse car mask
+        if (j.contains("carMask"))
+        {
+            auto &car = j["carMask"];
+            if (car.contains("polygon") && car["polygon"].is_array() && car["polygon"].size() >= 3)
             {
-                auto &track = j["trackDrawing"];
-                if (track.contains("maxConeDistance"))
-                    params.trackDrawing.maxConeDistance = track["maxConeDistance"];
-                if (track.contains("verticalPenaltyFactor"))
-                    params.trackDrawing.verticalPenaltyFactor = track["verticalPenaltyFactor"];
+                params.carMask.polygon.clear();
+                for (const auto &pt : car["polygon"])
+                    params.carMask.polygon.emplace_back(pt[0].get<float>(), pt[1].get<float>());
             }
+        }
+
+        // Parse detection ROI
+        if (j.contains("roi"))
+        {
+            auto &roi = j["roi"];
+            if (roi.contains("mode"))
+                params.roi.mode = roi["mode"];
+            if (roi.contains("top"))
+                params.roi.top = roi["top"];
+            if (roi.contains("bottom"))
+                params.roi.bottom = roi["bottom"];
+            if (roi.contains("margin"))
+                params.roi.margin = roi["margin"];
+        }
+
+        // Parse coarse-to-fine detection
+        if (j.contains("pyramid"))
+        {
+            auto &pyramid = j["pyramid"];
+            if (pyramid.contains("level"))
+                params.pyramid.level = pyramid["level"];
+            if (pyramid.contains("refineMargin"))
+                params.pyramid.refineMargin = pyramid["refineMargin"];
+        }
+
+        // Parse track drawing
+        if (j.contains("trackDrawing"))
+        {
+            auto &track = j["trackDrawing"];
+            if (track.contains("maxConeDistance"))
+                params.trackDrawing.maxConeDistance = track["maxConeDistance"];
+            if (track.contains("verticalPenaltyFactor"))
+                params.trackDrawing.verticalPenaltyFactor = track["verticalPenaltyFactor"];
+        }
 
-            // Parse odometry
-            if (j.contains("odometry"))
+        // Parse centerline
+        if (j.contains("centerline"))
+        {
+            auto &centerline = j["centerline"];
+            if (centerline.contains("maxTrackWidth"))
+                params.centerline.maxTrackWidth = centerline["maxTrackWidth"];
+        }
+
+        // Parse odometry
+        if (j.contains("odometry"))
+        {
+            auto &odom = j["odometry"];
+
+            if (odom.contains("cameraIntrinsics"))
             {
-                auto &odom = j["odometry"];
+                auto &intr = odom["cameraIntrinsics"];
+                if (intr.contains("fx"))
+                    params.odometry.cameraIntrinsics.fx = intr["fx"];
+                if (intr.contains("fy"))
+                    params.odometry.cameraIntrinsics.fy = intr["fy"];
+                if (intr.contains("cx"))
+                    params.odometry.cameraIntrinsics.cx = intr["cx"];
+                if (intr.contains("cy"))
+                    params.odometry.cameraIntrinsics.cy = intr["cy"];
+            }
 
-                if (odom.contains("cameraIntrinsics"))
+            if (odom.contains("ransacConfidence"))
+                params.odometry.ransacConfidence = odom["ransacConfidence"];
+            if (odom.contains("ransacThreshold"))
+                params.odometry.ransacThreshold = odom["ransacThreshold"];
+            if (odom.contains("matchDistanceMultiplier"))
+                params.odometry.matchDistanceMultiplier = odom["matchDistanceMultiplier"];
+            if (odom.contains("matchDistanceMinimum"))
+                params.odometry.matchDistanceMinimum = odom["matchDistanceMinimum"];
+            if (odom.contains("orbFeatures"))
+                params.odometry.orbFeatures = odom["orbFeatures"];
+            if (odom.contains("matcher"))
+                params.odometry.matcher = odom["matcher"];
+            if (odom.contains("gridCellSize"))
+                params.odometry.gridCellSize = odom["gridCellSize"];
+            if (odom.contains("gridSearchRadius"))
+                params.odometry.gridSearchRadius = odom["gridSearchRadius"];
+            if (odom.contains("minGridMatches"))
+                params.odometry.minGridMatches = odom["minGridMatches"];
+            if (odom.contains("matchFilter"))
+                params.odometry.matchFilter = odom["matchFilter"];
+            if (odom.contains("ratioThreshold"))
+                params.odometry.ratioThreshold = odom["ratioThreshold"];
+            if (odom.contains("minPoseMatches"))
+                params.odometry.minPoseMatches = odom["minPoseMatches"];
+            if (odom.contains("maxPoseMatches"))
+                params.odometry.maxPoseMatches = odom["maxPoseMatches"];
+            if (odom.contains("estimator"))
+                params.odometry.estimator = odom["estimator"];
+            if (odom.contains("ransacMaxIterations"))
+                params.odometry.ransacMaxIterations = odom["ransacMaxIterations"];
+            if (odom.contains("priorGateThreshold"))
+                params.odometry.priorGateThreshold = odom["priorGateThreshold"];
+        }
+
+        // Parse trajectory
+        if (j.contains("trajectory"))
+        {
+            auto &traj = j["trajectory"];
+            if (traj.contains("scaleSource"))
+                params.trajectory.scaleSource = traj["scaleSource"];
+            if (traj.contains("frameInterval"))
+                params.trajectory.frameInterval = traj["frameInterval"];
+            if (traj.contains("coneHeight"))
+                params.trajectory.coneHeight = traj["coneHeight"];
+            if (traj.contains("wheelSpeed"))
+                params.trajectory.wheelSpeed = traj["wheelSpeed"];
+        }
+
+        // Parse executor
+        if (j.contains("executor"))
+        {
+            auto &exec = j["executor"];
+            if (exec.contains("enabled"))
+                params.executor.enabled = exec["enabled"];
+            if (exec.contains("queueDepth"))
+            {
+                // Queue capacities are size_t: anything below one frame would wrap around
+                params.executor.queueDepth = exec["queueDepth"];
+                if (params.executor.queueDepth < 1)
                 {
-                    auto &intr = odom["cameraIntrinsics"];
-                    if (intr.contains("fx"))
-                        params.odometry.cameraIntrinsics.fx = intr["fx"];
-                    if (intr.contains("fy"))
-                        params.odometry.cameraIntrinsics.fy = intr["fy"];
-                    if (intr.contains("cx"))
-                        params.odometry.cameraIntrinsics.cx = intr["cx"];
-                    if (intr.contains("cy"))
-                        params.odometry.cameraIntrinsics.cy = intr["cy"];
+                    std::cerr << "Warning: executor.queueDepth must be at least 1, using 1" << std::endl;
+                    params.executor.queueDepth = 1;
                 }
-
-                if (odom.contains("ransacConfidence"))
-                    params.odometry.ransacConfidence = odom["ransacConfidence"];
-                if (odom.contains("ransacThreshold"))
-                    params.odometry.ransacThreshold = odom["ransacThreshold"];
-                if (odom.contains("matchDistanceMultiplier"))
-                    params.odometry.matchDistanceMultiplier = odom["matchDistanceMultiplier"];
-                if (odom.contains("matchDistanceMinimum"))
-                    params.odometry.matchDistanceMinimum = odom["matchDistanceMinimum"];
             }
+            if (exec.contains("pinThreads"))
+                params.executor.pinThreads = exec["pinThreads"];
+            if (exec.contains("stageCores") && exec["stageCores"].is_array())
+                params.executor.stageCores = exec["stageCores"].get<std::vector<int>>();
+        }
+
+        // Parse LIDAR detection
+        if (j.contains("lidar"))
+        {
+            auto &lidarJson = j["lidar"];
+            if (lidarJson.contains("minRange"))
+                params.lidar.minRange = lidarJson["minRange"];
+            if (lidarJson.contains("maxRange"))
+                params.lidar.maxRange = lidarJson["maxRange"];
+            if (lidarJson.contains("maxGroundZ"))
+                params.lidar.maxGroundZ = lidarJson["maxGroundZ"];
+            if (lidarJson.contains("ransacIterations"))
+                params.lidar.ransacIterations = lidarJson["ransacIterations"];
+            if (lidarJson.contains("groundThreshold"))
+                params.lidar.groundThreshold = lidarJson["groundThreshold"];
+            if (lidarJson.contains("maxGroundTilt"))
+                params.lidar.maxGroundTilt = lidarJson["maxGroundTilt"];
+            if (lidarJson.contains("voxelSize"))
+                params.lidar.voxelSize = lidarJson["voxelSize"];
+            if (lidarJson.contains("clusterTolerance"))
+                params.lidar.clusterTolerance = lidarJson["clusterTolerance"];
+            if (lidarJson.contains("minClusterPoints"))
+                params.lidar.minClusterPoints = lidarJson["minClusterPoints"];
+            if (lidarJson.contains("maxClusterPoints"))
+                params.lidar.maxClusterPoints = lidarJson["maxClusterPoints"];
+            if (lidarJson.contains("minConeHeight"))
+                params.lidar.minConeHeight = lidarJson["minConeHeight"];
+            if (lidarJson.contains("maxConeHeight"))
+                params.lidar.maxConeHeight = lidarJson["maxConeHeight"];
+            if (lidarJson.contains("maxConeWidth"))
+                params.lidar.maxConeWidth = lidarJson["maxConeWidth"];
+            if (lidarJson.contains("largeConeHeight"))
+                params.lidar.largeConeHeight = lidarJson["largeConeHeight"];
+            if (lidarJson.contains("birdsEyePixelsPerMetre"))
+                params.lidar.birdsEyePixelsPerMetre = lidarJson["birdsEyePixelsPerMetre"];
+        }
+
+        // Parse LIDAR odometry
+        if (j.contains("lidarOdometry"))
+        {
+            auto &icp = j["lidarOdometry"];
+            if (icp.contains("voxelSize"))
+                params.lidarOdometry.voxelSize = icp["voxelSize"];
+            if (icp.contains("maxCorrespondenceDistance"))
+                params.lidarOdometry.maxCorrespondenceDistance = icp["maxCorrespondenceDistance"];
+            if (icp.contains("minCorrespondenceDistance"))
+                params.lidarOdometry.minCorrespondenceDistance = icp["minCorrespondenceDistance"];
+            if (icp.contains("normalRadius"))
+                params.lidarOdometry.normalRadius = icp["normalRadius"];
+            if (icp.contains("maxIterations"))
+                params.lidarOdometry.maxIterations = icp["maxIterations"];
+            if (icp.contains("convergenceThreshold"))
+                params.lidarOdometry.convergenceThreshold = icp["convergenceThreshold"];
+            if (icp.contains("minCorrespondences"))
+                params.lidarOdometry.minCorrespondences = icp["minCorrespondences"];
+            if (icp.contains("initialGuess"))
+                params.lidarOdometry.initialGuess = icp["initialGuess"];
+        }
 
+        // Parse cone tracker
+        if (j.contains("tracker"))
+        {
+            auto &tracker = j["tracker"];
+            if (tracker.contains("enabled"))
+                params.tracker.enabled = tracker["enabled"];
+            if (tracker.contains("fullDetectionInterval"))
+                params.tracker.fullDetectionInterval = tracker["fullDetectionInterval"];
+            if (tracker.contains("gateDistance"))
+                params.tracker.gateDistance = tracker["gateDistance"];
+            if (tracker.contains("searchMargin"))
+                params.tracker.searchMargin = tracker["searchMargin"];
+            if (tracker.contains("maxMissedFrames"))
+                params.tracker.maxMissedFrames = tracker["maxMissedFrames"];
+            if (tracker.contains("processNoise"))
+                params.tracker.processNoise = tracker["processNoise"];
+            if (tracker.contains("measurementNoise"))
+                params.tracker.measurementNoise = tracker["measurementNoise"];
+        }
+
+        // Parse colour calibration
+        if (j.contains("calibration"))
+        {
+            auto &cal = j["calibration"];
+            if (cal.contains("enabled"))
+                params.calibration.enabled = cal["enabled"];
+            if (cal.contains("minTrackAge"))
+                params.calibration.minTrackAge = cal["minTrackAge"];
+            if (cal.contains("minSamples"))
+                params.calibration.minSamples = cal["minSamples"];
+            if (cal.contains("learningRate"))
+                params.calibration.learningRate = cal["learningRate"];
+            if (cal.contains("lowPercentile"))
+                params.calibration.lowPercentile = cal["lowPercentile"];
+            if (cal.contains("highPercentile"))
+                params.calibration.highPercentile = cal["highPercentile"];
+            if (cal.contains("hueTolerance"))
+                params.calibration.hueTolerance = cal["hueTolerance"];
+            if (cal.contains("satValTolerance"))
+                params.calibration.satValTolerance = cal["satValTolerance"];
+            if (cal.contains("maxDrift"))
+                params.calibration.maxDrift = cal["maxDrift"];
+        }
+
+        // Parse camera-LIDAR fusion
+        if (j.contains("fusion"))
+        {
+            auto &fusion = j["fusion"];
+            if (fusion.contains("rollPitchYaw") && fusion["rollPitchYaw"].is_array() && fusion["rollPitchYaw"].size() == 3)
+                params.fusion.rollPitchYaw = fusion["rollPitchYaw"].get<std::vector<double>>();
+            if (fusion.contains("translation") && fusion["translation"].is_array() && fusion["translation"].size() == 3)
+                params.fusion.translation = fusion["translation"].get<std::vector<double>>();
+            if (fusion.contains("coneWidth"))
+                params.fusion.coneWidth = fusion["coneWidth"];
+            if (fusion.contains("coneHeight"))
+                params.fusion.coneHeight = fusion["coneHeight"];
+            if (fusion.contains("patchMargin"))
+                params.fusion.patchMargin = fusion["patchMargin"];
+            if (fusion.contains("minColourPixels"))
+                params.fusion.minColourPixels = fusion["minColourPixels"];
+            if (fusion.contains("keepUncoloured"))
+                params.fusion.keepUncoloured = fusion["keepUncoloured"];
+        }
+
+        // Parse multi-camera batch
+        if (j.contains("multiCamera"))
+        {
+            auto &multi = j["multiCamera"];
+            if (multi.contains("cameras") && multi["cameras"].is_array())
+                params.multiCamera.cameras = multi["cameras"].get<std::vector<std::string>>();
+            if (multi.contains("groundZ"))
+                params.multiCamera.groundZ = multi["groundZ"];
+            if (multi.contains("maxRange"))
+                params.multiCamera.maxRange = multi["maxRange"];
+            if (multi.contains("mergeDistance"))
+                params.multiCamera.mergeDistance = multi["mergeDistance"];
+        }
+
+        // Parse acceleration backend
+        if (j.contains("acceleration"))
+        {
+            auto &accel = j["acceleration"];
+            if (accel.contains("backend"))
+                params.acceleration.backend = accel["backend"];
+        }
+
+        // Parse hot reload
+        if (j.contains("hotReload"))
+        {
+            auto &reload = j["hotReload"];
+            if (reload.contains("watchConfig"))
+                params.hotReload.watchConfig = reload["watchConfig"];
+            if (reload.contains("pollIntervalMs"))
+                params.hotReload.pollIntervalMs = reload["pollIntervalMs"];
+        }
+
+        // Parse log replay
+        if (j.contains("replay"))
+        {
+            auto &replay = j["replay"];
+            if (replay.contains("frameEncoding"))
+                params.replay.frameEncoding = replay["frameEncoding"];
+            if (replay.contains("segmentLength"))
+                params.replay.segmentLength = replay["segmentLength"];
+            if (replay.contains("threads"))
+                params.replay.threads = replay["threads"];
+            if (replay.contains("coneTolerance"))
+                params.replay.coneTolerance = replay["coneTolerance"];
+            if (replay.contains("poseTolerance"))
+                params.replay.poseTolerance = replay["poseTolerance"];
+        }
+
+        return params;
+    }
+
+    // Load from JSON file
+    static PipelineParams loadFromFile(const std::string &filepath)
+    {
+        PipelineParams params;
+        if (tryLoadFromFile(filepath, params))
             std::cout << "Loaded parameters from: " << filepath << std::endl;
+        else
+            std::cerr << "Using default parameters" << std::endl;
+        return params;
+    }
+
+    // Same, but leaves `params` alone if the file can't be opened or parsed
+    static bool tryLoadFromFile(const std::string &filepath, PipelineParams &params)
+    {
+        try
+        {
+            std::ifstream file(filepath);
+            if (!file.is_open())
+            {
+                std::cerr << "Warning: Could not open config file: " << filepath << std::endl;
+                return false;
+            }
+
+            json j;
+            file >> j;
+            params = fromJson(j);
+            return true;
         }
         catch (const std::exception &e)
         {
             std::cerr << "Error parsing config file: " << e.what() << std::endl;
-            std::cerr << "Using default parameters" << std::endl;
+            return false;
         }
+    }
 
-        return params;
+    // Whether the top-level section `key` (e.g. "tracker") differs between two sets
+    static bool sectionChanged(const PipelineParams &a, const PipelineParams &b, const std::string &key)
+    {
+        return a.toJson()[key] != b.toJson()[key];
     }
 
-    // Save to JSON file
-    void saveToFile(const std::string &filepath) const
+    json toJson() const
     {
         json j;
 
@@ -238,6 +726,9 @@ struct PipelineParams
         j["colorDetection"]["erosionIterations"] = colorDetection.erosionIterations;
         j["colorDetection"]["dilationIterations"] = colorDetection.dilationIterations;
         j["colorDetection"]["morphKernelSize"] = colorDetection.morphKernelSize;
+        j["colorDetection"]["parallelColours"] = colorDetection.parallelColours;
+        j["colorDetection"]["morphologyTiles"] = colorDetection.morphologyTiles;
+        j["colorDetection"]["tiledMinPixels"] = colorDetection.tiledMinPixels;
 
         // Cone detection
         j["coneDetection"]["minBoundingBoxArea"] = coneDetection.minBoundingBoxArea;
@@ -263,10 +754,26 @@ struct PipelineParams
             (int)roadMask.hsvUpper[1],
             (int)roadMask.hsvUpper[2]};
 
+        // Car mask
+        j["carMask"]["polygon"] = json::array();
+        for (const auto &pt : carMask.polygon)
+            j["carMask"]["polygon"].push_back(json::array({pt.x, pt.y}));
+
+        // Detection ROI
+        j["roi"]["mode"] = roi.mode;
+        j["roi"]["top"] = roi.top;
+        j["roi"]["bottom"] = roi.bottom;
+        j["roi"]["margin"] = roi.margin;
+
+        j["pyramid"]["level"] = pyramid.level;
+        j["pyramid"]["refineMargin"] = pyramid.refineMargin;
+
         // Track drawing
         j["trackDrawing"]["maxConeDistance"] = trackDrawing.maxConeDistance;
         j["trackDrawing"]["verticalPenaltyFactor"] = trackDrawing.verticalPenaltyFactor;
 
+        j["centerline"]["maxTrackWidth"] = centerline.maxTrackWidth;
+
         // Odometry
         j["odometry"]["cameraIntrinsics"]["fx"] = odometry.cameraIntrinsics.fx;
         j["odometry"]["cameraIntrinsics"]["fy"] = odometry.cameraIntrinsics.fy;
@@ -277,6 +784,107 @@ struct PipelineParams
         j["odometry"]["ransacThreshold"] = odometry.ransacThreshold;
         j["odometry"]["matchDistanceMultiplier"] = odometry.matchDistanceMultiplier;
         j["odometry"]["matchDistanceMinimum"] = odometry.matchDistanceMinimum;
+        j["odometry"]["orbFeatures"] = odometry.orbFeatures;
+        j["odometry"]["matcher"] = odometry.matcher;
+        j["odometry"]["gridCellSize"] = odometry.gridCellSize;
+        j["odometry"]["gridSearchRadius"] = odometry.gridSearchRadius;
+        j["odometry"]["minGridMatches"] = odometry.minGridMatches;
+        j["odometry"]["matchFilter"] = odometry.matchFilter;
+        j["odometry"]["ratioThreshold"] = odometry.ratioThreshold;
+        j["odometry"]["minPoseMatches"] = odometry.minPoseMatches;
+        j["odometry"]["maxPoseMatches"] = odometry.maxPoseMatches;
+        j["odometry"]["estimator"] = odometry.estimator;
+        j["odometry"]["ransacMaxIterations"] = odometry.ransacMaxIterations;
+        j["odometry"]["priorGateThreshold"] = odometry.priorGateThreshold;
+
+        // Trajectory
+        j["trajectory"]["scaleSource"] = trajectory.scaleSource;
+        j["trajectory"]["frameInterval"] = trajectory.frameInterval;
+        j["trajectory"]["coneHeight"] = trajectory.coneHeight;
+        j["trajectory"]["wheelSpeed"] = trajectory.wheelSpeed;
+
+        // Executor
+        j["executor"]["enabled"] = executor.enabled;
+        j["executor"]["queueDepth"] = executor.queueDepth;
+        j["executor"]["pinThreads"] = executor.pinThreads;
+        j["executor"]["stageCores"] = executor.stageCores;
+
+        // LIDAR detection
+        j["lidar"]["minRange"] = lidar.minRange;
+        j["lidar"]["maxRange"] = lidar.maxRange;
+        j["lidar"]["maxGroundZ"] = lidar.maxGroundZ;
+        j["lidar"]["ransacIterations"] = lidar.ransacIterations;
+        j["lidar"]["groundThreshold"] = lidar.groundThreshold;
+        j["lidar"]["maxGroundTilt"] = lidar.maxGroundTilt;
+        j["lidar"]["voxelSize"] = lidar.voxelSize;
+        j["lidar"]["clusterTolerance"] = lidar.clusterTolerance;
+        j["lidar"]["minClusterPoints"] = lidar.minClusterPoints;
+        j["lidar"]["maxClusterPoints"] = lidar.maxClusterPoints;
+        j["lidar"]["minConeHeight"] = lidar.minConeHeight;
+        j["lidar"]["maxConeHeight"] = lidar.maxConeHeight;
+        j["lidar"]["maxConeWidth"] = lidar.maxConeWidth;
+        j["lidar"]["largeConeHeight"] = lidar.largeConeHeight;
+        j["lidar"]["birdsEyePixelsPerMetre"] = lidar.birdsEyePixelsPerMetre;
+
+        // LIDAR odometry
+        j["lidarOdometry"]["voxelSize"] = lidarOdometry.voxelSize;
+        j["lidarOdometry"]["maxCorrespondenceDistance"] = lidarOdometry.maxCorrespondenceDistance;
+        j["lidarOdometry"]["minCorrespondenceDistance"] = lidarOdometry.minCorrespondenceDistance;
+        j["lidarOdometry"]["normalRadius"] = lidarOdometry.normalRadius;
+        j["lidarOdometry"]["maxIterations"] = lidarOdometry.maxIterations;
+        j["lidarOdometry"]["convergenceThreshold"] = lidarOdometry.convergenceThreshold;
+        j["lidarOdometry"]["minCorrespondences"] = lidarOdometry.minCorrespondences;
+        j["lidarOdometry"]["initialGuess"] = lidarOdometry.initialGuess;
+
+        j["tracker"]["enabled"] = tracker.enabled;
+        j["tracker"]["fullDetectionInterval"] = tracker.fullDetectionInterval;
+        j["tracker"]["gateDistance"] = tracker.gateDistance;
+        j["tracker"]["searchMargin"] = tracker.searchMargin;
+        j["tracker"]["maxMissedFrames"] = tracker.maxMissedFrames;
+        j["tracker"]["processNoise"] = tracker.processNoise;
+        j["tracker"]["measurementNoise"] = tracker.measurementNoise;
+
+        j["calibration"]["enabled"] = calibration.enabled;
+        j["calibration"]["minTrackAge"] = calibration.minTrackAge;
+        j["calibration"]["minSamples"] = calibration.minSamples;
+        j["calibration"]["learningRate"] = calibration.learningRate;
+        j["calibration"]["lowPercentile"] = calibration.lowPercentile;
+        j["calibration"]["highPercentile"] = calibration.highPercentile;
+        j["calibration"]["hueTolerance"] = calibration.hueTolerance;
+        j["calibration"]["satValTolerance"] = calibration.satValTolerance;
+        j["calibration"]["maxDrift"] = calibration.maxDrift;
+
+        j["fusion"]["rollPitchYaw"] = fusion.rollPitchYaw;
+        j["fusion"]["translation"] = fusion.translation;
+        j["fusion"]["coneWidth"] = fusion.coneWidth;
+        j["fusion"]["coneHeight"] = fusion.coneHeight;
+        j["fusion"]["patchMargin"] = fusion.patchMargin;
+        j["fusion"]["minColourPixels"] = fusion.minColourPixels;
+        j["fusion"]["keepUncoloured"] = fusion.keepUncoloured;
+
+        j["multiCamera"]["cameras"] = multiCamera.cameras;
+        j["multiCamera"]["groundZ"] = multiCamera.groundZ;
+        j["multiCamera"]["maxRange"] = multiCamera.maxRange;
+        j["multiCamera"]["mergeDistance"] = multiCamera.mergeDistance;
+
+        j["acceleration"]["backend"] = acceleration.backend;
+
+        j["hotReload"]["watchConfig"] = hotReload.watchConfig;
+        j["hotReload"]["pollIntervalMs"] = hotReload.pollIntervalMs;
+
+        j["replay"]["frameEncoding"] = replay.frameEncoding;
+        j["replay"]["segmentLength"] = replay.segmentLength;
+        j["replay"]["threads"] = replay.threads;
+        j["replay"]["coneTolerance"] = replay.coneTolerance;
+        j["replay"]["poseTolerance"] = replay.poseTolerance;
+
+        return j;
+    }
+
+    // Save to JSON file
+    void saveToFile(const std::string &filepath) const
+    {
+        json j = toJson();
 
         std::ofstream file(filepath);
         file << j.dump(4); // Pretty print with 4 spaces
@@ -0,0 +1,46 @@
+#ifndef PARAMS_WATCHER_HPP
+#define PARAMS_WATCHER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Watches a config file's modification time and calls reloadPipelineParams
+// when it changes, so the new snapshot (colour table, LIDAR detector, car
+// masks) is built here and never on a frame's thread. A file that fails to
+// parse (e.g. caught halfway through a save) keeps the current parameters;
+// finishing the write changes the time again.
+class ParamsWatcher
+{
+public:
+    // pollIntervalMs > 0 polls on a background thread; 0 leaves it to poll()
+    ParamsWatcher(const std::string &configPath, int pollIntervalMs);
+    ~ParamsWatcher();
+
+    ParamsWatcher(const ParamsWatcher &) = delete;
+    ParamsWatcher &operator=(const ParamsWatcher &) = delete;
+
+    // Reloads if the file changed since the last look; true if new parameters
+    // were published. Only for watchers without a thread
+    bool poll();
+
+    int reloads() const { return reloadCount.load(); }
+
+private:
+    void worker();
+
+    std::string configPath;
+    int pollIntervalMs;
+    std::filesystem::file_time_type lastSeen;
+    std::atomic<int> reloadCount{0};
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread thread;
+};
+
+#endif // PARAMS_WATCHER_HPP
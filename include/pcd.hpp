@@ -0,0 +1,117 @@
+#ifndef PCD_HPP
+#define PCD_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// One entry of the FIELDS/SIZE/TYPE/COUNT header lines
+struct PcdField
+{
+    std::string name;
+    int size = 0;    // Bytes per element
+    char type = 'F'; // F(loat), U(nsigned), I(nt)
+    int count = 1;
+    size_t offset = 0; // Byte offset inside a point record
+};
+
+struct PcdHeader
+{
+    std::string version;
+    std::vector<PcdField> fields;
+    size_t width = 0;
+    size_t height = 0;
+    size_t points = 0;
+    size_t pointStep = 0;  // Bytes per point record
+    size_t dataOffset = 0; // First byte after the DATA line
+    std::string data;      // "binary" is the only layout read in place
+
+    // Index into `fields`, -1 if missing
+    int fieldIndex(const std::string &name) const;
+};
+
+// Column of one field over the interleaved point records, read in place.
+// Binary PCD records aren't aligned (18 bytes for our x/y/z/intensity/tag/line
+// scans), so elements are memcpy'd out instead of dereferenced.
+template <typename T>
+struct PcdFieldView
+{
+    const uint8_t *base = nullptr;
+    size_t stride = 0;
+
+    bool valid() const { return base != nullptr; }
+
+    T operator[](size_t i) const
+    {
+        T value;
+        std::memcpy(&value, base + i * stride, sizeof(T));
+        return value;
+    }
+};
+
+// Structure-of-arrays view over a mapped cloud, one column per field; columns
+// missing from the file (or with another type) are left invalid
+struct PointCloudView
+{
+    size_t size = 0;
+    PcdFieldView<float> x, y, z, intensity;
+    PcdFieldView<uint8_t> tag, line;
+
+    // Validates the header against `size` bytes; x/y/z are required
+    bool attach(const PcdHeader &header, const void *buffer, size_t bufferSize);
+};
+
+// Parses the ASCII header at the start of `buffer`
+bool parsePcdHeader(const void *buffer, size_t size, PcdHeader &header);
+
+// Read-only memory mapping of a binary PCD file; no copy of the points is made
+class MappedPcdFile
+{
+public:
+    MappedPcdFile() = default;
+    ~MappedPcdFile();
+
+    MappedPcdFile(const MappedPcdFile &) = delete;
+    MappedPcdFile &operator=(const MappedPcdFile &) = delete;
+
+    bool open(const std::string &filepath);
+    void close();
+    bool isOpen() const { return data != nullptr; }
+
+    const PcdHeader &header() const { return pcdHeader; }
+    const PointCloudView &view() const { return cloudView; }
+
+    // The whole mapped file, header included
+    const void *bytes() const { return data; }
+    size_t byteSize() const { return size; }
+
+private:
+    void *data = nullptr;
+    size_t size = 0;
+    PcdHeader pcdHeader;
+    PointCloudView cloudView;
+};
+
+// Sorted .pcd files of a directory (or a single file), mapped one at a time
+class PcdSource
+{
+public:
+    bool open(const std::string &source);
+    bool isOpened() const { return !files.empty(); }
+
+    // Maps the next readable scan into `cloud`, replacing the previous one
+    bool read(MappedPcdFile &cloud);
+
+    int scanIndex() const { return index; }
+    const std::string &currentPath() const { return current; }
+
+private:
+    std::vector<std::string> files;
+    size_t nextFile = 0;
+    int index = -1;
+    std::string current;
+};
+
+#endif // PCD_HPP
@@ -2,47 +2,180 @@
 #define PIPELINE_HPP
 
 #include <opencv2/opencv.hpp>
+#include <memory>
 #include <string>
 #include "detection.hpp"
+#include "track.hpp"
+#include "centerline.hpp"
+#include "odometry.hpp"
+#include "cone_io.hpp"
+#include "pcd.hpp"
+#include "lidar_odometry.hpp"
+#include "cone_tracker.hpp"
+#include "classifier.hpp"
+#include "utils.hpp"
+#include "workspace.hpp"
+#include "device.hpp"
 
-// Structure to hold intermediate cone detection results
-struct ConeDetectionResult
-{
-    std::vector<Cone> orangeCones;
-    std::vector<Cone> blueCones;
-    std::vector<Cone> yellowCones;
-};
+class ColourCalibrator;
+class Trajectory;
 
 // Step 1: Detect cones from an image and save results to JSON
 // Returns: ConeDetectionResult containing all detected cones
-// Saves: JSON file with cone positions and types
+// Saves: JSON file with cone positions and types, plus the binary format if a path is given
 ConeDetectionResult detectConesFromImage(
     const std::string &imagePath,
-    const std::string &outputJsonPath);
+    const std::string &outputJsonPath,
+    const std::string &outputBinaryPath = "");
 
-// Step 2: Draw track lines using pre-detected cones from JSON
-// Reads: JSON file with cone positions
+// Step 2: Draw track lines using pre-detected cones
+// Reads: binary (.bin) or JSON file with cone positions
 // Returns: Output image with track lines drawn
 // Saves: Output image file
 cv::Mat drawTrackLinesFromCones(
     const std::string &imagePath,
-    const std::string &inputJsonPath,
+    const std::string &inputConesPath,
     const std::string &outputImagePath);
 
 // Step 3: Calculate odometry between two frames
 // Returns: Image with feature matches visualized
-// Saves: Output image file and prints R and t matrices
+// Saves: Output image file and prints R and t matrices (also returned through `result`)
 cv::Mat calculateOdometry(
     const std::string &image1Path,
     const std::string &image2Path,
-    const std::string &outputImagePath);
+    const std::string &outputImagePath,
+    OdometryResult *result = nullptr);
+
+// In-memory variants of the three steps, used by the streaming mode so each
+// frame is decoded once and shared by all stages; `previousCones` feeds the
+// "cones" ROI mode. `deviceImg` is the frame's uploadFrame() copy for the
+// OpenCL backend, uploaded by the step itself when the backend is on and
+// none is given; ignored on the CPU backend
+ConeDetectionResult detectConesFromImage(const cv::Mat &img, const ConeDetectionResult *previousCones = nullptr, const cv::UMat &deviceImg = cv::UMat());
+cv::Mat drawTrackLinesFromCones(const cv::Mat &img, const ConeDetectionResult &cones);
+
+// Step 1 with the parameters, colour table, car masks (for this frame size)
+// and buffers passed in instead of the global ones; concurrent calls are fine
+// as long as each has its own workspace (e.g. one per camera)
+ConeDetectionResult detectConesFromImage(const cv::Mat &img, const PipelineParams &params, const HsvLut &lut, const CarMasks &carMasks,
+                                         DetectionWorkspace &workspace, const ConeDetectionResult *previousCones = nullptr,
+                                         const cv::UMat &deviceImg = cv::UMat());
+
+// Step 1 inside `windows` only (local re-detection around tracked cones)
+ConeDetectionResult detectConesInWindows(const cv::Mat &img, const std::vector<cv::Rect> &windows, const cv::UMat &deviceImg = cv::UMat());
+
+// Tracked step 1 for sequences: full-frame detection every
+// tracker.fullDetectionInterval frames (ROI seeded by the predicted cones),
+// windows around the predictions in between; cones come back with ids
+ConeDetectionResult detectConesTracked(ConeTracker &tracker, const cv::Mat &img, const cv::UMat &deviceImg = cv::UMat());
+
+// Feeds tracked cones to the colour calibrator (calibration.enabled); later
+// frames pick up the refitted colour table once it has been rebuilt
+void calibrateColours(const cv::Mat &img, const ConeDetectionResult &cones);
+cv::Mat calculateOdometry(const cv::Mat &img1, const cv::Mat &img2, OdometryResult *result = nullptr);
+
+// Step 2 split in two: the geometry (indices into the blue/yellow cones, no
+// image needed) and the drawing of those edges (plus the centerline if
+// given), empty without debug rendering
+TrackEdges buildTrackEdges(const ConeDetectionResult &cones, int imageWidth);
+cv::Mat drawTrackLines(const cv::Mat &img, const ConeDetectionResult &cones, const TrackEdges &edges, const Centerline *centerline = nullptr);
+
+// Sequence variant: describes only the new frame and matches it against the
+// previous one kept in `odometry` (invalid result for the first frame);
+// the visualization is available from odometry.drawLastMatches()
+OdometryResult calculateOdometry(VisualOdometry &odometry, const cv::Mat &frame, const cv::UMat &deviceFrame = cv::UMat());
+
+// LIDAR variant of step 1: cones from one PCD scan, same result type as the
+// camera path (see LidarConeDetector for what center/bbox mean here)
+// Saves: JSON/binary cones and a bird's-eye image of the scan if paths are given
+ConeDetectionResult detectConesFromPointCloud(
+    const std::string &pcdPath,
+    const std::string &outputJsonPath,
+    const std::string &outputBinaryPath = "",
+    const std::string &outputImagePath = "");
+
+// In-memory LIDAR variant; each thread reuses its own detector
+ConeDetectionResult detectConesFromPointCloud(const PointCloudView &cloud);
+
+// LIDAR variant of step 3: metric motion from the previous scan kept in
+// `odometry` to `cloud`, same conventions as the camera sequence variant
+OdometryResult calculateOdometry(LidarOdometry &odometry, const PointCloudView &cloud);
+
+// LIDAR step 3 between two PCD files; prints R, t and the ICP iterations
+OdometryResult calculateLidarOdometry(const std::string &scan1Path, const std::string &scan2Path);
 
-// Utility functions for JSON serialization
-void saveConeDetectionToJson(const ConeDetectionResult &result, const std::string &filepath);
-ConeDetectionResult loadConeDetectionFromJson(const std::string &filepath);
+// Camera-LIDAR fusion: cones from the scan, coloured by classifying only
+// small image patches around their projections (odometry.cameraIntrinsics
+// plus the fusion extrinsic). Cones keep the metric LIDAR position and get
+// their image box; uses the thread's LIDAR detector like the variant above
+ConeDetectionResult fuseConesFromImageAndPointCloud(const cv::Mat &img, const PointCloudView &cloud);
+
+// Fusion from files; saves JSON cones and the cones drawn on the image if paths are given
+ConeDetectionResult fuseConesFromImageAndPointCloud(
+    const std::string &imagePath,
+    const std::string &pcdPath,
+    const std::string &outputJsonPath,
+    const std::string &outputImagePath = "");
+
+// Multi-camera step 1 on one image per camera taken at the same time, camera
+// configs from multiCamera.cameras (the current parameters for every image if
+// empty); see MultiCameraPipeline. Saves the merged cones as JSON and drawn
+// on the bird's-eye canvas if paths are given. Empty if an image or a camera
+// config can't be loaded
+ConeDetectionResult detectConesFromCameras(
+    const std::vector<std::string> &imagePaths,
+    const std::string &outputJsonPath,
+    const std::string &outputImagePath = "");
+
+// Immutable parameters plus the things built from them, so changing
+// parameters never rebuilds anything on the hot path. A frame takes the
+// latest snapshot when it starts and keeps it (SnapshotScope), so in-flight
+// frames finish with the parameters they started with
+struct PipelineSnapshot
+{
+    PipelineParams params;
+    uint64_t version = 0; // Increases with every parameter change; calibrated tables keep it
+    std::shared_ptr<const HsvLut> lut; // Replaced by the calibrator while it runs
+    std::shared_ptr<ColourCalibrator> calibrator; // Only with calibration.enabled
+};
 
 // Parameter management functions
 void initializePipelineParams(const std::string &configPath);
-const struct PipelineParams &getPipelineParams();
+// Builds the snapshot for `params` on the calling thread and swaps it in;
+// safe while frames are running, later frames pick it up
+void setPipelineParams(const struct PipelineParams &params);
+// Same from a config file; keeps the current parameters (and returns false)
+// if the file can't be read or parsed, e.g. while an editor is writing it
+bool reloadPipelineParams(const std::string &configPath);
+
+// The snapshot pinned on this thread, else the latest one. Lock-free except
+// for the first call on a thread after parameters change, which loads the
+// new snapshot under the standard library's shared_ptr lock
+std::shared_ptr<const PipelineSnapshot> getPipelineSnapshot();
+// Copy of the parameters of getPipelineSnapshot()
+PipelineParams getPipelineParams();
+
+// Pins `snapshot` for all pipeline steps called on this thread while the
+// scope lives, so every step of a frame sees the same parameters
+class SnapshotScope
+{
+public:
+    explicit SnapshotScope(std::shared_ptr<const PipelineSnapshot> snapshot);
+    ~SnapshotScope();
+
+    SnapshotScope(const SnapshotScope &) = delete;
+    SnapshotScope &operator=(const SnapshotScope &) = delete;
+
+private:
+    std::shared_ptr<const PipelineSnapshot> previous;
+};
+
+// Between two frames of a sequence whose snapshots differ: the stage objects
+// whose section changed start over with the new values, the others keep their
+// state (tracks, the previous frame's features); null ones are skipped.
+// (the trajectory also on new camera intrinsics). Executor settings only
+// apply to the next run
+void refreshStages(const PipelineParams &previous, const PipelineParams &params,
+                   ConeTracker *tracker, CenterlineBuilder *centerline, VisualOdometry *odometry, Trajectory *trajectory);
 
 #endif // PIPELINE_HPP
@@ -0,0 +1,132 @@
+#ifndef PROFILING_HPP
+#define PROFILING_HPP
+
+#include <array>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "json.hpp"
+
+using json = nlohmann::json;
+
+// Fixed-size latency histogram with log-spaced buckets (8 per octave, ~9%
+// resolution) from 1us to ~2 minutes; percentiles without keeping samples
+class LatencyHistogram
+{
+public:
+    void add(double microseconds);
+    void merge(const LatencyHistogram &other);
+    double percentile(double p) const; // p in [0, 1], microseconds
+    size_t count() const { return samples; }
+    double mean() const { return samples ? sum / samples : 0.0; }
+    double max() const { return maxValue; }
+    json toJson() const;
+
+private:
+    static const int bucketsPerOctave = 8;
+    static const int bucketCount = 27 * bucketsPerOctave + 1;
+
+    std::array<size_t, bucketCount> buckets = {};
+    size_t samples = 0;
+    double sum = 0.0;
+    double minValue = 0.0;
+    double maxValue = 0.0;
+};
+
+// Process-wide registry of named timings. Timers recorded while a frame scope
+// is active on the same thread are also attributed to that frame, so stages
+// running on different threads still end up in one per-frame report.
+// Each thread records into its own buffer, keyed by the name literal, so
+// concurrent timers never wait on each other; the reports merge the buffers
+class Profiler
+{
+public:
+    static Profiler &instance();
+
+    // `name` must outlive the profiler (PROFILE_SCOPE passes string literals)
+    void record(const char *name, double microseconds);
+
+    // Timings of one frame, removed from the registry: {"frame": N, "<name>": us, ...}
+    json takeFrameReport(int frameIndex);
+
+    // Aggregate count/mean/p50/p95/p99/max per timer, in microseconds
+    json report() const;
+    bool saveReport(const std::string &filepath) const;
+
+    void reset();
+
+    static int &currentFrame();
+
+private:
+    struct FrameTiming
+    {
+        int frame;
+        const char *name;
+        double microseconds;
+    };
+
+    // One per recording thread. Its mutex is only contended while a report
+    // is merging it
+    struct ThreadTimings
+    {
+        std::mutex mutex;
+        std::unordered_map<const char *, LatencyHistogram> histograms;
+        std::vector<FrameTiming> frames;
+    };
+
+    ThreadTimings &threadTimings();
+
+    mutable std::mutex mutex; // Guards the list of buffers, not their contents
+    std::vector<std::shared_ptr<ThreadTimings>> threads;
+};
+
+// Records the time until the end of the enclosing scope
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(const char *name) : name(name), start(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer()
+    {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        Profiler::instance().record(name, std::chrono::duration<double, std::micro>(elapsed).count());
+    }
+
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+private:
+    const char *name;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Attributes timers on this thread to `frameIndex` until the end of the scope
+class ProfileFrameScope
+{
+public:
+    explicit ProfileFrameScope(int frameIndex) : previous(Profiler::currentFrame())
+    {
+        Profiler::currentFrame() = frameIndex;
+    }
+    ~ProfileFrameScope() { Profiler::currentFrame() = previous; }
+
+private:
+    int previous;
+};
+
+// Timers compile to nothing unless DRIVERLESS_PROFILING is defined (CMake option, on by default)
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef DRIVERLESS_PROFILING
+#define PROFILE_SCOPE(name) ScopedTimer PROFILE_CONCAT(profileTimer_, __LINE__)(name)
+#define PROFILE_FRAME(index) ProfileFrameScope PROFILE_CONCAT(profileFrame_, __LINE__)(index)
+#else
+#define PROFILE_SCOPE(name) ((void)(name))
+#define PROFILE_FRAME(index) ((void)(index))
+#endif
+
+#endif // PROFILING_HPP
@@ -0,0 +1,194 @@
+#ifndef RECORDING_HPP
+#define RECORDING_HPP
+
+#include <opencv2/opencv.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "detection.hpp"
+#include "pcd.hpp"
+#include "trajectory.hpp"
+
+// Recorded log: timestamped camera frames, LIDAR scans and pipeline outputs
+// in one file, meant to be mapped and replayed. Little-endian, laid out as
+//   LogFileHeader
+//   records: LogRecordHeader + payload, padded to 8 bytes
+//   index: one LogIndexEntry per record
+//   LogFileFooter
+// Records are tagged with a frame number; everything with the same number
+// belongs to one moment. Payloads are read in place where the data allows:
+//   LOG_FRAME:       LogImageHeader + raw pixels (a view into the mapping) or a PNG/JPEG
+//   LOG_SCAN:        a complete binary PCD file, read with PointCloudView
+//   LOG_CONES,
+//   LOG_LIDAR_CONES: the packed cone format of cone_io.hpp
+//   LOG_POSE:        PackedPose
+// A log cut short before its index is written (e.g. the recorder was
+// killed) is still read by walking the record headers.
+struct LogFileHeader
+{
+    char magic[4];    // "DLOG"
+    uint32_t version; // logFormatVersion
+};
+
+struct LogRecordHeader
+{
+    uint32_t type; // LogRecordType
+    int32_t frame;
+    int64_t timestampNs; // Since the start of the recording
+    uint64_t size;       // Payload bytes, without the padding
+};
+
+struct LogIndexEntry
+{
+    uint32_t type;
+    int32_t frame;
+    int64_t timestampNs;
+    uint64_t offset; // Of the payload, from the start of the file
+    uint64_t size;
+};
+
+struct LogFileFooter
+{
+    char magic[4]; // "DIDX"
+    uint32_t entries;
+    uint64_t indexOffset;
+};
+
+struct LogImageHeader
+{
+    int32_t rows;
+    int32_t cols;
+    int32_t type;     // cv::Mat type of the raw pixels / decoded image
+    int32_t encoding; // LogImageEncoding
+};
+
+struct PackedPose
+{
+    int32_t valid;
+    int32_t reserved;
+    double timestamp; // TrajectoryPoint::timestamp
+    double scale;
+    double R[9]; // Row-major
+    double t[3];
+};
+
+static_assert(sizeof(LogFileHeader) == 8, "LogFileHeader must stay 8 bytes");
+static_assert(sizeof(LogRecordHeader) == 24, "LogRecordHeader must stay 24 bytes");
+static_assert(sizeof(LogIndexEntry) == 32, "LogIndexEntry must stay 32 bytes");
+static_assert(sizeof(LogFileFooter) == 16, "LogFileFooter must stay 16 bytes");
+static_assert(sizeof(LogImageHeader) == 16, "LogImageHeader must stay 16 bytes");
+static_assert(sizeof(PackedPose) == 120, "PackedPose must stay 120 bytes");
+
+const uint32_t logFormatVersion = 1;
+
+enum LogRecordType
+{
+    LOG_FRAME = 1,
+    LOG_SCAN = 2,
+    LOG_CONES = 3,
+    LOG_LIDAR_CONES = 4,
+    LOG_POSE = 5
+};
+
+enum LogImageEncoding
+{
+    LOG_IMAGE_RAW = 0, // Largest, but replayed without decoding
+    LOG_IMAGE_PNG = 1,
+    LOG_IMAGE_JPEG = 2 // Lossy, detections differ slightly from the source frames
+};
+
+// "raw", "png" or "jpg"; unknown names fall back to png with a warning
+LogImageEncoding parseLogImageEncoding(const std::string &name);
+
+// Appends records to a new log; close() (or the destructor) writes the index.
+// Not thread-safe
+class LogWriter
+{
+public:
+    LogWriter() = default;
+    ~LogWriter();
+
+    LogWriter(const LogWriter &) = delete;
+    LogWriter &operator=(const LogWriter &) = delete;
+
+    bool open(const std::string &filepath);
+    bool isOpen() const { return file.is_open(); }
+
+    bool writeFrame(int frame, int64_t timestampNs, const cv::Mat &image, LogImageEncoding encoding);
+    // `pcd` is a whole binary PCD file, e.g. the bytes of a MappedPcdFile
+    bool writeScan(int frame, int64_t timestampNs, const void *pcd, size_t size);
+    bool writeCones(int frame, int64_t timestampNs, const ConeDetectionResult &cones, LogRecordType type = LOG_CONES);
+    bool writePose(int frame, int64_t timestampNs, const TrajectoryPoint &pose);
+
+    // Writes the index and footer; false if any write failed
+    bool close();
+
+    size_t recordCount() const { return index.size(); }
+
+private:
+    bool writeRecord(LogRecordType type, int frame, int64_t timestampNs, const void *prefix, size_t prefixSize, const void *payload, size_t size);
+
+    std::ofstream file;
+    std::string path;
+    uint64_t offset = 0;
+    bool failed = false;
+    std::vector<LogIndexEntry> index;
+    std::vector<uint8_t> scratch; // Encoded images and packed cones
+};
+
+// The records of one frame number; null where the log has none
+struct LogFrame
+{
+    int frame = -1;
+    int64_t timestampNs = 0; // Of the first record with this number
+    const LogIndexEntry *image = nullptr;
+    const LogIndexEntry *scan = nullptr;
+    const LogIndexEntry *cones = nullptr;
+    const LogIndexEntry *lidarCones = nullptr;
+    const LogIndexEntry *pose = nullptr;
+};
+
+// Read-only memory mapping of a log. The read functions only look at the
+// mapping, so they can be called from several threads at once; views they
+// return (raw frames, scans) are valid while the log stays open
+class MappedLog
+{
+public:
+    MappedLog() = default;
+    ~MappedLog();
+
+    MappedLog(const MappedLog &) = delete;
+    MappedLog &operator=(const MappedLog &) = delete;
+
+    bool open(const std::string &filepath);
+    void close();
+    bool isOpen() const { return data != nullptr; }
+
+    const std::vector<LogIndexEntry> &entries() const { return index; }
+    // In frame number order
+    const std::vector<LogFrame> &frames() const { return frameTable; }
+    // Null if no record has this frame number
+    const LogFrame *findFrame(int frame) const;
+
+    // Raw frames come back as a read-only view of the mapping (clone before
+    // writing into them), encoded ones are decoded
+    bool readImage(const LogIndexEntry &entry, cv::Mat &image) const;
+    bool readScan(const LogIndexEntry &entry, PointCloudView &cloud) const;
+    bool readCones(const LogIndexEntry &entry, ConeDetectionResult &cones) const;
+    bool readPose(const LogIndexEntry &entry, TrajectoryPoint &pose) const;
+
+private:
+    bool readIndex();
+    void walkRecords();
+    void buildFrameTable();
+    const uint8_t *payload(const LogIndexEntry &entry) const;
+
+    void *data = nullptr;
+    size_t size = 0;
+    std::vector<LogIndexEntry> index;
+    std::vector<LogFrame> frameTable;
+};
+
+#endif // RECORDING_HPP
@@ -0,0 +1,48 @@
+#ifndef REPLAY_HPP
+#define REPLAY_HPP
+
+#include <string>
+#include "recording.hpp"
+#include "stream.hpp"
+
+struct RecordOptions
+{
+    std::string scanSource; // PCD file or directory, scan N is stored with frame N; empty for frames only
+    int maxFrames = -1;     // -1 means until both sources run out
+};
+
+// Writes every frame of `source` (and scan of `scanSource`) to a new log,
+// encoded as replay.frameEncoding and stamped with the time it was read
+// Returns: number of recorded frame numbers, -1 if the log couldn't be written
+int recordLog(FrameSource &source, const std::string &logPath, const RecordOptions &options = RecordOptions());
+
+struct ReplayOptions
+{
+    std::string outputDir = "output/replay"; // replay_report.json (and diff.json with a baseline)
+    std::string outputLog;                   // Cones, LIDAR cones and poses of every frame, usable as a baseline later
+    std::string baselineLog;                 // Log with the outputs to compare against
+    int maxFrames = -1;
+};
+
+struct ReplayReport
+{
+    int frames = 0;
+    int segments = 0;
+    double seconds = 0.0; // Wall time of the processing, writing excluded
+    double framesPerSecond = 0.0;
+    int comparedFrames = 0;  // Frames the baseline has outputs for
+    int differingFrames = 0; // Of those, outside replay.coneTolerance / poseTolerance
+};
+
+// Runs detection, track edges, centerline, odometry and the trajectory on
+// every frame of the log, plus the LIDAR detector on every scan, as fast as
+// the cores allow: segments of replay.segmentLength frames run as parallel
+// tasks, each with its own tracker, odometry and trajectory, and the
+// segment trajectories are chained afterwards. Each segment also runs the
+// frame before its first one, so odometry across the cut isn't lost.
+// The outputs only depend on the log and the parameters: no debug drawing
+// and no online colour calibration. Prints frames/sec and per-stage
+// latencies; with a baseline, counts the frames whose outputs differ
+ReplayReport replayLog(const MappedLog &log, const ReplayOptions &options = ReplayOptions());
+
+#endif // REPLAY_HPP
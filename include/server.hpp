@@ -0,0 +1,23 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <iostream>
+#include <string>
+
+// Long-lived pipeline server for the Gradio frontend: reads one JSON request
+// per line from `in` and answers with one JSON line on `out`. Decoded images,
+// masks, lookup tables and the last detected cones stay resident between
+// requests, and parameters are updated in place instead of restarting.
+//
+// Requests:
+//   {"cmd": "run", "step": "all|detect|track|odometry", "params": {...}}  params optional
+//   {"cmd": "set_params", "params": {...}}
+//   {"cmd": "reload"}  re-reads the config file (also done on changes with hotReload.watchConfig)
+//   {"cmd": "ping"}
+//   {"cmd": "quit"}
+// Responses carry "ok", the captured console output as "log", and "error" on failure.
+// Parameters start out from `configPath`
+// Returns: process exit code
+int runPipelineServer(const std::string &configPath, std::istream &in, std::ostream &out);
+
+#endif // SERVER_HPP
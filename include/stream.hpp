@@ -0,0 +1,43 @@
+#ifndef STREAM_HPP
+#define STREAM_HPP
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+// Sequential source of frames: a camera device index ("0"), a video file or a
+// directory of images (read in filename order)
+class FrameSource
+{
+public:
+    bool open(const std::string &source);
+    bool isOpened() const;
+
+    // Decodes the next frame into `frame`; returns false at the end of the stream
+    bool read(cv::Mat &frame);
+
+    // Index of the last frame returned by read(), -1 before the first one
+    int frameIndex() const { return index; }
+
+private:
+    cv::VideoCapture capture;
+    std::vector<std::string> files;
+    size_t nextFile = 0;
+    bool fromFiles = false;
+    int index = -1;
+};
+
+struct StreamOptions
+{
+    std::string outputDir = "output/stream";
+    bool saveOutputs = false; // Write track/odometry images for every frame
+    int maxFrames = -1;       // -1 means until the source runs out
+    bool pipelined = false;   // Run the stages concurrently on the PipelinedExecutor
+    bool headless = false;    // No debug drawing or per-item logging, only the numbers
+};
+
+// Runs detection -> track lines -> odometry on every frame of the source
+// Returns: number of processed frames
+int runStreamingPipeline(FrameSource &source, const StreamOptions &options = StreamOptions());
+
+#endif // STREAM_HPP
@@ -4,6 +4,24 @@
 #ifndef TRACK_HPP
 #define TRACK_HPP
 
-cv::Mat connectCones(const cv::Mat &image, std::vector<Cone> &cones, cv::Scalar lineColor, int maxDistance = 50, float verticalPenaltyFactor = 3.5f);
+class FrameWorkspace;
+
+// Ordered track edges as indices into the blue/yellow cones of a detection
+struct TrackEdges
+{
+    std::vector<int> blue;
+    std::vector<int> yellow;
+};
+
+// Chains cones into a track edge, geometry only: starts from the bottom cone
+// closest to the middle of the image and greedily adds the nearest cone, with
+// vertical steps penalised, until the next one is further than maxDistance.
+// Returns indices into `cones` in chain order; cones off the chain are left out.
+std::vector<int> connectCones(const std::vector<Cone> &cones, int imageWidth, int maxDistance = 50, float verticalPenaltyFactor = 3.5f);
+// Same into `edge` (cleared first), with the sort and grid buffers from `workspace`
+void connectCones(const std::vector<Cone> &cones, int imageWidth, int maxDistance, float verticalPenaltyFactor, FrameWorkspace &workspace, std::vector<int> &edge);
+
+// Draws an edge returned by connectCones into `image`
+void drawTrackEdge(cv::Mat &image, const std::vector<Cone> &cones, const std::vector<int> &edge, cv::Scalar lineColor);
 
 #endif // TRACK_HPP
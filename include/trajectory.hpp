@@ -0,0 +1,62 @@
+#ifndef TRAJECTORY_HPP
+#define TRAJECTORY_HPP
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include "detection.hpp"
+#include "odometry.hpp"
+#include "params.hpp"
+
+// Camera pose in the world frame, which is the camera frame of the first image
+struct Pose
+{
+    cv::Matx33d R = cv::Matx33d::eye();
+    cv::Vec3d t = cv::Vec3d(0, 0, 0);
+};
+
+struct TrajectoryPoint
+{
+    int frameIndex = -1;
+    double timestamp = 0.0; // Seconds since the first frame
+    Pose pose;
+    double scale = 0.0; // Length of the applied translation
+    bool valid = false; // False when the pose was held because odometry failed
+};
+
+// Chains the relative motions from VisualOdometry into a global pose; the
+// translation scale comes from TrajectoryParams::scaleSource
+class Trajectory
+{
+public:
+    Trajectory(const TrajectoryParams &params = TrajectoryParams(), const CameraIntrinsics &intrinsics = CameraIntrinsics());
+
+    // Applies the motion from the previous frame to `frameIndex`; cones are only
+    // needed for the "cones" scale source. `timestamp` is the capture time in
+    // seconds since the first frame (recorded logs have it); negative means
+    // frameIndex * frameInterval
+    const TrajectoryPoint &update(int frameIndex, const OdometryResult &odometry, const ConeDetectionResult &cones = ConeDetectionResult(),
+                                  double timestamp = -1.0);
+
+    const TrajectoryPoint &current() const { return last; }
+
+    void reset();
+
+private:
+    double estimateScale(int frameIndex, double timestamp, const ConeDetectionResult &cones);
+
+    TrajectoryParams params;
+    CameraIntrinsics intrinsics;
+
+    TrajectoryPoint last;
+    ConeDetectionResult prevCones;
+    double prevScale = 1.0;
+};
+
+// Distance travelled between two frames, from the change in depth of cones seen in both;
+// depth comes from the bounding box height of a cone of known height. Returns 0 if no cone pairs up
+double estimateScaleFromCones(const ConeDetectionResult &prev, const ConeDetectionResult &curr, const CameraIntrinsics &intrinsics, double coneHeight);
+
+void saveTrajectoryToJson(const std::vector<TrajectoryPoint> &points, const std::string &filepath);
+
+#endif // TRAJECTORY_HPP
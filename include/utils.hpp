@@ -2,6 +2,7 @@
 #define UTILS_HPP
 
 #include <opencv2/opencv.hpp>
+#include "params.hpp"
 
 struct ColourRange
 {
@@ -28,7 +29,21 @@ enum Colours
     YELLOW
 };
 
+// Masks derived from the car polygon; fixed for a given resolution and mount
+struct CarMasks
+{
+    cv::Mat car;   // 255 on the car, used as the negative mask for colour detection
+    cv::Mat valid; // Inverse of car, where features may be detected
+};
+
 cv::Mat createCarMask(const cv::Mat &image);
+cv::Mat createCarMask(const cv::Size &size, const CarMaskParams &params);
+
+// Cached per image size and polygon, so the polygon is only rasterized once; thread-safe
+CarMasks getCarMasks(const cv::Size &size, const CarMaskParams &params);
+// Builds the masks of a new polygon for every size already cached, so the
+// first frame after a parameter change doesn't rasterize it
+void prewarmCarMasks(const CarMaskParams &params);
 ColourMaskConfig getColourMask(Colours colour);
 
 #endif // UTILS_HPP
@@ -0,0 +1,111 @@
+#ifndef WORKSPACE_HPP
+#define WORKSPACE_HPP
+
+#include <opencv2/opencv.hpp>
+#include <array>
+#include <map>
+#include <vector>
+#include "detection.hpp"
+#include "cone_grid.hpp"
+#include "device.hpp"
+
+// Border for the filters run in place on workspace buffers. They are views
+// into larger storage, and without BORDER_ISOLATED OpenCV reads whatever
+// earlier, larger frames left past their right and bottom edges; with
+// morphologyDefaultBorderValue() the border never wins an erode or dilate
+const int workspaceBorder = cv::BORDER_CONSTANT | cv::BORDER_ISOLATED;
+
+// Buffers reused from frame to frame by colour detection, cone extraction and
+// track building. Images grow to the largest size asked for and are handed
+// out as views of the requested size, so the tracker's changing search
+// windows don't reallocate either; vectors keep their capacity. Once it has
+// seen a frame, a workspace makes no further allocations of its own (OpenCV
+// still allocates inside findContours and the morphology filters).
+// Not thread-safe: one workspace per thread running the detection stages.
+class FrameWorkspace
+{
+public:
+    enum Buffer
+    {
+        BUFFER_HSV,
+        BUFFER_LABELS,
+        BUFFER_RANGE, // inRange output in detectColour
+        BUFFER_ROAD,
+        BUFFER_ORANGE,
+        BUFFER_BLUE,
+        BUFFER_YELLOW,
+        BUFFER_CLEANUP_0, // Untouched copies of the masks a tiled cleanup reads from
+        BUFFER_CLEANUP_1,
+        BUFFER_CLEANUP_2,
+        BUFFER_COARSE,     // Subsampled ROI and car mask of coarse-to-fine detection
+        BUFFER_COARSE_CAR,
+        BUFFER_COUNT
+    };
+
+    // `size` view of buffer `which`; the contents are whatever was left there
+    // and stay valid until the buffer is asked for again
+    cv::Mat buffer(Buffer which, const cv::Size &size, int type);
+
+    // Same for the per-task band images of a tiled cleanup; reserveTiles()
+    // first, tile() may then be called from several threads for different indices
+    void reserveTiles(int count);
+    cv::Mat tile(int index, const cv::Size &size, int type);
+
+    // cv::MORPH_ELLIPSE kernel, built once per size
+    const cv::Mat &ellipseKernel(int size);
+
+    // identifyCones
+    std::vector<std::vector<cv::Point>> contours;
+    std::vector<Cone> parts;
+    std::vector<int> coneCells;
+    ConeGrid mergeGrid;
+    std::vector<Cone> cones; // Per-colour output in the pipeline, copied to the result
+
+    // connectCones
+    std::vector<int> order;
+    std::vector<int> rank;
+    std::vector<bool> used;
+    ConeGrid trackGrid;
+
+private:
+    std::array<cv::Mat, BUFFER_COUNT> storage;
+    std::vector<cv::Mat> tiles;
+    std::map<int, cv::Mat> kernels;
+};
+
+// Device images of the OpenCL backend, handed out as views of grow-only
+// storage like the FrameWorkspace ones. Not thread-safe either
+class DeviceWorkspace
+{
+public:
+    enum Buffer
+    {
+        BUFFER_FRAME, // Upload of the frame when the caller has no device copy
+        BUFFER_HSV,
+        BUFFER_H,
+        BUFFER_S,
+        BUFFER_V,
+        BUFFER_LABELS,
+        BUFFER_ROAD,
+        BUFFER_CONE, // One cone mask at a time, downloaded before the next
+        BUFFER_COUNT
+    };
+
+    cv::UMat buffer(Buffer which, const cv::Size &size, int type);
+
+    DeviceImageCache car; // CarMasks::car
+
+private:
+    std::array<cv::UMat, BUFFER_COUNT> storage;
+};
+
+// Buffers of one step 1 caller: the colour masks and track edges, plus one
+// cone extraction set per colour, as the colours may run as parallel tasks
+struct DetectionWorkspace
+{
+    FrameWorkspace frame;
+    std::array<FrameWorkspace, 3> colours;
+    DeviceWorkspace device; // Only used with acceleration.backend "opencl"
+};
+
+#endif // WORKSPACE_HPP
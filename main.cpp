@@ -1,6 +1,44 @@
 #include <opencv2/opencv.hpp>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
 #include <iostream>
 #include "include/pipeline.hpp"
+#include "include/stream.hpp"
+#include "include/server.hpp"
+#include "include/params.hpp"
+#include "include/profiling.hpp"
+#include "include/params_watcher.hpp"
+#include "include/replay.hpp"
+
+// Whichever cones file was written last: step 1 writes the JSON and then the
+// binary, but other tools only regenerate the JSON, and an older binary from
+// an earlier run must not win over it
+static std::string newestConesFile(const std::string &binaryPath, const std::string &jsonPath)
+{
+    std::error_code binaryError, jsonError;
+    auto binaryTime = std::filesystem::last_write_time(binaryPath, binaryError);
+    auto jsonTime = std::filesystem::last_write_time(jsonPath, jsonError);
+    if (binaryError)
+        return jsonPath;
+    if (jsonError)
+        return binaryPath;
+    return binaryTime >= jsonTime ? binaryPath : jsonPath;
+}
+
+// Arguments of the modes that take options, shared by their own usage line
+// and the general one
+static const char *streamArguments = "stream <camera index|video file|frame directory> [--save] [--max-frames N] [--pipelined] [--headless] [--watch-config]";
+static const char *recordArguments = "record <camera index|video file|frame directory> <log.drvlog> [--scans scan.pcd|directory] [--max-frames N]";
+static const char *replayArguments = "replay <log.drvlog> [--output outputs.drvlog] [--baseline outputs.drvlog] [--max-frames N] [--segment-length N] [--threads N]";
+
+// Whole argument as an int, false on anything else (e.g. "abc" or "12x")
+static bool parseInt(const char *text, int &value)
+{
+    const char *end = text + std::strlen(text);
+    auto [ptr, error] = std::from_chars(text, end, value);
+    return error == std::errc() && ptr == end && ptr != text;
+}
 
 int main(int argc, char *argv[])
 {
@@ -11,12 +49,217 @@ int main(int argc, char *argv[])
     {
         configPath = "config/default_params.json";
     }
+
+    // Server mode: stay resident and take requests on stdin (used by the Gradio frontend)
+    if (argc > 1 && std::string(argv[1]) == "serve")
+        return runPipelineServer(configPath, std::cin, std::cout);
+
     initializePipelineParams(configPath);
 
+    // Streaming mode: run all steps on every frame of a camera, video or directory
+    if (argc > 1 && std::string(argv[1]) == "stream")
+    {
+        const std::string usage = std::string("Usage: ") + argv[0] + " " + streamArguments;
+        if (argc < 3)
+        {
+            std::cout << usage << std::endl;
+            return 1;
+        }
+
+        StreamOptions options;
+        PipelineParams params = getPipelineParams();
+        options.pipelined = params.executor.enabled;
+        bool watchConfig = params.hotReload.watchConfig;
+        for (int i = 3; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            bool parsed = true;
+            if (arg == "--save")
+                options.saveOutputs = true;
+            else if (arg == "--max-frames" && i + 1 < argc)
+                parsed = parseInt(argv[++i], options.maxFrames);
+            else if (arg == "--pipelined")
+                options.pipelined = true;
+            else if (arg == "--headless")
+                options.headless = true;
+            else if (arg == "--watch-config")
+                watchConfig = true;
+            else
+                parsed = false;
+            if (!parsed)
+            {
+                std::cout << usage << std::endl;
+                return 1;
+            }
+        }
+
+        // Edits to the config file reach the next frames without a restart
+        std::unique_ptr<ParamsWatcher> watcher;
+        if (watchConfig)
+            watcher = std::make_unique<ParamsWatcher>(configPath, params.hotReload.pollIntervalMs);
+
+        FrameSource source;
+        if (!source.open(argv[2]))
+            return 1;
+
+        runStreamingPipeline(source, options);
+        return 0;
+    }
+
+    // Recording: frames (and LIDAR scans) into one log for offline replay
+    if (argc > 1 && std::string(argv[1]) == "record")
+    {
+        const std::string usage = std::string("Usage: ") + argv[0] + " " + recordArguments;
+        if (argc < 4)
+        {
+            std::cout << usage << std::endl;
+            return 1;
+        }
+
+        RecordOptions options;
+        for (int i = 4; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            bool parsed = true;
+            if (arg == "--scans" && i + 1 < argc)
+                options.scanSource = argv[++i];
+            else if (arg == "--max-frames" && i + 1 < argc)
+                parsed = parseInt(argv[++i], options.maxFrames);
+            else
+                parsed = false;
+            if (!parsed)
+            {
+                std::cout << usage << std::endl;
+                return 1;
+            }
+        }
+
+        FrameSource source;
+        if (!source.open(argv[2]))
+            return 1;
+        return recordLog(source, argv[3], options) > 0 ? 0 : 1;
+    }
+
+    // Replay: the whole pipeline over a recorded log, as fast as the cores allow
+    if (argc > 1 && std::string(argv[1]) == "replay")
+    {
+        const std::string usage = std::string("Usage: ") + argv[0] + " " + replayArguments;
+        if (argc < 3)
+        {
+            std::cout << usage << std::endl;
+            return 1;
+        }
+
+        ReplayOptions options;
+        PipelineParams params = getPipelineParams();
+        bool paramsChanged = false;
+        for (int i = 3; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            bool parsed = true;
+            if (arg == "--output" && i + 1 < argc)
+                options.outputLog = argv[++i];
+            else if (arg == "--baseline" && i + 1 < argc)
+                options.baselineLog = argv[++i];
+            else if (arg == "--max-frames" && i + 1 < argc)
+                parsed = parseInt(argv[++i], options.maxFrames);
+            else if (arg == "--segment-length" && i + 1 < argc)
+            {
+                parsed = parseInt(argv[++i], params.replay.segmentLength);
+                paramsChanged = true;
+            }
+            else if (arg == "--threads" && i + 1 < argc)
+            {
+                parsed = parseInt(argv[++i], params.replay.threads);
+                paramsChanged = true;
+            }
+            else
+                parsed = false;
+            if (!parsed)
+            {
+                std::cout << usage << std::endl;
+                return 1;
+            }
+        }
+        if (paramsChanged)
+            setPipelineParams(params);
+
+        MappedLog log;
+        if (!log.open(argv[2]))
+            return 1;
+
+        // Fails on differences, and on a baseline with nothing to compare
+        ReplayReport report = replayLog(log, options);
+        if (report.frames == 0)
+            return 1;
+        if (!options.baselineLog.empty() && (report.comparedFrames == 0 || report.differingFrames > 0))
+            return 1;
+        return 0;
+    }
+
+    // LIDAR mode: cone detection on one PCD scan, or on every scan of a directory
+    if (argc > 1 && std::string(argv[1]) == "lidar")
+    {
+        std::string path = argc > 2 ? argv[2] : "data/cones.pcd";
+        if (!std::filesystem::is_directory(path))
+        {
+            detectConesFromPointCloud(path, "output/lidar_cones.json", "output/lidar_cones.bin", "output/lidar_cones.png");
+            Profiler::instance().saveReport("output/timing_report.json");
+            return 0;
+        }
+
+        PcdSource source;
+        if (!source.open(path))
+            return 1;
+
+        MappedPcdFile cloud;
+        while (source.read(cloud))
+        {
+            ConeDetectionResult cones = detectConesFromPointCloud(cloud.view());
+            std::cout << "Scan " << source.scanIndex() << " (" << source.currentPath() << "): "
+                      << cones.orangeCones.size() << " orange, "
+                      << cones.blueCones.size() << " blue, "
+                      << cones.yellowCones.size() << " yellow cones" << std::endl;
+        }
+        Profiler::instance().saveReport("output/timing_report.json");
+        return 0;
+    }
+
+    // Synchronized frames of several cameras, one image per camera
+    if (argc > 1 && std::string(argv[1]) == "cameras")
+    {
+        std::vector<std::string> images(argv + 2, argv + argc);
+        if (images.empty())
+            images = {"data/frame_1.png", "data/frame_2.png"};
+        detectConesFromCameras(images, "output/multi_camera_cones.json", "output/multi_camera_cones.png");
+        Profiler::instance().saveReport("output/timing_report.json");
+        return 0;
+    }
+
+    // Camera-LIDAR fusion on one image and one scan
+    if (argc > 1 && std::string(argv[1]) == "fusion")
+    {
+        std::string image = argc > 2 ? argv[2] : "data/frame_1.png";
+        std::string scan = argc > 3 ? argv[3] : "data/cones.pcd";
+        fuseConesFromImageAndPointCloud(image, scan, "output/fused_cones.json", "output/fused_cones.png");
+        Profiler::instance().saveReport("output/timing_report.json");
+        return 0;
+    }
+
+    // LIDAR odometry between two scans
+    if (argc > 1 && std::string(argv[1]) == "lidar-odometry")
+    {
+        std::string scan1 = argc > 2 ? argv[2] : "data/first.pcd";
+        std::string scan2 = argc > 3 ? argv[3] : "data/second.pcd";
+        OdometryResult motion = calculateLidarOdometry(scan1, scan2);
+        Profiler::instance().saveReport("output/timing_report.json");
+        return motion.valid ? 0 : 1;
+    }
+
     std::cout << "=== MODULAR DRIVERLESS PIPELINE ===" << std::endl;
     std::cout << "This program demonstrates three independent steps:" << std::endl;
     std::cout << "  1. Detect cones and save to JSON" << std::endl;
-    std::cout << "  2. Draw track lines from JSON data" << std::endl;
+    std::cout << "  2. Draw track lines from the saved cones" << std::endl;
     std::cout << "  3. Calculate odometry between frames" << std::endl;
     std::cout << std::endl;
 
@@ -50,12 +293,21 @@ int main(int argc, char *argv[])
             else
             {
                 std::cout << "Usage: " << argv[0] << " [1|detect] [2|track] [3|odometry] [all]" << std::endl;
+                std::cout << "       " << argv[0] << " " << streamArguments << std::endl;
+                std::cout << "       " << argv[0] << " lidar [scan.pcd|directory]" << std::endl;
+                std::cout << "       " << argv[0] << " lidar-odometry [first.pcd second.pcd]" << std::endl;
+                std::cout << "       " << argv[0] << " fusion [image.png scan.pcd]" << std::endl;
+                std::cout << "       " << argv[0] << " cameras [camera0.png camera1.png ...]" << std::endl;
+                std::cout << "       " << argv[0] << " " << recordArguments << std::endl;
+                std::cout << "       " << argv[0] << " " << replayArguments << std::endl;
+                std::cout << "       " << argv[0] << " serve     # JSON requests on stdin, one per line" << std::endl;
                 std::cout << "  Run specific steps or all steps (default: all)" << std::endl;
                 std::cout << "Examples:" << std::endl;
                 std::cout << "  " << argv[0] << "           # Run all steps" << std::endl;
                 std::cout << "  " << argv[0] << " 1         # Run only step 1 (detect cones)" << std::endl;
                 std::cout << "  " << argv[0] << " 2         # Run only step 2 (draw track lines)" << std::endl;
                 std::cout << "  " << argv[0] << " 1 2       # Run steps 1 and 2" << std::endl;
+                std::cout << "  " << argv[0] << " stream data/  # Run all steps on every frame in data/" << std::endl;
                 return 0;
             }
         }
@@ -65,35 +317,48 @@ int main(int argc, char *argv[])
     const std::string inputImage = "data/frame_1.png";
     const std::string inputImage2 = "data/frame_2.png";
     const std::string conesJsonPath = "output/detected_cones.json";
+    const std::string conesBinaryPath = "output/detected_cones.bin";
     const std::string trackImagePath = "output/detected_cones.png";
     const std::string odometryImagePath = "output/odometry_matches.png";
+    const std::string timingReportPath = "output/timing_report.json";
+
+    // Empty when a step didn't run or drew nothing
+    cv::Mat trackImage, odometryImage;
 
     // STEP 1: Detect cones from image and save to JSON
     if (runStep1)
     {
-        ConeDetectionResult cones = detectConesFromImage(inputImage, conesJsonPath);
+        ConeDetectionResult cones = detectConesFromImage(inputImage, conesJsonPath, conesBinaryPath);
     }
 
-    // STEP 2: Draw track lines using detected cones from JSON
+    // STEP 2: Draw track lines using detected cones, binary handoff from step 1
+    // (the JSON file when that one is newer or the only one around)
     if (runStep2)
     {
-        cv::Mat trackImage = drawTrackLinesFromCones(inputImage, conesJsonPath, trackImagePath);
+        trackImage = drawTrackLinesFromCones(inputImage, newestConesFile(conesBinaryPath, conesJsonPath), trackImagePath);
     }
 
     // STEP 3: Calculate odometry between two frames
     if (runStep3)
     {
-        cv::Mat odometryImage = calculateOdometry(inputImage, inputImage2, odometryImagePath);
+        odometryImage = calculateOdometry(inputImage, inputImage2, odometryImagePath);
     }
 
+    Profiler::instance().saveReport(timingReportPath);
+
     std::cout << "\n=== PIPELINE COMPLETE ===" << std::endl;
     std::cout << "Output files:" << std::endl;
     if (runStep1)
+    {
         std::cout << "  - Detected cones JSON: " << conesJsonPath << std::endl;
-    if (runStep2)
+        std::cout << "  - Detected cones binary: " << conesBinaryPath << std::endl;
+    }
+    // The images are only listed when this run drew them (not with rendering off)
+    if (!trackImage.empty())
         std::cout << "  - Track lines image: " << trackImagePath << std::endl;
-    if (runStep3)
+    if (!odometryImage.empty())
         std::cout << "  - Odometry visualization: " << odometryImagePath << std::endl;
+    std::cout << "  - Timing report: " << timingReportPath << std::endl;
     std::cout << "\nView results at: http://localhost:8080" << std::endl;
 
     return 0;
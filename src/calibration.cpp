@@ -0,0 +1,217 @@
+#include "../include/calibration.hpp"
+#include "../include/profiling.hpp"
+#include <algorithm>
+#include <cmath>
+
+// Smallest value with at least `p` of the samples at or below it
+static int histogramPercentile(const std::array<uint32_t, 256> &histogram, uint32_t count, double p)
+{
+    uint64_t rank = static_cast<uint64_t>(std::ceil(std::clamp(p, 0.0, 1.0) * count));
+    uint64_t seen = 0;
+    for (int value = 0; value < 256; ++value)
+    {
+        seen += histogram[value];
+        if (seen >= std::max<uint64_t>(rank, 1))
+            return value;
+    }
+    return 255;
+}
+
+ColourCalibrator::ColourCalibrator(const CalibrationParams &params, const RoadMaskParams &roadMask, PublishCallback publish)
+    : params(params), roadMask(roadMask), publish(std::move(publish)),
+      defaults({getColourMask(ORANGE), getColourMask(BLUE), getColourMask(YELLOW)}),
+      current(defaults)
+{
+    for (const auto &colour : current)
+        histograms.emplace_back(colour.colourRanges.size());
+    thread = std::thread(&ColourCalibrator::worker, this);
+}
+
+ColourCalibrator::~ColourCalibrator()
+{
+    stop();
+}
+
+void ColourCalibrator::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (thread.joinable())
+        thread.join();
+}
+
+std::vector<ColourMaskConfig> ColourCalibrator::ranges() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return current;
+}
+
+int ColourCalibrator::refits() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return refitCount;
+}
+
+void ColourCalibrator::sampleCone(const cv::Mat &frame, const Cone &cone, int colour, const std::vector<ColourMaskConfig> &ranges, std::vector<std::vector<RangeHistogram>> &local) const
+{
+    cv::Rect box = cone.boundingBox & cv::Rect(cv::Point(0, 0), frame.size());
+    if (box.area() <= 0)
+        return;
+
+    cv::Mat hsv;
+    cv::cvtColor(frame(box), hsv, cv::COLOR_BGR2HSV);
+
+    // Pixels near a range (by the tolerances) count towards the first such range
+    const auto &colourRanges = ranges[colour].colourRanges;
+    for (int y = 0; y < hsv.rows; ++y)
+    {
+        const uchar *p = hsv.ptr<uchar>(y);
+        for (int x = 0; x < hsv.cols; ++x, p += 3)
+        {
+            for (size_t r = 0; r < colourRanges.size(); ++r)
+            {
+                const ColourRange &range = colourRanges[r];
+                if (p[0] < range.lowerBound[0] - params.hueTolerance || p[0] > range.upperBound[0] + params.hueTolerance ||
+                    p[1] < range.lowerBound[1] - params.satValTolerance || p[1] > range.upperBound[1] ||
+                    p[2] < range.lowerBound[2] - params.satValTolerance || p[2] > range.upperBound[2])
+                    continue;
+
+                RangeHistogram &histogram = local[colour][r];
+                ++histogram.h[p[0]];
+                ++histogram.s[p[1]];
+                ++histogram.v[p[2]];
+                ++histogram.count;
+                break;
+            }
+        }
+    }
+}
+
+void ColourCalibrator::addSamples(const cv::Mat &frame, const ConeDetectionResult &cones)
+{
+    PROFILE_SCOPE("calibration.sample");
+
+    if (frame.empty())
+        return;
+
+    std::vector<ColourMaskConfig> ranges = this->ranges();
+    std::vector<std::vector<RangeHistogram>> local;
+    for (const auto &colour : ranges)
+        local.emplace_back(colour.colourRanges.size());
+
+    // Ages of the ids seen in this frame; the others are forgotten
+    std::unordered_map<int, int> ages;
+    const std::vector<Cone> *byColour[3] = {&cones.orangeCones, &cones.blueCones, &cones.yellowCones};
+    bool sampled = false;
+    for (int colour = 0; colour < 3; ++colour)
+    {
+        for (const auto &cone : *byColour[colour])
+        {
+            if (cone.id < 0)
+                continue;
+            auto it = trackAges.find(cone.id);
+            int age = ages[cone.id] = it == trackAges.end() ? 1 : it->second + 1;
+            if (age >= params.minTrackAge)
+            {
+                sampleCone(frame, cone, colour, ranges, local);
+                sampled = true;
+            }
+        }
+    }
+    trackAges = std::move(ages);
+
+    if (!sampled)
+        return;
+
+    bool ready = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t colour = 0; colour < histograms.size(); ++colour)
+        {
+            for (size_t r = 0; r < histograms[colour].size(); ++r)
+            {
+                RangeHistogram &total = histograms[colour][r];
+                const RangeHistogram &add = local[colour][r];
+                for (int value = 0; value < 256; ++value)
+                {
+                    total.h[value] += add.h[value];
+                    total.s[value] += add.s[value];
+                    total.v[value] += add.v[value];
+                }
+                total.count += add.count;
+                ready = ready || total.count >= static_cast<uint32_t>(params.minSamples);
+            }
+        }
+        pending = pending || ready;
+    }
+    if (ready)
+        wake.notify_one();
+}
+
+bool ColourCalibrator::refit()
+{
+    bool moved = false;
+    for (size_t colour = 0; colour < current.size(); ++colour)
+    {
+        for (size_t r = 0; r < current[colour].colourRanges.size(); ++r)
+        {
+            RangeHistogram &histogram = histograms[colour][r];
+            if (histogram.count < static_cast<uint32_t>(params.minSamples))
+                continue;
+
+            ColourRange &range = current[colour].colourRanges[r];
+            const ColourRange &initial = defaults[colour].colourRanges[r];
+            auto step = [&](double value, double fitted, double base, double limit)
+            {
+                double next = value + params.learningRate * (fitted - value);
+                return std::clamp(std::round(next), std::max(0.0, base - params.maxDrift), std::min(limit, base + params.maxDrift));
+            };
+
+            // Hue on both sides, saturation and value only from below (the
+            // upper bounds stay as configured, usually 255)
+            double hueLow = step(range.lowerBound[0], histogramPercentile(histogram.h, histogram.count, params.lowPercentile), initial.lowerBound[0], 179.0);
+            double hueHigh = step(range.upperBound[0], histogramPercentile(histogram.h, histogram.count, params.highPercentile), initial.upperBound[0], 179.0);
+            double satLow = step(range.lowerBound[1], histogramPercentile(histogram.s, histogram.count, params.lowPercentile), initial.lowerBound[1], 255.0);
+            double valLow = step(range.lowerBound[2], histogramPercentile(histogram.v, histogram.count, params.lowPercentile), initial.lowerBound[2], 255.0);
+
+            if (hueLow <= hueHigh && satLow <= range.upperBound[1] && valLow <= range.upperBound[2])
+            {
+                moved = moved || hueLow != range.lowerBound[0] || hueHigh != range.upperBound[0] ||
+                        satLow != range.lowerBound[1] || valLow != range.lowerBound[2];
+                range.lowerBound = cv::Scalar(hueLow, satLow, valLow);
+                range.upperBound[0] = hueHigh;
+            }
+            histogram = RangeHistogram();
+        }
+    }
+    return moved;
+}
+
+void ColourCalibrator::worker()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        wake.wait(lock, [this]
+                  { return pending || stopping; });
+        if (stopping)
+            return;
+        pending = false;
+
+        if (!refit())
+            continue;
+        ++refitCount;
+        std::vector<ColourMaskConfig> ranges = current;
+
+        // The LUT is built and published without the lock, sampling goes on meanwhile
+        lock.unlock();
+        {
+            PROFILE_SCOPE("calibration.rebuild_lut");
+            publish(std::make_shared<const HsvLut>(buildHsvLut(roadMask, ranges)));
+        }
+        lock.lock();
+    }
+}
@@ -0,0 +1,205 @@
+#include "../include/centerline.hpp"
+#include "../include/profiling.hpp"
+#include <algorithm>
+#include <cmath>
+
+json centerlineToJson(const Centerline &centerline)
+{
+    json points = json::array();
+    for (const auto &p : centerline.points)
+        points.push_back({{"x", p.position.x}, {"y", p.position.y}, {"curvature", p.curvature}, {"width", p.width}});
+    return points;
+}
+
+void drawCenterline(cv::Mat &image, const Centerline &centerline)
+{
+    for (size_t i = 1; i < centerline.points.size(); ++i)
+        cv::line(image, centerline.points[i - 1].position, centerline.points[i].position, cv::Scalar(255, 255, 255), 2);
+}
+
+// Closest point to p on segment ab
+static cv::Point2f closestOnSegment(const cv::Point2f &p, const cv::Point2f &a, const cv::Point2f &b)
+{
+    cv::Point2f ab = b - a;
+    float lengthSquared = ab.dot(ab);
+    if (lengthSquared <= 0.0f)
+        return a;
+    float t = std::clamp((p - a).dot(ab) / lengthSquared, 0.0f, 1.0f);
+    return a + ab * t;
+}
+
+// Signed curvature of the circle through a, b and c
+static float mengerCurvature(const cv::Point2f &a, const cv::Point2f &b, const cv::Point2f &c)
+{
+    cv::Point2f ab = b - a, bc = c - b, ac = c - a;
+    double denominator = std::sqrt(static_cast<double>(ab.dot(ab)) * bc.dot(bc) * ac.dot(ac));
+    if (denominator <= 0.0)
+        return 0.0f;
+    double cross = static_cast<double>(ab.x) * bc.y - static_cast<double>(ab.y) * bc.x;
+    return static_cast<float>(2.0 * cross / denominator);
+}
+
+CenterlineBuilder::CenterlineBuilder(const CenterlineParams &params) : params(params)
+{
+}
+
+void CenterlineBuilder::reset()
+{
+    previousOther.clear();
+    previousMidpoints.clear();
+    previousReferenceSize = 0;
+    previousDropped = false;
+    path = Centerline();
+}
+
+// Squared distance from ref to segment s of the other edge; a single cone on
+// the other side is a segment of length zero
+float CenterlineBuilder::segmentDistance(const cv::Point2f &ref, size_t s) const
+{
+    cv::Point2f q = closestOnSegment(ref, other[s], other[std::min(s + 1, other.size() - 1)]);
+    cv::Point2f d = q - ref;
+    return d.dot(d);
+}
+
+CenterlineBuilder::Midpoint CenterlineBuilder::computeMidpoint(const cv::Point2f &ref) const
+{
+    Midpoint m;
+    m.reference = ref;
+
+    float best = params.maxTrackWidth * params.maxTrackWidth;
+    size_t segments = other.size() > 1 ? other.size() - 1 : other.size();
+    for (size_t s = 0; s < segments; ++s)
+    {
+        float distance = segmentDistance(ref, s);
+        if (distance < best)
+        {
+            best = distance;
+            m.segment = static_cast<int>(s);
+            m.position = (ref + closestOnSegment(ref, other[s], other[std::min(s + 1, other.size() - 1)])) * 0.5f;
+            m.width = std::sqrt(distance);
+            m.distance = distance;
+        }
+    }
+    return m;
+}
+
+bool CenterlineBuilder::reusable(size_t i) const
+{
+    if (i >= previousMidpoints.size() || previousMidpoints[i].reference != reference[i])
+        return false;
+    if (other.size() != previousOther.size())
+        return false;
+
+    // Segments that didn't move keep their distances, so they still lose to
+    // the cached one; only the moved ones can take over. Ties go to the lower
+    // index, as in computeMidpoint()
+    const Midpoint &cached = previousMidpoints[i];
+    if (cached.segment >= 0 && segmentMoved[cached.segment])
+        return false;
+    float best = cached.segment >= 0 ? cached.distance : params.maxTrackWidth * params.maxTrackWidth;
+    for (int s : movedSegments)
+    {
+        float distance = segmentDistance(reference[i], s);
+        if (distance < best || (distance == best && cached.segment >= 0 && s < cached.segment))
+            return false;
+    }
+    return true;
+}
+
+const Centerline &CenterlineBuilder::update(const ConeDetectionResult &cones, const TrackEdges &edges)
+{
+    PROFILE_SCOPE("path.centerline");
+
+    // The longer edge sees further, the other one is only searched
+    bool blueReference = edges.blue.size() >= edges.yellow.size();
+    const std::vector<int> &referenceEdge = blueReference ? edges.blue : edges.yellow;
+    const std::vector<int> &otherEdge = blueReference ? edges.yellow : edges.blue;
+    const std::vector<Cone> &referenceCones = blueReference ? cones.blueCones : cones.yellowCones;
+    const std::vector<Cone> &otherCones = blueReference ? cones.yellowCones : cones.blueCones;
+
+    reference.clear();
+    for (int i : referenceEdge)
+        reference.push_back(referenceCones[i].center);
+    other.clear();
+    for (int i : otherEdge)
+        other.push_back(otherCones[i].center);
+
+    // Swapping sides invalidates everything
+    if (blueReference != previousBlueReference)
+        previousMidpoints.clear();
+    previousBlueReference = blueReference;
+
+    // Segments with an end that moved since the last update
+    movedSegments.clear();
+    segmentMoved.assign(other.size(), false);
+    if (other.size() == previousOther.size())
+    {
+        size_t segments = other.size() > 1 ? other.size() - 1 : other.size();
+        for (size_t s = 0; s < segments; ++s)
+        {
+            size_t next = std::min(s + 1, other.size() - 1);
+            if (other[s] != previousOther[s] || other[next] != previousOther[next])
+            {
+                segmentMoved[s] = true;
+                movedSegments.push_back(static_cast<int>(s));
+            }
+        }
+    }
+
+    // Midpoints, rebuilding only the ones whose inputs moved
+    midpoints.resize(reference.size());
+    std::vector<bool> changed(reference.size(), false);
+    path.recomputed = 0;
+    for (size_t i = 0; i < reference.size(); ++i)
+    {
+        if (reusable(i))
+        {
+            midpoints[i] = previousMidpoints[i];
+            continue;
+        }
+        midpoints[i] = computeMidpoint(reference[i]);
+        changed[i] = true;
+        ++path.recomputed;
+    }
+
+    // Points without a partner within maxTrackWidth are left out, which
+    // shifts the indices of the ones after them; curvature can only be copied
+    // by index when neither this update nor the last one dropped any and the
+    // reference kept its length, otherwise it is redone for all
+    std::vector<PathPoint> points;
+    bool dropped = false;
+    for (size_t i = 0; i < midpoints.size(); ++i)
+    {
+        if (midpoints[i].segment < 0)
+        {
+            dropped = true;
+            continue;
+        }
+        PathPoint p;
+        p.position = midpoints[i].position;
+        p.width = midpoints[i].width;
+        points.push_back(p);
+    }
+    bool layoutChanged = dropped || previousDropped || reference.size() != previousReferenceSize;
+
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        if (points.size() < 3)
+            break;
+
+        // Ends take the curvature of their neighbour
+        size_t center = std::clamp<size_t>(i, 1, points.size() - 2);
+        bool dirty = layoutChanged || changed[center - 1] || changed[center] || changed[center + 1];
+        if (!dirty)
+            points[i].curvature = path.points[i].curvature;
+        else
+            points[i].curvature = mengerCurvature(points[center - 1].position, points[center].position, points[center + 1].position);
+    }
+    path.points = std::move(points);
+
+    std::swap(previousMidpoints, midpoints);
+    previousOther = other;
+    previousReferenceSize = reference.size();
+    previousDropped = dropped;
+    return path;
+}
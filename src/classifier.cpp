@@ -0,0 +1,312 @@
+#include "../include/classifier.hpp"
+#include "../include/profiling.hpp"
+#include "../include/workspace.hpp"
+#include <algorithm>
+#include <cmath>
+
+bool addColourToLut(HsvLut &lut, const ColourMaskConfig &cfg, uchar label)
+{
+    if (lut.rangeCount + (int)cfg.colourRanges.size() > HsvLut::maxRanges)
+        return false;
+
+    for (const auto &range : cfg.colourRanges)
+    {
+        uchar bit = static_cast<uchar>(1 << lut.rangeCount++);
+        uchar *tables[3] = {lut.h, lut.s, lut.v};
+
+        // Same inclusive bounds as cv::inRange
+        for (int c = 0; c < 3; ++c)
+        {
+            int lo = std::max(0, (int)std::ceil(range.lowerBound[c]));
+            int hi = std::min(255, (int)std::floor(range.upperBound[c]));
+            for (int value = lo; value <= hi; ++value)
+                tables[c][value] |= bit;
+        }
+
+        for (int bits = 0; bits < 256; ++bits)
+        {
+            if (bits & bit)
+                lut.rangeLabels[bits] |= label;
+        }
+    }
+
+    return true;
+}
+
+HsvLut buildHsvLut(const RoadMaskParams &roadMask)
+{
+    return buildHsvLut(roadMask, {getColourMask(ORANGE), getColourMask(BLUE), getColourMask(YELLOW)});
+}
+
+HsvLut buildHsvLut(const RoadMaskParams &roadMask, const std::vector<ColourMaskConfig> &coneColours)
+{
+    static const uchar labels[3] = {LABEL_ORANGE, LABEL_BLUE, LABEL_YELLOW};
+
+    HsvLut lut;
+    addColourToLut(lut, {"Road", {{roadMask.hsvLower, roadMask.hsvUpper}}}, LABEL_ROAD);
+    for (size_t i = 0; i < coneColours.size() && i < 3; ++i)
+        addColourToLut(lut, coneColours[i], labels[i]);
+    return lut;
+}
+
+void classifyColours(const cv::Mat &hsvImage, const HsvLut &lut, const cv::Mat &negMask, cv::Mat &labels)
+{
+    PROFILE_SCOPE("detect.classify");
+
+    CV_Assert(hsvImage.type() == CV_8UC3);
+    CV_Assert(negMask.empty() || (negMask.type() == CV_8UC1 && negMask.size() == hsvImage.size()));
+
+    labels.create(hsvImage.size(), CV_8UC1);
+
+    cv::parallel_for_(cv::Range(0, hsvImage.rows), [&](const cv::Range &rows)
+                      {
+        for (int y = rows.start; y < rows.end; ++y)
+        {
+            const uchar *src = hsvImage.ptr<uchar>(y);
+            const uchar *neg = negMask.empty() ? nullptr : negMask.ptr<uchar>(y);
+            uchar *dst = labels.ptr<uchar>(y);
+
+            for (int x = 0; x < hsvImage.cols; ++x, src += 3)
+            {
+                uchar label = lut.classify(src[0], src[1], src[2]);
+                dst[x] = (neg && neg[x]) ? static_cast<uchar>(LABEL_NONE) : label;
+            }
+        } });
+}
+
+// Erode/dilate plus close/open cleanup, same sequence as detectColour; host or device mask
+static void cleanupMask(cv::InputOutputArray mask, bool dilate, bool erode, const ColorDetectionParams &params, const cv::Mat &kernel)
+{
+    if (erode)
+        cv::erode(mask, mask, cv::Mat(), cv::Point(-1, -1), params.erosionIterations, workspaceBorder, cv::morphologyDefaultBorderValue());
+
+    if (dilate)
+        cv::dilate(mask, mask, cv::Mat(), cv::Point(-1, -1), params.dilationIterations, workspaceBorder, cv::morphologyDefaultBorderValue());
+
+    cv::morphologyEx(mask, mask, cv::MORPH_CLOSE, kernel, cv::Point(-1, -1), 1, workspaceBorder, cv::morphologyDefaultBorderValue());
+    cv::morphologyEx(mask, mask, cv::MORPH_OPEN, kernel, cv::Point(-1, -1), 1, workspaceBorder, cv::morphologyDefaultBorderValue());
+}
+
+// Rows above and below a pixel its cleanup result depends on: one per
+// erode/dilate iteration (3x3), size/2 for each of the four close/open passes
+static int cleanupHalo(bool dilate, bool erode, const ColorDetectionParams &params)
+{
+    int halo = 4 * (params.morphKernelSize / 2);
+    if (erode)
+        halo += params.erosionIterations;
+    if (dilate)
+        halo += params.dilationIterations;
+    return halo;
+}
+
+struct CleanupJob
+{
+    cv::Mat mask; // Cleaned up in place
+    bool dilate;
+    bool erode;
+};
+
+// Cleans up all jobs (masks of one size, at most three), one task per mask
+// when `parallel`. Large masks are also split into row bands, each cleaned up
+// with `halo` extra rows read from an untouched copy, so the result is the
+// same as the untiled cleanup and every band of every mask is its own task.
+static void cleanupMasks(CleanupJob *jobs, int count, bool parallel, const ColorDetectionParams &params, const cv::Mat &kernel, FrameWorkspace &workspace)
+{
+    const cv::Size size = jobs[0].mask.size();
+    int maxHalo = 0;
+    for (int j = 0; j < count; ++j)
+        maxHalo = std::max(maxHalo, cleanupHalo(jobs[j].dilate, jobs[j].erode, params));
+
+    // Bands much thinner than their halo would mostly redo their neighbours' work
+    int tiles = params.morphologyTiles > 0 ? params.morphologyTiles : (size.area() >= params.tiledMinPixels ? cv::getNumThreads() : 1);
+    tiles = std::max(1, std::min(tiles, size.height / std::max(1, 2 * maxHalo)));
+
+    cv::Mat sources[3];
+    if (tiles > 1)
+    {
+        for (int j = 0; j < count; ++j)
+        {
+            sources[j] = workspace.buffer(static_cast<FrameWorkspace::Buffer>(FrameWorkspace::BUFFER_CLEANUP_0 + j), size, CV_8UC1);
+            jobs[j].mask.copyTo(sources[j]);
+        }
+        workspace.reserveTiles(count * tiles);
+    }
+
+    // Pool threads don't know which frame they work on
+    const int frame = Profiler::currentFrame();
+    auto body = [&](const cv::Range &range)
+    {
+        PROFILE_FRAME(frame);
+        for (int task = range.start; task < range.end; ++task)
+        {
+            CleanupJob &job = jobs[task / tiles];
+            if (tiles == 1)
+            {
+                cleanupMask(job.mask, job.dilate, job.erode, params, kernel);
+                continue;
+            }
+
+            int band = task % tiles;
+            int halo = cleanupHalo(job.dilate, job.erode, params);
+            int y0 = size.height * band / tiles, y1 = size.height * (band + 1) / tiles;
+            int top = std::max(0, y0 - halo), bottom = std::min(size.height, y1 + halo);
+
+            cv::Mat tile = workspace.tile(task, cv::Size(size.width, bottom - top), CV_8UC1);
+            sources[task / tiles].rowRange(top, bottom).copyTo(tile);
+            cleanupMask(tile, job.dilate, job.erode, params, kernel);
+            tile.rowRange(y0 - top, y1 - top).copyTo(job.mask.rowRange(y0, y1));
+        }
+    };
+
+    int tasks = count * tiles;
+    if ((parallel || tiles > 1) && tasks > 1)
+        cv::parallel_for_(cv::Range(0, tasks), body, tasks);
+    else
+        body(cv::Range(0, tasks));
+}
+
+// Binary mask of all pixels carrying `label`
+static void extractLabel(const cv::Mat &labels, uchar label, cv::Mat &mask)
+{
+    mask.create(labels.size(), CV_8UC1);
+    cv::parallel_for_(cv::Range(0, labels.rows), [&](const cv::Range &rows)
+                      {
+        for (int y = rows.start; y < rows.end; ++y)
+        {
+            const uchar *src = labels.ptr<uchar>(y);
+            uchar *dst = mask.ptr<uchar>(y);
+            for (int x = 0; x < labels.cols; ++x)
+                dst[x] = (src[x] & label) ? 255 : 0;
+        } });
+}
+
+// Device variant: AND with the label, then 0/255
+static void extractLabel(const cv::UMat &labels, uchar label, cv::UMat &mask)
+{
+    cv::bitwise_and(labels, cv::Scalar(label), mask);
+    cv::compare(mask, cv::Scalar(0), mask, cv::CMP_NE);
+}
+
+// Split all three cone masks in one pass over the labels, without the road
+static void splitConeMasks(const cv::Mat &labels, ColourMasks &masks)
+{
+    PROFILE_SCOPE("detect.split_masks");
+
+    masks.orange.create(labels.size(), CV_8UC1);
+    masks.blue.create(labels.size(), CV_8UC1);
+    masks.yellow.create(labels.size(), CV_8UC1);
+
+    cv::parallel_for_(cv::Range(0, labels.rows), [&](const cv::Range &rows)
+                      {
+        for (int y = rows.start; y < rows.end; ++y)
+        {
+            const uchar *label = labels.ptr<uchar>(y);
+            const uchar *road = masks.road.ptr<uchar>(y);
+            uchar *orange = masks.orange.ptr<uchar>(y);
+            uchar *blue = masks.blue.ptr<uchar>(y);
+            uchar *yellow = masks.yellow.ptr<uchar>(y);
+
+            for (int x = 0; x < labels.cols; ++x)
+            {
+                uchar l = road[x] ? static_cast<uchar>(LABEL_NONE) : label[x];
+                orange[x] = (l & LABEL_ORANGE) ? 255 : 0;
+                blue[x] = (l & LABEL_BLUE) ? 255 : 0;
+                yellow[x] = (l & LABEL_YELLOW) ? 255 : 0;
+            }
+        } });
+}
+
+ColourMasks detectColours(const cv::Mat &hsvImage, const HsvLut &lut, const cv::Mat &negMask, const ColorDetectionParams &params)
+{
+    FrameWorkspace workspace;
+    return detectColours(hsvImage, lut, negMask, params, workspace);
+}
+
+ColourMasks detectColours(const cv::Mat &hsvImage, const HsvLut &lut, const cv::Mat &negMask, const ColorDetectionParams &params, FrameWorkspace &workspace)
+{
+    const cv::Size size = hsvImage.size();
+    ColourMasks masks;
+    masks.road = workspace.buffer(FrameWorkspace::BUFFER_ROAD, size, CV_8UC1);
+    masks.orange = workspace.buffer(FrameWorkspace::BUFFER_ORANGE, size, CV_8UC1);
+    masks.blue = workspace.buffer(FrameWorkspace::BUFFER_BLUE, size, CV_8UC1);
+    masks.yellow = workspace.buffer(FrameWorkspace::BUFFER_YELLOW, size, CV_8UC1);
+
+    cv::Mat labels = workspace.buffer(FrameWorkspace::BUFFER_LABELS, size, CV_8UC1);
+    classifyColours(hsvImage, lut, negMask, labels);
+
+    const cv::Mat &kernel = workspace.ellipseKernel(params.morphKernelSize);
+
+    // Road first, the cone masks exclude the cleaned-up road
+    extractLabel(labels, LABEL_ROAD, masks.road);
+    {
+        PROFILE_SCOPE("detect.cleanup_road");
+        CleanupJob road = {masks.road, false, true};
+        cleanupMasks(&road, 1, false, params, kernel, workspace);
+    }
+
+    splitConeMasks(labels, masks);
+
+    // The three cone colours are independent from here on
+    {
+        PROFILE_SCOPE("detect.cleanup_cones");
+        CleanupJob cones[3] = {{masks.orange, true, false}, {masks.blue, true, false}, {masks.yellow, true, false}};
+        cleanupMasks(cones, 3, params.parallelColours, params, kernel, workspace);
+    }
+
+    return masks;
+}
+
+ColourMasks detectColours(const cv::UMat &hsvImage, const HsvLut &lut, const cv::UMat &negMask, const ColorDetectionParams &params,
+                          DeviceWorkspace &device, FrameWorkspace &workspace)
+{
+    const cv::Size size = hsvImage.size();
+    cv::UMat labels = device.buffer(DeviceWorkspace::BUFFER_LABELS, size, CV_8UC1);
+    {
+        PROFILE_SCOPE("detect.classify");
+
+        // Per-channel range bits, their AND mapped to the labels as in HsvLut::classify
+        std::vector<cv::UMat> channels = {device.buffer(DeviceWorkspace::BUFFER_H, size, CV_8UC1),
+                                          device.buffer(DeviceWorkspace::BUFFER_S, size, CV_8UC1),
+                                          device.buffer(DeviceWorkspace::BUFFER_V, size, CV_8UC1)};
+        cv::split(hsvImage, channels);
+        const uchar *tables[3] = {lut.h, lut.s, lut.v};
+        for (int c = 0; c < 3; ++c)
+            cv::LUT(channels[c], cv::Mat(1, 256, CV_8UC1, const_cast<uchar *>(tables[c])), channels[c]);
+        cv::bitwise_and(channels[0], channels[1], channels[0]);
+        cv::bitwise_and(channels[0], channels[2], channels[0]);
+        cv::LUT(channels[0], cv::Mat(1, 256, CV_8UC1, const_cast<uchar *>(lut.rangeLabels)), labels);
+        if (!negMask.empty())
+            labels.setTo(cv::Scalar(LABEL_NONE), negMask);
+    }
+
+    const cv::Mat &kernel = workspace.ellipseKernel(params.morphKernelSize);
+
+    // Road first, the cone masks exclude the cleaned-up road
+    cv::UMat road = device.buffer(DeviceWorkspace::BUFFER_ROAD, size, CV_8UC1);
+    {
+        PROFILE_SCOPE("detect.cleanup_road");
+        extractLabel(labels, LABEL_ROAD, road);
+        cleanupMask(road, false, true, params, kernel);
+    }
+    labels.setTo(cv::Scalar(LABEL_NONE), road);
+
+    // One device queue, so the colours run one after the other; each mask is
+    // downloaded for findContours as soon as it is cleaned up
+    ColourMasks masks;
+    masks.orange = workspace.buffer(FrameWorkspace::BUFFER_ORANGE, size, CV_8UC1);
+    masks.blue = workspace.buffer(FrameWorkspace::BUFFER_BLUE, size, CV_8UC1);
+    masks.yellow = workspace.buffer(FrameWorkspace::BUFFER_YELLOW, size, CV_8UC1);
+    {
+        PROFILE_SCOPE("detect.cleanup_cones");
+        const std::pair<uchar, cv::Mat *> cones[3] = {{LABEL_ORANGE, &masks.orange}, {LABEL_BLUE, &masks.blue}, {LABEL_YELLOW, &masks.yellow}};
+        cv::UMat cone = device.buffer(DeviceWorkspace::BUFFER_CONE, size, CV_8UC1);
+        for (const auto &colour : cones)
+        {
+            extractLabel(labels, colour.first, cone);
+            cleanupMask(cone, true, false, params, kernel);
+            cone.copyTo(*colour.second);
+        }
+    }
+
+    return masks;
+}
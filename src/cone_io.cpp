@@ -0,0 +1,268 @@
+#include "../include/cone_io.hpp"
+#include "../include/json.hpp"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using json = nlohmann::json;
+
+static const char *coneKeys[3] = {"orangeCones", "blueCones", "yellowCones"};
+
+static const std::vector<Cone> &conesOf(const ConeDetectionResult &result, int colour)
+{
+    return colour == CONE_ORANGE ? result.orangeCones : colour == CONE_BLUE ? result.blueCones
+                                                                             : result.yellowCones;
+}
+
+static std::vector<Cone> &conesOf(ConeDetectionResult &result, int colour)
+{
+    return colour == CONE_ORANGE ? result.orangeCones : colour == CONE_BLUE ? result.blueCones
+                                                                             : result.yellowCones;
+}
+
+// JSON serialization helpers
+void saveConeDetectionToJson(const ConeDetectionResult &result, const std::string &filepath)
+{
+    std::ofstream file(filepath);
+    if (!file.is_open())
+    {
+        std::cerr << "Error: Could not open file for writing: " << filepath << std::endl;
+        return;
+    }
+
+    // Ordered so the file keeps the orange/blue/yellow and x/y/bbox layout
+    nlohmann::ordered_json j;
+    for (int colour = 0; colour < 3; ++colour)
+    {
+        j[coneKeys[colour]] = nlohmann::ordered_json::array();
+        for (const auto &cone : conesOf(result, colour))
+        {
+            nlohmann::ordered_json c = {{"x", cone.center.x},
+                                        {"y", cone.center.y},
+                                        {"bbox_x", cone.boundingBox.x},
+                                        {"bbox_y", cone.boundingBox.y},
+                                        {"bbox_width", cone.boundingBox.width},
+                                        {"bbox_height", cone.boundingBox.height}};
+            // Only LIDAR cones have a 3D position
+            if (cone.position != cv::Point3f())
+                c["position"] = {cone.position.x, cone.position.y, cone.position.z};
+            if (cone.id >= 0)
+                c["id"] = cone.id;
+            j[coneKeys[colour]].push_back(c);
+        }
+    }
+
+    file << j.dump(2) << "\n";
+    file.close();
+
+    std::cout << "Saved cone detection results to: " << filepath << std::endl;
+}
+
+ConeDetectionResult loadConeDetectionFromJson(const std::string &filepath)
+{
+    ConeDetectionResult result;
+    std::ifstream file(filepath);
+
+    if (!file.is_open())
+    {
+        std::cerr << "Error: Could not open file for reading: " << filepath << std::endl;
+        return result;
+    }
+
+    try
+    {
+        json j;
+        file >> j;
+
+        for (int colour = 0; colour < 3; ++colour)
+        {
+            if (!j.contains(coneKeys[colour]))
+                continue;
+
+            for (const auto &c : j[coneKeys[colour]])
+            {
+                Cone cone;
+                cone.center = cv::Point(c.value("x", 0), c.value("y", 0));
+                cone.boundingBox = cv::Rect(c.value("bbox_x", 0), c.value("bbox_y", 0),
+                                            c.value("bbox_width", 0), c.value("bbox_height", 0));
+                if (c.contains("position") && c["position"].size() == 3)
+                    cone.position = cv::Point3f(c["position"][0], c["position"][1], c["position"][2]);
+                cone.id = c.value("id", -1);
+                conesOf(result, colour).push_back(cone);
+            }
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error parsing cone file " << filepath << ": " << e.what() << std::endl;
+        return ConeDetectionResult();
+    }
+
+    std::cout << "Loaded cone detection results from: " << filepath << std::endl;
+    std::cout << "  Orange cones: " << result.orangeCones.size() << std::endl;
+    std::cout << "  Blue cones: " << result.blueCones.size() << std::endl;
+    std::cout << "  Yellow cones: " << result.yellowCones.size() << std::endl;
+
+    return result;
+}
+
+size_t packedConeDetectionSize(const ConeDetectionResult &result)
+{
+    size_t count = result.orangeCones.size() + result.blueCones.size() + result.yellowCones.size();
+    return sizeof(PackedConeHeader) + count * sizeof(PackedCone);
+}
+
+size_t packConeDetection(const ConeDetectionResult &result, void *buffer, size_t capacity)
+{
+    size_t size = packedConeDetectionSize(result);
+    if (!buffer || capacity < size)
+        return 0;
+
+    PackedConeHeader header;
+    std::memcpy(header.magic, "CONE", 4);
+    header.version = packedConeVersion;
+
+    uint8_t *out = static_cast<uint8_t *>(buffer) + sizeof(PackedConeHeader);
+    for (int colour = 0; colour < 3; ++colour)
+    {
+        const auto &cones = conesOf(result, colour);
+        header.counts[colour] = static_cast<uint32_t>(cones.size());
+
+        for (const auto &cone : cones)
+        {
+            PackedCone packed = {cone.center.x, cone.center.y,
+                                 cone.boundingBox.x, cone.boundingBox.y,
+                                 cone.boundingBox.width, cone.boundingBox.height,
+                                 cone.position.x, cone.position.y, cone.position.z,
+                                 cone.id};
+            std::memcpy(out, &packed, sizeof(PackedCone));
+            out += sizeof(PackedCone);
+        }
+    }
+
+    std::memcpy(buffer, &header, sizeof(PackedConeHeader));
+    return size;
+}
+
+bool ConeDetectionView::attach(const void *buffer, size_t size)
+{
+    *this = ConeDetectionView();
+    if (!buffer || size < sizeof(PackedConeHeader))
+        return false;
+
+    const PackedConeHeader *header = static_cast<const PackedConeHeader *>(buffer);
+    if (std::memcmp(header->magic, "CONE", 4) != 0 || header->version != packedConeVersion)
+        return false;
+
+    size_t total = (size_t)header->counts[0] + header->counts[1] + header->counts[2];
+    if (size < sizeof(PackedConeHeader) + total * sizeof(PackedCone))
+        return false;
+
+    // Records are 4-byte aligned after the 20-byte header, safe to point at directly
+    const PackedCone *records = reinterpret_cast<const PackedCone *>(header + 1);
+    for (int colour = 0; colour < 3; ++colour)
+    {
+        cones[colour] = records;
+        counts[colour] = header->counts[colour];
+        records += counts[colour];
+    }
+    return true;
+}
+
+ConeDetectionResult ConeDetectionView::toResult() const
+{
+    ConeDetectionResult result;
+    for (int colour = 0; colour < 3; ++colour)
+    {
+        auto &out = conesOf(result, colour);
+        out.reserve(counts[colour]);
+        for (size_t i = 0; i < counts[colour]; ++i)
+        {
+            const PackedCone &packed = cones[colour][i];
+            Cone cone;
+            cone.center = cv::Point(packed.x, packed.y);
+            cone.boundingBox = cv::Rect(packed.bboxX, packed.bboxY, packed.bboxWidth, packed.bboxHeight);
+            cone.position = cv::Point3f(packed.positionX, packed.positionY, packed.positionZ);
+            cone.id = packed.id;
+            out.push_back(cone);
+        }
+    }
+    return result;
+}
+
+MappedConeFile::~MappedConeFile()
+{
+    close();
+}
+
+bool MappedConeFile::open(const std::string &filepath)
+{
+    close();
+
+    int fd = ::open(filepath.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+        return false;
+
+    data = mapped;
+    size = st.st_size;
+
+    if (!coneView.attach(data, size))
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedConeFile::close()
+{
+    if (data)
+        munmap(data, size);
+    data = nullptr;
+    size = 0;
+    coneView = ConeDetectionView();
+}
+
+void saveConeDetectionToBinary(const ConeDetectionResult &result, const std::string &filepath)
+{
+    std::vector<uint8_t> buffer(packedConeDetectionSize(result));
+    packConeDetection(result, buffer.data(), buffer.size());
+
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cerr << "Error: Could not open file for writing: " << filepath << std::endl;
+        return;
+    }
+    file.write(reinterpret_cast<const char *>(buffer.data()), buffer.size());
+
+    std::cout << "Saved binary cone detection results to: " << filepath << std::endl;
+}
+
+ConeDetectionResult loadConeDetectionFromBinary(const std::string &filepath)
+{
+    MappedConeFile mapped;
+    if (!mapped.open(filepath))
+    {
+        std::cerr << "Error: Could not read binary cone file: " << filepath << std::endl;
+        return ConeDetectionResult();
+    }
+
+    return mapped.view().toResult();
+}
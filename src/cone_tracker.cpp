@@ -0,0 +1,216 @@
+#include "../include/cone_tracker.hpp"
+#include "../include/profiling.hpp"
+#include <algorithm>
+#include <tuple>
+
+// Velocity of a new track is unknown, ~10 px per frame either way
+static const double initialVelocityVariance = 100.0;
+
+void AxisFilter::init(double position, double measurementNoise)
+{
+    state = cv::Vec2d(position, 0.0);
+    covariance = cv::Matx22d(measurementNoise, 0.0, 0.0, initialVelocityVariance);
+}
+
+void AxisFilter::predict(double processNoise)
+{
+    // x' = F x, P' = F P F^T + Q with F = [1 1; 0 1] and Q from a white
+    // acceleration over one frame
+    const cv::Matx22d &P = covariance;
+    state = cv::Vec2d(state[0] + state[1], state[1]);
+    covariance = cv::Matx22d(P(0, 0) + P(0, 1) + P(1, 0) + P(1, 1) + processNoise * 0.25,
+                             P(0, 1) + P(1, 1) + processNoise * 0.5,
+                             P(1, 0) + P(1, 1) + processNoise * 0.5,
+                             P(1, 1) + processNoise);
+}
+
+void AxisFilter::update(double position, double measurementNoise)
+{
+    // Only the position is measured, H = [1 0]
+    const cv::Matx22d P = covariance;
+    double s = P(0, 0) + measurementNoise;
+    cv::Vec2d gain(P(0, 0) / s, P(1, 0) / s);
+    double innovation = position - state[0];
+
+    state += gain * innovation;
+    for (int i = 0; i < 2; ++i)
+        for (int j = 0; j < 2; ++j)
+            covariance(i, j) = P(i, j) - gain[i] * P(0, j);
+}
+
+static std::vector<Cone> &conesOf(ConeDetectionResult &result, int colour)
+{
+    return colour == 0 ? result.orangeCones : colour == 1 ? result.blueCones
+                                                          : result.yellowCones;
+}
+
+static const std::vector<Cone> &conesOf(const ConeDetectionResult &result, int colour)
+{
+    return colour == 0 ? result.orangeCones : colour == 1 ? result.blueCones
+                                                          : result.yellowCones;
+}
+
+ConeTracker::ConeTracker(const TrackerParams &params) : params(params)
+{
+}
+
+void ConeTracker::reset()
+{
+    tracks.clear();
+    nextId = 0;
+    framesSinceFull = 0;
+}
+
+void ConeTracker::predict()
+{
+    for (auto &track : tracks)
+    {
+        track.x.predict(params.processNoise);
+        track.y.predict(params.processNoise);
+    }
+    ++framesSinceFull;
+}
+
+bool ConeTracker::needsFullDetection() const
+{
+    return tracks.empty() || framesSinceFull >= params.fullDetectionInterval;
+}
+
+Cone ConeTracker::predictedCone(const Track &track) const
+{
+    Cone cone;
+    cone.center = cv::Point(cvRound(track.x.state[0]), cvRound(track.y.state[0]));
+    cone.boundingBox = cv::Rect(cone.center + track.boxOffset, track.boxSize);
+    cone.id = track.id;
+    return cone;
+}
+
+ConeDetectionResult ConeTracker::predictedCones() const
+{
+    ConeDetectionResult result;
+    for (const auto &track : tracks)
+        conesOf(result, track.colour).push_back(predictedCone(track));
+    return result;
+}
+
+std::vector<cv::Rect> ConeTracker::searchWindows(const cv::Size &size) const
+{
+    const cv::Rect frame(cv::Point(0, 0), size);
+    const int margin = params.searchMargin;
+
+    std::vector<cv::Rect> windows;
+    for (const auto &track : tracks)
+    {
+        cv::Rect box = predictedCone(track).boundingBox;
+        cv::Rect window = cv::Rect(box.x - margin, box.y - margin, box.width + 2 * margin, box.height + 2 * margin) & frame;
+        if (window.area() > 0)
+            windows.push_back(window);
+    }
+
+    // Overlapping windows are merged, so no cone is detected twice
+    bool merged = true;
+    while (merged)
+    {
+        merged = false;
+        for (size_t i = 0; i < windows.size() && !merged; ++i)
+        {
+            for (size_t j = i + 1; j < windows.size(); ++j)
+            {
+                if ((windows[i] & windows[j]).area() > 0)
+                {
+                    windows[i] |= windows[j];
+                    windows.erase(windows.begin() + j);
+                    merged = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    return windows;
+}
+
+void ConeTracker::startTrack(const Cone &cone, int colour)
+{
+    Track track;
+    track.id = nextId++;
+    track.colour = colour;
+    track.x.init(cone.center.x, params.measurementNoise);
+    track.y.init(cone.center.y, params.measurementNoise);
+    track.boxOffset = cone.boundingBox.tl() - cone.center;
+    track.boxSize = cone.boundingBox.size();
+    tracks.push_back(track);
+}
+
+ConeDetectionResult ConeTracker::update(const ConeDetectionResult &detections, bool fullFrame)
+{
+    PROFILE_SCOPE("tracker.update");
+
+    ConeDetectionResult result = detections;
+    std::vector<bool> matched(tracks.size(), false);
+    const double gate = static_cast<double>(params.gateDistance) * params.gateDistance;
+    const size_t existing = tracks.size();
+
+    for (int colour = 0; colour < 3; ++colour)
+    {
+        std::vector<Cone> &cones = conesOf(result, colour);
+
+        // Every gated (track, detection) pair, taken closest first; ties go to
+        // the older track so the assignment is deterministic
+        std::vector<std::tuple<double, int, int>> pairs;
+        for (size_t t = 0; t < existing; ++t)
+        {
+            if (tracks[t].colour != colour)
+                continue;
+            for (size_t d = 0; d < cones.size(); ++d)
+            {
+                double dx = cones[d].center.x - tracks[t].x.state[0];
+                double dy = cones[d].center.y - tracks[t].y.state[0];
+                double distance = dx * dx + dy * dy;
+                if (distance < gate)
+                    pairs.emplace_back(distance, static_cast<int>(t), static_cast<int>(d));
+            }
+        }
+        std::sort(pairs.begin(), pairs.end());
+
+        std::vector<bool> taken(cones.size(), false);
+        for (const auto &[distance, t, d] : pairs)
+        {
+            if (matched[t] || taken[d])
+                continue;
+            matched[t] = true;
+            taken[d] = true;
+
+            Track &track = tracks[t];
+            track.x.update(cones[d].center.x, params.measurementNoise);
+            track.y.update(cones[d].center.y, params.measurementNoise);
+            track.boxOffset = cones[d].boundingBox.tl() - cones[d].center;
+            track.boxSize = cones[d].boundingBox.size();
+            track.missed = 0;
+            cones[d].id = track.id;
+        }
+
+        for (size_t d = 0; d < cones.size(); ++d)
+        {
+            if (taken[d])
+                continue;
+            startTrack(cones[d], colour);
+            cones[d].id = tracks.back().id;
+        }
+    }
+
+    // Drop the tracks that went unseen for too long (new ones are past `existing`)
+    size_t kept = 0;
+    for (size_t t = 0; t < tracks.size(); ++t)
+    {
+        if (t < existing && !matched[t] && ++tracks[t].missed > params.maxMissedFrames)
+            continue;
+        tracks[kept++] = tracks[t];
+    }
+    tracks.resize(kept);
+
+    if (fullFrame)
+        framesSinceFull = 0;
+
+    return result;
+}
@@ -0,0 +1,13 @@
+#include "../include/debug_sink.hpp"
+
+DebugSink &DebugSink::instance()
+{
+    static DebugSink sink;
+    return sink;
+}
+
+void DebugSink::writeLine(const std::string &line)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    *out << line << std::endl;
+}
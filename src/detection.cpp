@@ -1,46 +1,65 @@
 #include "../include/detection.hpp"
 #include "../include/params.hpp"
+#include "../include/debug_sink.hpp"
+#include "../include/workspace.hpp"
+#include "../include/profiling.hpp"
+#include <algorithm>
 
-#define SHOW_COLOUR_MASKS
-#define SHOW_DETECTED_CONES
+cv::Mat detectColour(const cv::Mat &image, const ColourMaskConfig &cfg, const cv::Mat &negMask, bool dilate, bool erode, const ColorDetectionParams &params)
+{
+    FrameWorkspace workspace;
+    cv::Mat retMask;
+    detectColour(image, cfg, negMask, dilate, erode, params, workspace, retMask);
+    return retMask;
+}
 
-cv::Mat detectColour(const cv::Mat &image, ColourMaskConfig cfg, const cv::Mat &negMask, bool dilate, bool erode, const ColorDetectionParams &params)
+void detectColour(const cv::Mat &image, const ColourMaskConfig &cfg, const cv::Mat &negMask, bool dilate, bool erode, const ColorDetectionParams &params, FrameWorkspace &workspace, cv::Mat &retMask)
 {
-    cv::Mat retMask = cv::Mat::zeros(image.size(), CV_8UC1);
+    retMask.create(image.size(), CV_8UC1);
+    retMask.setTo(0);
 
+    cv::Mat mask = workspace.buffer(FrameWorkspace::BUFFER_RANGE, image.size(), CV_8UC1);
     for (const auto &colourRange : cfg.colourRanges)
     {
         // Threshold
-        cv::Mat mask;
         cv::inRange(image, colourRange.lowerBound, colourRange.upperBound, mask);
         cv::bitwise_or(retMask, mask, retMask);
     }
 
-    // Remove the car area from the mask
-    cv::bitwise_and(retMask, ~negMask, retMask);
+    // Remove the car area from the mask (0/255, so same as AND with its inverse)
+    retMask.setTo(0, negMask);
 
     if (erode)
-        cv::erode(retMask, retMask, cv::Mat(), cv::Point(-1, -1), params.erosionIterations);
+        cv::erode(retMask, retMask, cv::Mat(), cv::Point(-1, -1), params.erosionIterations, workspaceBorder, cv::morphologyDefaultBorderValue());
 
     if (dilate)
-        cv::dilate(retMask, retMask, cv::Mat(), cv::Point(-1, -1), params.dilationIterations);
+        cv::dilate(retMask, retMask, cv::Mat(), cv::Point(-1, -1), params.dilationIterations, workspaceBorder, cv::morphologyDefaultBorderValue());
 
     // Morphological operations to clean up the mask
-    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(params.morphKernelSize, params.morphKernelSize));
+    const cv::Mat &kernel = workspace.ellipseKernel(params.morphKernelSize);
 
-    cv::morphologyEx(retMask, retMask, cv::MORPH_CLOSE, kernel);
-    cv::morphologyEx(retMask, retMask, cv::MORPH_OPEN, kernel);
+    cv::morphologyEx(retMask, retMask, cv::MORPH_CLOSE, kernel, cv::Point(-1, -1), 1, workspaceBorder, cv::morphologyDefaultBorderValue());
+    cv::morphologyEx(retMask, retMask, cv::MORPH_OPEN, kernel, cv::Point(-1, -1), 1, workspaceBorder, cv::morphologyDefaultBorderValue());
+}
 
-    return retMask;
+std::vector<Cone> identifyCones(const cv::Mat &mask, int vThreshold, int hThreshold, int maxArea, int minArea, cv::Mat *debugImage)
+{
+    FrameWorkspace workspace;
+    std::vector<Cone> cones;
+    identifyCones(mask, vThreshold, hThreshold, maxArea, minArea, workspace, cones, debugImage);
+    return cones;
 }
 
-std::vector<Cone> identifyCones(const cv::Mat &mask, const cv::Mat &image, int vThreshold, int hThreshold, int maxArea, int minArea)
+void identifyCones(const cv::Mat &mask, int vThreshold, int hThreshold, int maxArea, int minArea, FrameWorkspace &workspace, std::vector<Cone> &cones, cv::Mat *debugImage)
 {
-    std::vector<Cone> detectedParts;
-    auto img = image.clone();
+    std::vector<Cone> &detectedParts = workspace.parts;
+    detectedParts.clear();
     // Find contours
-    std::vector<std::vector<cv::Point>> contours;
-    cv::findContours(mask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+    std::vector<std::vector<cv::Point>> &contours = workspace.contours;
+    {
+        PROFILE_SCOPE("detect.find_contours");
+        cv::findContours(mask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+    }
 
     for (const auto &contour : contours)
     {
@@ -49,7 +68,7 @@ std::vector<Cone> identifyCones(const cv::Mat &mask, const cv::Mat &image, int v
         // If the bounding box is too small or big, skip
         if (boundingBox.area() < minArea || boundingBox.area() > maxArea)
         {
-            std::cout << "\tDiscarding contour with area: " << boundingBox.area() << std::endl;
+            DEBUG_LOG("\tDiscarding contour with area: " << boundingBox.area());
             continue;
         }
 
@@ -60,47 +79,104 @@ std::vector<Cone> identifyCones(const cv::Mat &mask, const cv::Mat &image, int v
             int cX = static_cast<int>(M.m10 / M.m00);
             int cY = static_cast<int>(M.m01 / M.m00);
 
-            detectedParts.push_back({boundingBox, cv::Point(cX, cY)});
-            cv::rectangle(img, boundingBox, cv::Scalar(255, 0, 0), 1);
-            cv::circle(img, cv::Point(cX, cY), 2, cv::Scalar(0, 0, 255), -1);
+            detectedParts.push_back({boundingBox, cv::Point(cX, cY), cv::Point3f()});
+            if (debugImage)
+            {
+                cv::rectangle(*debugImage, boundingBox, cv::Scalar(255, 0, 0), 1);
+                cv::circle(*debugImage, cv::Point(cX, cY), 2, cv::Scalar(0, 0, 255), -1);
+            }
         }
     }
 
-    // Filter out duplicates based on proximity, keep the lowest (base)
+    PROFILE_SCOPE("detect.merge");
+
+    // Filter out duplicates based on proximity, keep the lowest (base).
+    // Ties broken on x so the result doesn't depend on the contour order
     std::sort(detectedParts.begin(), detectedParts.end(), [](const Cone &a, const Cone &b)
-              { return a.center.y < b.center.y; });
+              { return a.center.y != b.center.y ? a.center.y < b.center.y : a.center.x < b.center.x; });
 
-    std::vector<Cone> cones;
+    cones.clear();
+    std::vector<int> &coneCells = workspace.coneCells;
+    coneCells.clear();
+    ConeGrid &grid = workspace.mergeGrid;
+    grid.reset(mask.size(), hThreshold, vThreshold);
 
-    // Start from the top cones and merge downwards
+    // Start from the top cones and merge downwards, each part into at most
+    // one cone: the closest one (in threshold units), the oldest on ties
     for (const auto &part : detectedParts)
     {
-        bool merged = false;
-        for (int i = 0; i < cones.size(); ++i)
-        {
-            const auto &cone = cones[i];
+        int best = -1;
+        double bestDistance = 0.0;
+        grid.forNeighbours(part.center, [&](int i)
+                           {
+            int dx = std::abs(part.center.x - cones[i].center.x);
+            int dy = std::abs(part.center.y - cones[i].center.y);
+            if (dx >= hThreshold || dy >= vThreshold)
+                return;
+
+            double distance = static_cast<double>(dx) * dx / (static_cast<double>(hThreshold) * hThreshold) +
+                              static_cast<double>(dy) * dy / (static_cast<double>(vThreshold) * vThreshold);
+            if (best < 0 || distance < bestDistance || (distance == bestDistance && i < best))
             {
-                if (std::abs(part.center.x - cone.center.x) < hThreshold &&
-                    std::abs(part.center.y - cone.center.y) < vThreshold)
-                {
-                    // Merge the bounding boxes to include both parts
-                    cones[i].boundingBox |= part.boundingBox;
-                    cones[i].center.x = (cones[i].center.x + part.center.x) / 2;
-                    cones[i].center.y = (cones[i].center.y + part.center.y) / 2;
-                    merged = true;
-                }
-            }
-        }
-        if (!merged)
+                best = i;
+                bestDistance = distance;
+            } });
+
+        if (best < 0)
+        {
             cones.push_back(part);
+            coneCells.push_back(grid.cellOf(part.center));
+            grid.insert(coneCells.back(), static_cast<int>(cones.size()) - 1);
+            continue;
+        }
+
+        // Merge the bounding boxes to include both parts
+        Cone &cone = cones[best];
+        cone.boundingBox |= part.boundingBox;
+        cone.center.x = (cone.center.x + part.center.x) / 2;
+        cone.center.y = (cone.center.y + part.center.y) / 2;
+
+        // The merged center may have moved to another cell
+        int cell = grid.cellOf(cone.center);
+        if (cell != coneCells[best])
+        {
+            grid.remove(coneCells[best], best);
+            grid.insert(cell, best);
+            coneCells[best] = cell;
+        }
     }
 
     // Draw bounding boxes for visualization
-    for (const auto &cone : cones)
+    if (debugImage)
+    {
+        for (const auto &cone : cones)
+        {
+            cv::rectangle(*debugImage, cone.boundingBox, cv::Scalar(0, 255, 0), 1);
+            cv::circle(*debugImage, cone.center, 2, cv::Scalar(255, 0, 0), -1);
+        }
+    }
+}
+
+cv::Rect getDetectionRoi(const cv::Size &size, const RoiParams &params, const ConeDetectionResult *previous)
+{
+    if (params.mode == "none")
+        return cv::Rect(0, 0, size.width, size.height);
+
+    float top = params.top;
+    if (params.mode == "cones" && previous)
     {
-        cv::rectangle(img, cone.boundingBox, cv::Scalar(0, 255, 0), 1);
-        cv::circle(img, cone.center, 2, cv::Scalar(255, 0, 0), -1);
+        // The highest cones are the farthest ones, right below the horizon
+        int highest = size.height;
+        for (const auto *cones : {&previous->orangeCones, &previous->blueCones, &previous->yellowCones})
+        {
+            for (const auto &cone : *cones)
+                highest = std::min(highest, cone.boundingBox.y);
+        }
+        if (highest < size.height)
+            top = static_cast<float>(highest) / size.height - params.margin;
     }
 
-    return cones;
+    int y0 = std::clamp(static_cast<int>(top * size.height), 0, size.height - 1);
+    int y1 = std::clamp(static_cast<int>(params.bottom * size.height), y0 + 1, size.height);
+    return cv::Rect(0, y0, size.width, y1 - y0);
 }
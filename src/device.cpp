@@ -0,0 +1,28 @@
+#include "../include/device.hpp"
+#include "../include/profiling.hpp"
+
+bool useDevice(const AccelerationParams &params)
+{
+    return params.backend == "opencl" && cv::ocl::haveOpenCL();
+}
+
+cv::UMat uploadFrame(const cv::Mat &frame, const AccelerationParams &params)
+{
+    cv::UMat device;
+    if (!frame.empty() && useDevice(params))
+    {
+        PROFILE_SCOPE("frame.upload");
+        frame.copyTo(device);
+    }
+    return device;
+}
+
+const cv::UMat &DeviceImageCache::get(const cv::Mat &host)
+{
+    if (host.data != source.data || host.size() != source.size() || host.type() != source.type())
+    {
+        source = host;
+        host.copyTo(device);
+    }
+    return device;
+}
@@ -0,0 +1,163 @@
+#include "../include/executor.hpp"
+#include "../include/profiling.hpp"
+#include <iostream>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Pin the calling thread to one core; no-op where hard affinity isn't available (macOS)
+static void pinCurrentThread(int core)
+{
+    if (core < 0)
+        return;
+
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        std::cerr << "Warning: Could not pin thread to core " << core << std::endl;
+#endif
+}
+
+PipelinedExecutor::PipelinedExecutor(const ExecutorParams &params, ResultCallback onResult)
+    : params(params),
+      onResult(std::move(onResult)),
+      detectionQueue(params.queueDepth),
+      trackQueue(params.queueDepth),
+      odometryQueue(params.queueDepth)
+{
+    threads.emplace_back(&PipelinedExecutor::detectionStage, this);
+    threads.emplace_back(&PipelinedExecutor::trackStage, this);
+    threads.emplace_back(&PipelinedExecutor::odometryStage, this);
+}
+
+PipelinedExecutor::~PipelinedExecutor()
+{
+    finish();
+}
+
+void PipelinedExecutor::submit(int index, cv::Mat frame)
+{
+    FrameResult item;
+    item.index = index;
+    item.snapshot = getPipelineSnapshot();
+    item.frame = std::move(frame);
+    detectionQueue.push(std::move(item));
+}
+
+void PipelinedExecutor::finish()
+{
+    if (finished)
+        return;
+    finished = true;
+
+    // Closing cascades: each stage closes its output queue once its input is drained
+    detectionQueue.close();
+    for (auto &thread : threads)
+        thread.join();
+}
+
+// Core to pin stage `stage` to, -1 for no pinning
+static int stageCore(const ExecutorParams &params, size_t stage)
+{
+    if (!params.pinThreads || stage >= params.stageCores.size())
+        return -1;
+    return params.stageCores[stage];
+}
+
+void PipelinedExecutor::detectionStage()
+{
+    pinCurrentThread(stageCore(params, 0));
+
+    FrameResult item;
+    ConeDetectionResult prevCones; // Steers the "cones" ROI mode
+    std::shared_ptr<const PipelineSnapshot> stages = getPipelineSnapshot();
+    ConeTracker tracker(stages->params.tracker);
+    cv::Size prevSize;
+    while (detectionQueue.pop(item))
+    {
+        PROFILE_FRAME(item.index);
+        SnapshotScope pin(item.snapshot);
+        const PipelineParams &params = item.snapshot->params;
+        if (item.snapshot->version != stages->version)
+        {
+            refreshStages(stages->params, params, &tracker, nullptr, nullptr, nullptr);
+            stages = item.snapshot;
+        }
+
+        if (item.frame.size() != prevSize)
+            tracker.reset();
+        prevSize = item.frame.size();
+        item.deviceFrame = uploadFrame(item.frame, params.acceleration);
+        item.cones = params.tracker.enabled ? detectConesTracked(tracker, item.frame, item.deviceFrame) : detectConesFromImage(item.frame, &prevCones, item.deviceFrame);
+        calibrateColours(item.frame, item.cones);
+        prevCones = item.cones;
+        trackQueue.push(std::move(item));
+    }
+    trackQueue.close();
+}
+
+void PipelinedExecutor::trackStage()
+{
+    pinCurrentThread(stageCore(params, 1));
+
+    FrameResult item;
+    std::shared_ptr<const PipelineSnapshot> stages = getPipelineSnapshot();
+    CenterlineBuilder centerline(stages->params.centerline);
+    while (trackQueue.pop(item))
+    {
+        PROFILE_FRAME(item.index);
+        SnapshotScope pin(item.snapshot);
+        if (item.snapshot->version != stages->version)
+        {
+            refreshStages(stages->params, item.snapshot->params, nullptr, &centerline, nullptr, nullptr);
+            stages = item.snapshot;
+        }
+
+        {
+            PROFILE_SCOPE("track.total");
+            item.edges = buildTrackEdges(item.cones, item.frame.cols);
+            item.centerline = centerline.update(item.cones, item.edges);
+            item.trackImage = drawTrackLines(item.frame, item.cones, item.edges, &item.centerline);
+        }
+        odometryQueue.push(std::move(item));
+    }
+    odometryQueue.close();
+}
+
+void PipelinedExecutor::odometryStage()
+{
+    pinCurrentThread(stageCore(params, 2));
+
+    // Keeps the previous frame's features; the source hands over a fresh buffer for every frame
+    std::shared_ptr<const PipelineSnapshot> stages = getPipelineSnapshot();
+    VisualOdometry odometry(stages->params.odometry);
+    Trajectory trajectory(stages->params.trajectory, stages->params.odometry.cameraIntrinsics);
+    cv::Size prevSize;
+
+    FrameResult item;
+    while (odometryQueue.pop(item))
+    {
+        PROFILE_FRAME(item.index);
+        SnapshotScope pin(item.snapshot);
+        if (item.snapshot->version != stages->version)
+        {
+            refreshStages(stages->params, item.snapshot->params, nullptr, nullptr, &odometry, &trajectory);
+            stages = item.snapshot;
+        }
+
+        if (item.frame.size() != prevSize)
+            odometry.reset();
+        item.odometry = calculateOdometry(odometry, item.frame, item.deviceFrame);
+        item.deviceFrame.release();
+        item.odometryImage = odometry.drawLastMatches();
+        item.pose = trajectory.update(item.index, item.odometry, item.cones);
+
+        prevSize = item.frame.size();
+        if (onResult)
+            onResult(item);
+    }
+}
@@ -0,0 +1,147 @@
+#include "../include/fusion.hpp"
+#include "../include/profiling.hpp"
+#include <cmath>
+
+// Rotation about the camera x, y and z axes, applied in that order
+static cv::Matx33d rollPitchYawRotation(const std::vector<double> &degrees)
+{
+    const double toRadians = CV_PI / 180.0;
+    double roll = degrees.size() > 0 ? degrees[0] * toRadians : 0.0;
+    double pitch = degrees.size() > 1 ? degrees[1] * toRadians : 0.0;
+    double yaw = degrees.size() > 2 ? degrees[2] * toRadians : 0.0;
+
+    cv::Matx33d Rx(1, 0, 0, 0, std::cos(roll), -std::sin(roll), 0, std::sin(roll), std::cos(roll));
+    cv::Matx33d Ry(std::cos(pitch), 0, std::sin(pitch), 0, 1, 0, -std::sin(pitch), 0, std::cos(pitch));
+    cv::Matx33d Rz(std::cos(yaw), -std::sin(yaw), 0, std::sin(yaw), std::cos(yaw), 0, 0, 0, 1);
+    return Rz * Ry * Rx;
+}
+
+LidarCameraProjection::LidarCameraProjection(const CameraIntrinsics &intrinsics, const FusionParams &params)
+    : intrinsics(intrinsics)
+{
+    // Camera x = -LIDAR y, camera y = -LIDAR z, camera z = LIDAR x
+    const cv::Matx33d axes(0, -1, 0, 0, 0, -1, 1, 0, 0);
+    R = rollPitchYawRotation(params.rollPitchYaw) * axes;
+    for (int i = 0; i < 3; ++i)
+        t[i] = i < static_cast<int>(params.translation.size()) ? params.translation[i] : 0.0;
+}
+
+cv::Point3d LidarCameraProjection::toCamera(const cv::Point3f &p) const
+{
+    cv::Vec3d c = R * cv::Vec3d(p.x, p.y, p.z) + t;
+    return cv::Point3d(c[0], c[1], c[2]);
+}
+
+bool LidarCameraProjection::project(const cv::Point3f &lidarPoint, cv::Point2f &pixel) const
+{
+    cv::Point3d c = toCamera(lidarPoint);
+    if (c.z <= 0.1)
+        return false;
+    pixel = cv::Point2f(static_cast<float>(intrinsics.fx * c.x / c.z + intrinsics.cx),
+                        static_cast<float>(intrinsics.fy * c.y / c.z + intrinsics.cy));
+    return true;
+}
+
+bool LidarCameraProjection::backProjectToGround(const cv::Point2f &pixel, float groundZ, cv::Point3f &lidarPoint) const
+{
+    // Camera center and ray direction in the LIDAR frame: x = R^T (c - t)
+    cv::Matx33d Rt = R.t();
+    cv::Vec3d origin = -(Rt * t);
+    cv::Vec3d ray = Rt * cv::Vec3d((pixel.x - intrinsics.cx) / intrinsics.fx, (pixel.y - intrinsics.cy) / intrinsics.fy, 1.0);
+    if (std::abs(ray[2]) < 1e-9)
+        return false;
+
+    double s = (groundZ - origin[2]) / ray[2];
+    if (s <= 0.0)
+        return false;
+
+    cv::Vec3d p = origin + s * ray;
+    lidarPoint = cv::Point3f(static_cast<float>(p[0]), static_cast<float>(p[1]), static_cast<float>(p[2]));
+    return true;
+}
+
+cv::Rect LidarCameraProjection::coneBox(const cv::Point3f &base, float width, float height) const
+{
+    // Bounding box of the eight corners of the cone's box
+    float half = width * 0.5f;
+    float minX = 0, minY = 0, maxX = 0, maxY = 0;
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        cv::Point3f p(base.x + (corner & 1 ? half : -half), base.y + (corner & 2 ? half : -half), base.z + (corner & 4 ? height : 0.0f));
+        cv::Point2f pixel;
+        if (!project(p, pixel))
+            return cv::Rect();
+
+        minX = corner ? std::min(minX, pixel.x) : pixel.x;
+        minY = corner ? std::min(minY, pixel.y) : pixel.y;
+        maxX = corner ? std::max(maxX, pixel.x) : pixel.x;
+        maxY = corner ? std::max(maxY, pixel.y) : pixel.y;
+    }
+    return cv::Rect(cv::Point(static_cast<int>(std::floor(minX)), static_cast<int>(std::floor(minY))),
+                    cv::Point(static_cast<int>(std::ceil(maxX)) + 1, static_cast<int>(std::ceil(maxY)) + 1));
+}
+
+ConeDetectionResult fuseLidarCones(const cv::Mat &img, const ConeDetectionResult &lidarCones, const LidarCameraProjection &projection,
+                                   const HsvLut &lut, const cv::Mat &carMask, const FusionParams &params)
+{
+    PROFILE_SCOPE("fusion.total");
+
+    ConeDetectionResult result;
+    if (img.empty())
+        return result;
+
+    const cv::Rect frame(cv::Point(0, 0), img.size());
+    std::vector<Cone> *outputs[3] = {&result.orangeCones, &result.blueCones, &result.yellowCones};
+    const std::vector<Cone> *inputs[3] = {&lidarCones.orangeCones, &lidarCones.blueCones, &lidarCones.yellowCones};
+    const uchar labels[3] = {LABEL_ORANGE, LABEL_BLUE, LABEL_YELLOW};
+
+    cv::Mat hsv;
+    for (int guess = 0; guess < 3; ++guess)
+    {
+        for (const auto &cone : *inputs[guess])
+        {
+            cv::Rect box = projection.coneBox(cone.position, params.coneWidth, params.coneHeight);
+            cv::Rect patch = cv::Rect(box.x - params.patchMargin, box.y - params.patchMargin,
+                                      box.width + 2 * params.patchMargin, box.height + 2 * params.patchMargin) &
+                             frame;
+            if (box.area() <= 0 || patch.area() <= 0)
+                continue;
+
+            // Only the patch is converted and classified; patches are small,
+            // so this stays on one thread unlike classifyColours
+            cv::cvtColor(img(patch), hsv, cv::COLOR_BGR2HSV);
+
+            int counts[3] = {0, 0, 0};
+            for (int y = 0; y < hsv.rows; ++y)
+            {
+                const uchar *src = hsv.ptr<uchar>(y);
+                const uchar *car = carMask.empty() ? nullptr : carMask.ptr<uchar>(patch.y + y) + patch.x;
+                for (int x = 0; x < hsv.cols; ++x, src += 3)
+                {
+                    if (car && car[x])
+                        continue;
+                    uchar label = lut.classify(src[0], src[1], src[2]);
+                    for (int colour = 0; colour < 3; ++colour)
+                        counts[colour] += (label & labels[colour]) ? 1 : 0;
+                }
+            }
+
+            int colour = static_cast<int>(std::max_element(counts, counts + 3) - counts);
+            if (counts[colour] < params.minColourPixels)
+            {
+                if (!params.keepUncoloured)
+                    continue;
+                colour = guess;
+            }
+
+            Cone fused = cone;
+            fused.boundingBox = box & frame;
+            cv::Point2f base;
+            projection.project(cone.position, base);
+            fused.center = cv::Point(cvRound(base.x), cvRound(base.y));
+            outputs[colour]->push_back(fused);
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,371 @@
+#include "../include/lidar.hpp"
+#include "../include/profiling.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+// Chunks the crop is split into; each one is filled by a single parallel_for_ stripe
+static const int cropChunks = 8;
+// Ground hypotheses are scored on at most this many candidates
+static const size_t ransacSampleSize = 2048;
+
+cv::Point2f lidarToBirdsEye(float x, float y, const LidarParams &params)
+{
+    return cv::Point2f(lidarBirdsEyeSize.width / 2.0f - y * params.birdsEyePixelsPerMetre,
+                       lidarBirdsEyeSize.height - x * params.birdsEyePixelsPerMetre);
+}
+
+uint64_t lidarGridKey(int ix, int iy, int iz)
+{
+    const int offset = 1 << 20;
+    return (static_cast<uint64_t>(ix + offset) << 42) | (static_cast<uint64_t>(iy + offset) << 21) | static_cast<uint64_t>(iz + offset);
+}
+
+static int findRoot(std::vector<int> &parent, int i)
+{
+    while (parent[i] != i)
+    {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+// Plane through three points, normal flipped to point up; false if degenerate
+static bool planeFromPoints(const cv::Point3f &a, const cv::Point3f &b, const cv::Point3f &c, GroundPlane &plane)
+{
+    cv::Point3f u = b - a, v = c - a;
+    cv::Point3f n(u.y * v.z - u.z * v.y, u.z * v.x - u.x * v.z, u.x * v.y - u.y * v.x);
+    float length = std::sqrt(n.dot(n));
+    if (length < 1e-6f)
+        return false;
+
+    n = n * ((n.z < 0 ? -1.0f : 1.0f) / length);
+    plane.normal = cv::Vec3f(n.x, n.y, n.z);
+    plane.d = -n.dot(a);
+    plane.valid = true;
+    return true;
+}
+
+// Least squares z = a*x + b*y + c over `inliers`; false if they're degenerate
+static bool fitPlaneLeastSquares(const std::vector<cv::Point3f> &inliers, GroundPlane &plane)
+{
+    // Normal equations, accumulated around the mean for conditioning
+    double mx = 0, my = 0, mz = 0;
+    for (const auto &p : inliers)
+    {
+        mx += p.x;
+        my += p.y;
+        mz += p.z;
+    }
+    double n = static_cast<double>(inliers.size());
+    mx /= n;
+    my /= n;
+    mz /= n;
+
+    double sxx = 0, sxy = 0, syy = 0, sxz = 0, syz = 0;
+    for (const auto &p : inliers)
+    {
+        double x = p.x - mx, y = p.y - my, z = p.z - mz;
+        sxx += x * x;
+        sxy += x * y;
+        syy += y * y;
+        sxz += x * z;
+        syz += y * z;
+    }
+
+    double det = sxx * syy - sxy * sxy;
+    if (inliers.size() < 3 || std::abs(det) < 1e-9)
+        return false;
+
+    double a = (sxz * syy - syz * sxy) / det;
+    double b = (syz * sxx - sxz * sxy) / det;
+    double c = mz - a * mx - b * my;
+
+    double length = std::sqrt(a * a + b * b + 1.0);
+    plane.normal = cv::Vec3f(static_cast<float>(-a / length), static_cast<float>(-b / length), static_cast<float>(1.0 / length));
+    plane.d = static_cast<float>(-c / length);
+    plane.valid = true;
+    return true;
+}
+
+LidarConeDetector::LidarConeDetector(const LidarParams &params) : params(params), chunks(cropChunks)
+{
+}
+
+void LidarConeDetector::cropPoints(const PointCloudView &cloud)
+{
+    PROFILE_SCOPE("lidar.crop");
+
+    const float minRange2 = params.minRange * params.minRange;
+    const float maxRange2 = params.maxRange * params.maxRange;
+    const size_t chunkSize = (cloud.size + cropChunks - 1) / cropChunks;
+
+    cv::parallel_for_(cv::Range(0, cropChunks), [&](const cv::Range &range)
+                      {
+        for (int chunk = range.start; chunk < range.end; ++chunk)
+        {
+            auto &out = chunks[chunk];
+            out.clear();
+
+            size_t end = std::min(cloud.size, (chunk + 1) * chunkSize);
+            for (size_t i = chunk * chunkSize; i < end; ++i)
+            {
+                float x = cloud.x[i], y = cloud.y[i];
+                float range2 = x * x + y * y;
+                // Missing returns are stored as zeros, the range crop drops them too
+                if (range2 >= minRange2 && range2 <= maxRange2)
+                    out.emplace_back(x, y, cloud.z[i]);
+            }
+        } });
+
+    points.clear();
+    for (const auto &chunk : chunks)
+        points.insert(points.end(), chunk.begin(), chunk.end());
+}
+
+bool LidarConeDetector::fitGroundPlane()
+{
+    PROFILE_SCOPE("lidar.ground");
+
+    ground = GroundPlane();
+
+    // Candidates below the sensor, thinned out to a fixed budget for scoring
+    std::vector<cv::Point3f> candidates;
+    for (const auto &p : points)
+    {
+        if (p.z < params.maxGroundZ)
+            candidates.push_back(p);
+    }
+    if (candidates.size() < 3)
+        return false;
+
+    std::vector<cv::Point3f> sample;
+    size_t step = std::max<size_t>(1, candidates.size() / ransacSampleSize);
+    for (size_t i = 0; i < candidates.size(); i += step)
+        sample.push_back(candidates[i]);
+
+    // Hypotheses drawn up front with a fixed seed, so results are repeatable
+    // while the scoring runs in parallel
+    int iterations = std::max(1, params.ransacIterations);
+    std::vector<GroundPlane> hypotheses(iterations);
+    std::vector<int> scores(iterations, -1);
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<size_t> pick(0, candidates.size() - 1);
+    for (auto &hypothesis : hypotheses)
+        planeFromPoints(candidates[pick(rng)], candidates[pick(rng)], candidates[pick(rng)], hypothesis);
+
+    const float minNormalZ = std::cos(params.maxGroundTilt * static_cast<float>(CV_PI) / 180.0f);
+    cv::parallel_for_(cv::Range(0, iterations), [&](const cv::Range &range)
+                      {
+        for (int h = range.start; h < range.end; ++h)
+        {
+            const GroundPlane &plane = hypotheses[h];
+            if (!plane.valid || plane.normal[2] < minNormalZ)
+                continue;
+
+            int inliers = 0;
+            for (const auto &p : sample)
+                inliers += std::abs(plane.height(p)) <= params.groundThreshold;
+            scores[h] = inliers;
+        } });
+
+    int best = static_cast<int>(std::max_element(scores.begin(), scores.end()) - scores.begin());
+    if (scores[best] < 3)
+        return false;
+
+    // Refine on all candidates close to the best hypothesis
+    ground = hypotheses[best];
+    std::vector<cv::Point3f> inliers;
+    for (const auto &p : candidates)
+    {
+        if (std::abs(ground.height(p)) <= params.groundThreshold)
+            inliers.push_back(p);
+    }
+    fitPlaneLeastSquares(inliers, ground);
+    return true;
+}
+
+void LidarConeDetector::removeGround()
+{
+    PROFILE_SCOPE("lidar.remove_ground");
+
+    heights.resize(points.size());
+    cv::parallel_for_(cv::Range(0, static_cast<int>(points.size())), [&](const cv::Range &range)
+                      {
+        for (int i = range.start; i < range.end; ++i)
+            heights[i] = ground.height(points[i]); });
+
+    // Keep the band cones can occupy; walls and overhangs are cut down with it
+    obstacles.clear();
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        if (heights[i] > params.groundThreshold && heights[i] <= params.maxConeHeight)
+            obstacles.push_back(points[i]);
+    }
+}
+
+void LidarConeDetector::downsample()
+{
+    PROFILE_SCOPE("lidar.voxel");
+
+    const float inv = 1.0f / params.voxelSize;
+    keys.resize(obstacles.size());
+    for (size_t i = 0; i < obstacles.size(); ++i)
+    {
+        const auto &p = obstacles[i];
+        keys[i] = {lidarGridKey(static_cast<int>(std::floor(p.x * inv)), static_cast<int>(std::floor(p.y * inv)), static_cast<int>(std::floor(p.z * inv))), static_cast<int>(i)};
+    }
+    std::sort(keys.begin(), keys.end());
+
+    // One centroid per occupied voxel
+    voxels.clear();
+    for (size_t begin = 0; begin < keys.size();)
+    {
+        size_t end = begin;
+        cv::Point3f sum(0, 0, 0);
+        while (end < keys.size() && keys[end].first == keys[begin].first)
+            sum = sum + obstacles[keys[end++].second];
+        voxels.push_back(sum * (1.0 / (end - begin)));
+        begin = end;
+    }
+}
+
+void LidarConeDetector::cluster()
+{
+    PROFILE_SCOPE("lidar.cluster");
+
+    // xy grid with tolerance-sized cells: neighbours are always in the 3x3 block
+    const float tolerance2 = params.clusterTolerance * params.clusterTolerance;
+    const float inv = 1.0f / params.clusterTolerance;
+    auto cellOf = [&](const cv::Point3f &p)
+    {
+        return cv::Point(static_cast<int>(std::floor(p.x * inv)), static_cast<int>(std::floor(p.y * inv)));
+    };
+
+    keys.resize(voxels.size());
+    for (size_t i = 0; i < voxels.size(); ++i)
+    {
+        cv::Point cell = cellOf(voxels[i]);
+        keys[i] = {lidarGridKey(cell.x, cell.y, 0), static_cast<int>(i)};
+    }
+    std::sort(keys.begin(), keys.end());
+
+    parent.resize(voxels.size());
+    for (size_t i = 0; i < parent.size(); ++i)
+        parent[i] = static_cast<int>(i);
+
+    for (size_t i = 0; i < voxels.size(); ++i)
+    {
+        const cv::Point3f &p = voxels[i];
+        cv::Point cell = cellOf(p);
+
+        for (int dy = -1; dy <= 1; ++dy)
+        {
+            for (int dx = -1; dx <= 1; ++dx)
+            {
+                uint64_t key = lidarGridKey(cell.x + dx, cell.y + dy, 0);
+                auto it = std::lower_bound(keys.begin(), keys.end(), std::make_pair(key, 0));
+                for (; it != keys.end() && it->first == key; ++it)
+                {
+                    int j = it->second;
+                    if (j <= static_cast<int>(i))
+                        continue;
+
+                    float ex = voxels[j].x - p.x, ey = voxels[j].y - p.y;
+                    if (ex * ex + ey * ey > tolerance2)
+                        continue;
+
+                    int a = findRoot(parent, static_cast<int>(i)), b = findRoot(parent, j);
+                    if (a != b)
+                        parent[std::max(a, b)] = std::min(a, b);
+                }
+            }
+        }
+    }
+
+    clusters.clear();
+    std::vector<int> clusterOfRoot(voxels.size(), -1);
+    for (size_t i = 0; i < voxels.size(); ++i)
+    {
+        int root = findRoot(parent, static_cast<int>(i));
+        if (clusterOfRoot[root] < 0)
+        {
+            clusterOfRoot[root] = static_cast<int>(clusters.size());
+            clusters.emplace_back();
+        }
+        clusters[clusterOfRoot[root]].push_back(static_cast<int>(i));
+    }
+}
+
+ConeDetectionResult LidarConeDetector::classifyClusters() const
+{
+    ConeDetectionResult result;
+
+    for (const auto &members : clusters)
+    {
+        int count = static_cast<int>(members.size());
+        if (count < params.minClusterPoints || count > params.maxClusterPoints)
+            continue;
+
+        cv::Point3f sum(0, 0, 0);
+        float minX = 1e9f, maxX = -1e9f, minY = 1e9f, maxY = -1e9f, top = 0.0f;
+        for (int i : members)
+        {
+            const cv::Point3f &p = voxels[i];
+            sum = sum + p;
+            minX = std::min(minX, p.x);
+            maxX = std::max(maxX, p.x);
+            minY = std::min(minY, p.y);
+            maxY = std::max(maxY, p.y);
+            top = std::max(top, ground.height(p));
+        }
+
+        if (top < params.minConeHeight || std::max(maxX - minX, maxY - minY) > params.maxConeWidth)
+            continue;
+
+        // Base of the cone: centroid dropped onto the ground plane
+        cv::Point3f centroid = sum * (1.0 / count);
+        float drop = ground.height(centroid);
+        Cone cone;
+        cone.position = cv::Point3f(centroid.x - ground.normal[0] * drop,
+                                    centroid.y - ground.normal[1] * drop,
+                                    centroid.z - ground.normal[2] * drop);
+
+        cv::Point2f center = lidarToBirdsEye(cone.position.x, cone.position.y, params);
+        cv::Point2f corner = lidarToBirdsEye(maxX, maxY, params);
+        cv::Point2f opposite = lidarToBirdsEye(minX, minY, params);
+        cone.center = cv::Point(cvRound(center.x), cvRound(center.y));
+        cone.boundingBox = cv::Rect(cvRound(corner.x), cvRound(corner.y),
+                                    std::max(1, cvRound(opposite.x - corner.x)), std::max(1, cvRound(opposite.y - corner.y)));
+
+        if (top > params.largeConeHeight)
+            result.orangeCones.push_back(cone);
+        else if (cone.position.y > 0)
+            result.blueCones.push_back(cone);
+        else
+            result.yellowCones.push_back(cone);
+    }
+
+    return result;
+}
+
+ConeDetectionResult LidarConeDetector::detect(const PointCloudView &cloud)
+{
+    PROFILE_SCOPE("lidar.total");
+
+    cropPoints(cloud);
+    if (!fitGroundPlane())
+    {
+        std::cerr << "Warning: No ground plane found in LIDAR scan" << std::endl;
+        voxels.clear();
+        clusters.clear();
+        return ConeDetectionResult();
+    }
+
+    removeGround();
+    downsample();
+    cluster();
+    return classifyClusters();
+}
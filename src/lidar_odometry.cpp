@@ -0,0 +1,339 @@
+#include "../include/lidar_odometry.hpp"
+#include "../include/lidar.hpp"
+#include "../include/profiling.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+void VoxelHashIndex::build(const std::vector<cv::Point3f> &points, float searchRadius)
+{
+    radius = searchRadius;
+    inv = 1.0f / (2.0f * searchRadius);
+
+    keys.resize(points.size());
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        const auto &p = points[i];
+        keys[i] = {lidarGridKey(static_cast<int>(std::floor(p.x * inv)), static_cast<int>(std::floor(p.y * inv)), static_cast<int>(std::floor(p.z * inv))), static_cast<int>(i)};
+    }
+    std::sort(keys.begin(), keys.end());
+
+    sorted.resize(points.size());
+    cells.clear();
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        sorted[i] = points[keys[i].second];
+        auto it = cells.find(keys[i].first);
+        if (it == cells.end())
+            cells.emplace(keys[i].first, std::make_pair(static_cast<int>(i), static_cast<int>(i) + 1));
+        else
+            it->second.second = static_cast<int>(i) + 1;
+    }
+}
+
+void VoxelHashIndex::clear()
+{
+    sorted.clear();
+    keys.clear();
+    cells.clear();
+}
+
+int VoxelHashIndex::nearest(const cv::Point3f &p, float maxDistance) const
+{
+    // The neighbour cell on each axis is the one on the side of the point
+    float g[3] = {p.x * inv, p.y * inv, p.z * inv};
+    int base[3], other[3];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        base[axis] = static_cast<int>(std::floor(g[axis]));
+        other[axis] = g[axis] - base[axis] < 0.5f ? base[axis] - 1 : base[axis] + 1;
+    }
+
+    int best = -1;
+    float limit = std::min(maxDistance, radius);
+    float bestDistance = limit * limit;
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        uint64_t key = lidarGridKey(corner & 1 ? other[0] : base[0], corner & 2 ? other[1] : base[1], corner & 4 ? other[2] : base[2]);
+        auto it = cells.find(key);
+        if (it == cells.end())
+            continue;
+
+        for (int i = it->second.first; i < it->second.second; ++i)
+        {
+            float dx = sorted[i].x - p.x, dy = sorted[i].y - p.y, dz = sorted[i].z - p.z;
+            float distance = dx * dx + dy * dy + dz * dz;
+            if (distance < bestDistance)
+            {
+                bestDistance = distance;
+                best = i;
+            }
+        }
+    }
+    return best;
+}
+
+void VoxelHashIndex::radiusSearch(const cv::Point3f &p, float maxDistance, std::vector<int> &indices) const
+{
+    indices.clear();
+
+    float g[3] = {p.x * inv, p.y * inv, p.z * inv};
+    int base[3], other[3];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        base[axis] = static_cast<int>(std::floor(g[axis]));
+        other[axis] = g[axis] - base[axis] < 0.5f ? base[axis] - 1 : base[axis] + 1;
+    }
+
+    float limit = std::min(maxDistance, radius);
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        uint64_t key = lidarGridKey(corner & 1 ? other[0] : base[0], corner & 2 ? other[1] : base[1], corner & 4 ? other[2] : base[2]);
+        auto it = cells.find(key);
+        if (it == cells.end())
+            continue;
+
+        for (int i = it->second.first; i < it->second.second; ++i)
+        {
+            float dx = sorted[i].x - p.x, dy = sorted[i].y - p.y, dz = sorted[i].z - p.z;
+            if (dx * dx + dy * dy + dz * dz <= limit * limit)
+                indices.push_back(i);
+        }
+    }
+}
+
+LidarOdometry::LidarOdometry(const LidarOdometryParams &params) : params(params)
+{
+}
+
+void LidarOdometry::reset()
+{
+    target.clear();
+    targetNormals.clear();
+    lastAlignment = Pose();
+    haveGuess = false;
+    iterations.clear();
+}
+
+void LidarOdometry::setInitialGuess(const cv::Matx33d &R, const cv::Vec3d &t)
+{
+    // Stored as the alignment, i.e. the inverse of the motion
+    guess.R = R.t();
+    guess.t = -(guess.R * t);
+    haveGuess = true;
+}
+
+void LidarOdometry::downsample(const PointCloudView &cloud)
+{
+    PROFILE_SCOPE("lidar_odometry.downsample");
+
+    // Missing returns are stored as zeros
+    filtered.clear();
+    for (size_t i = 0; i < cloud.size; ++i)
+    {
+        cv::Point3f p(cloud.x[i], cloud.y[i], cloud.z[i]);
+        if (p.x != 0.0f || p.y != 0.0f || p.z != 0.0f)
+            filtered.push_back(p);
+    }
+
+    const float inv = 1.0f / params.voxelSize;
+    voxelKeys.resize(filtered.size());
+    for (size_t i = 0; i < filtered.size(); ++i)
+    {
+        const auto &p = filtered[i];
+        voxelKeys[i] = {lidarGridKey(static_cast<int>(std::floor(p.x * inv)), static_cast<int>(std::floor(p.y * inv)), static_cast<int>(std::floor(p.z * inv))), static_cast<int>(i)};
+    }
+    std::sort(voxelKeys.begin(), voxelKeys.end());
+
+    scan.clear();
+    for (size_t begin = 0; begin < voxelKeys.size();)
+    {
+        size_t end = begin;
+        cv::Point3f sum(0, 0, 0);
+        while (end < voxelKeys.size() && voxelKeys[end].first == voxelKeys[begin].first)
+            sum = sum + filtered[voxelKeys[end++].second];
+        scan.push_back(sum * (1.0 / (end - begin)));
+        begin = end;
+    }
+}
+
+void LidarOdometry::estimateNormals(const VoxelHashIndex &index, std::vector<cv::Vec3f> &normals) const
+{
+    PROFILE_SCOPE("lidar_odometry.normals");
+
+    const std::vector<cv::Point3f> &points = index.points();
+    normals.assign(points.size(), cv::Vec3f(0, 0, 0));
+
+    cv::parallel_for_(cv::Range(0, static_cast<int>(points.size())), [&](const cv::Range &range)
+                      {
+        std::vector<int> neighbours;
+        for (int i = range.start; i < range.end; ++i)
+        {
+            index.radiusSearch(points[i], params.normalRadius, neighbours);
+            if (neighbours.size() < 5)
+                continue;
+
+            // Normal = direction of least spread of the neighbourhood
+            cv::Vec3d mean(0, 0, 0);
+            for (int j : neighbours)
+                mean += cv::Vec3d(points[j].x, points[j].y, points[j].z);
+            mean *= 1.0 / neighbours.size();
+
+            cv::Matx33d covariance = cv::Matx33d::zeros();
+            for (int j : neighbours)
+            {
+                cv::Vec3d d = cv::Vec3d(points[j].x, points[j].y, points[j].z) - mean;
+                for (int a = 0; a < 3; ++a)
+                    for (int b = 0; b < 3; ++b)
+                        covariance(a, b) += d[a] * d[b];
+            }
+
+            cv::Vec3d eigenvalues;
+            cv::Matx33d eigenvectors;
+            if (cv::eigen(covariance, eigenvalues, eigenvectors))
+                normals[i] = cv::Vec3f(eigenvectors(2, 0), eigenvectors(2, 1), eigenvectors(2, 2));
+        } });
+}
+
+bool LidarOdometry::align(Pose &alignment)
+{
+    iterations.clear();
+    matches.resize(scan.size());
+    const std::vector<cv::Point3f> &targetPoints = target.points();
+    float distance = params.maxCorrespondenceDistance;
+    bool converged = false;
+
+    for (int iteration = 0; iteration < params.maxIterations; ++iteration)
+    {
+        PROFILE_SCOPE("lidar_odometry.iteration");
+        auto start = std::chrono::steady_clock::now();
+
+        // Correspondences in parallel, the reduction below is cheap
+        const cv::Matx33d R = alignment.R;
+        const cv::Vec3d t = alignment.t;
+        cv::parallel_for_(cv::Range(0, static_cast<int>(scan.size())), [&](const cv::Range &range)
+                          {
+            for (int i = range.start; i < range.end; ++i)
+            {
+                cv::Vec3d p = R * cv::Vec3d(scan[i].x, scan[i].y, scan[i].z) + t;
+                matches[i] = target.nearest(cv::Point3f(static_cast<float>(p[0]), static_cast<float>(p[1]), static_cast<float>(p[2])), distance);
+            } });
+
+        // Gauss-Newton step, point-to-plane, with the left-multiplied update
+        // p' = exp(w) * p + dt: the residual n.(p' - q) has Jacobian [p x n | n]
+        cv::Matx66d H = cv::Matx66d::zeros();
+        cv::Vec6d g = cv::Vec6d::all(0);
+        double squaredError = 0.0;
+        int correspondences = 0;
+
+        for (size_t i = 0; i < scan.size(); ++i)
+        {
+            if (matches[i] < 0)
+                continue;
+
+            const cv::Vec3f &n = targetNormals[matches[i]];
+            if (n[0] == 0.0f && n[1] == 0.0f && n[2] == 0.0f)
+                continue;
+
+            cv::Vec3d p = R * cv::Vec3d(scan[i].x, scan[i].y, scan[i].z) + t;
+            const cv::Point3f &q = targetPoints[matches[i]];
+            double r = n[0] * (p[0] - q.x) + n[1] * (p[1] - q.y) + n[2] * (p[2] - q.z);
+
+            double J[6] = {p[1] * n[2] - p[2] * n[1], p[2] * n[0] - p[0] * n[2], p[0] * n[1] - p[1] * n[0], n[0], n[1], n[2]};
+            for (int a = 0; a < 6; ++a)
+            {
+                for (int b = 0; b < 6; ++b)
+                    H(a, b) += J[a] * J[b];
+                g[a] += J[a] * r;
+            }
+            squaredError += r * r;
+            ++correspondences;
+        }
+
+        IcpIteration stats;
+        stats.correspondences = correspondences;
+        stats.rmse = correspondences ? std::sqrt(squaredError / correspondences) : 0.0;
+        stats.correspondenceDistance = distance;
+
+        if (correspondences < params.minCorrespondences)
+        {
+            iterations.push_back(stats);
+            return false;
+        }
+
+        // H is singular when the scans don't constrain every direction (only
+        // ground, a corridor); a failed solve is not a zero step
+        cv::Vec6d step;
+        if (!cv::solve(H, -g, step, cv::DECOMP_CHOLESKY))
+        {
+            iterations.push_back(stats);
+            return false;
+        }
+        cv::Matx33d dR;
+        cv::Rodrigues(cv::Vec3d(step[0], step[1], step[2]), dR);
+        alignment.R = dR * alignment.R;
+        alignment.t = dR * alignment.t + cv::Vec3d(step[3], step[4], step[5]);
+
+        stats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        iterations.push_back(stats);
+
+        if (cv::norm(step) < params.convergenceThreshold)
+        {
+            if (distance <= params.minCorrespondenceDistance)
+            {
+                converged = true;
+                break;
+            }
+            distance = std::max(params.minCorrespondenceDistance, distance * 0.5f);
+        }
+    }
+
+    // Running out of iterations before settling at the finest radius leaves
+    // an unconverged pose
+    return converged;
+}
+
+OdometryResult LidarOdometry::process(const PointCloudView &cloud)
+{
+    PROFILE_SCOPE("lidar_odometry.total");
+
+    OdometryResult result;
+    downsample(cloud);
+
+    if (!target.empty() && !scan.empty())
+    {
+        // Constant velocity: the last alignment is the best guess for this one
+        Pose alignment;
+        if (haveGuess)
+            alignment = guess;
+        else if (params.initialGuess == "constant_velocity")
+            alignment = lastAlignment;
+
+        if (align(alignment))
+        {
+            // The alignment maps current points into the previous frame, the
+            // result maps previous points into the current one
+            cv::Matx33d R = alignment.R.t();
+            cv::Vec3d t = -(R * alignment.t);
+            result.valid = true;
+            result.R = cv::Mat(R);
+            result.t = cv::Mat(t);
+            result.inliers = iterations.empty() ? 0 : iterations.back().correspondences;
+            lastAlignment = alignment;
+        }
+        else
+            lastAlignment = Pose();
+    }
+    haveGuess = false;
+
+    // The current scan becomes the target of the next one
+    {
+        PROFILE_SCOPE("lidar_odometry.index");
+        current.build(scan, std::max(params.maxCorrespondenceDistance, params.normalRadius));
+        estimateNormals(current, currentNormals);
+        std::swap(target, current);
+        std::swap(targetNormals, currentNormals);
+    }
+
+    return result;
+}
@@ -0,0 +1,151 @@
+#include "../include/matching.hpp"
+#include <opencv2/core/hal/hal.hpp>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+MatcherBackend parseMatcherBackend(const std::string &name)
+{
+    if (name == "flann_lsh")
+        return MATCHER_FLANN_LSH;
+    if (name == "grid")
+        return MATCHER_GRID;
+    return MATCHER_BRUTE_FORCE;
+}
+
+MatchFilter parseMatchFilter(const std::string &name)
+{
+    if (name == "ratio")
+        return MATCH_FILTER_RATIO;
+    if (name == "cross_check")
+        return MATCH_FILTER_CROSS_CHECK;
+    return MATCH_FILTER_DISTANCE;
+}
+
+void keepRatioMatches(const std::vector<std::vector<cv::DMatch>> &knnMatches, float ratio, std::vector<cv::DMatch> &matches)
+{
+    matches.clear();
+    for (const auto &candidates : knnMatches)
+    {
+        if (candidates.empty())
+            continue;
+        if (candidates.size() == 1 || candidates[0].distance < ratio * candidates[1].distance)
+            matches.push_back(candidates[0]);
+    }
+}
+
+void keepMutualMatches(std::vector<cv::DMatch> &matches, const std::vector<cv::DMatch> &backward)
+{
+    // Nearest query for every train index
+    int trainCount = 0;
+    for (const auto &match : matches)
+        trainCount = std::max(trainCount, match.trainIdx + 1);
+    std::vector<int> reverse(trainCount, -1);
+    for (const auto &match : backward)
+    {
+        if (match.queryIdx < trainCount)
+            reverse[match.queryIdx] = match.trainIdx;
+    }
+
+    matches.erase(std::remove_if(matches.begin(), matches.end(), [&](const cv::DMatch &match)
+                                 { return reverse[match.trainIdx] != match.queryIdx; }),
+                  matches.end());
+}
+
+void matchInGrid(const std::vector<cv::KeyPoint> &queryKeypoints, const cv::Mat &queryDescriptors,
+                 const std::vector<cv::KeyPoint> &trainKeypoints, const cv::Mat &trainDescriptors,
+                 const cv::Matx33d &prediction, float cellSize, float searchRadius,
+                 std::vector<cv::DMatch> &matches, float ratio)
+{
+    matches.clear();
+    if (queryKeypoints.empty() || trainKeypoints.empty() || cellSize <= 0)
+        return;
+
+    // Grid over the bounding box of the train keypoints
+    float minX = trainKeypoints[0].pt.x, maxX = minX;
+    float minY = trainKeypoints[0].pt.y, maxY = minY;
+    for (const auto &kp : trainKeypoints)
+    {
+        minX = std::min(minX, kp.pt.x);
+        maxX = std::max(maxX, kp.pt.x);
+        minY = std::min(minY, kp.pt.y);
+        maxY = std::max(maxY, kp.pt.y);
+    }
+
+    int gridCols = static_cast<int>((maxX - minX) / cellSize) + 1;
+    int gridRows = static_cast<int>((maxY - minY) / cellSize) + 1;
+
+    auto cellOf = [&](const cv::Point2f &pt)
+    {
+        int cx = static_cast<int>((pt.x - minX) / cellSize);
+        int cy = static_cast<int>((pt.y - minY) / cellSize);
+        return cy * gridCols + cx;
+    };
+
+    // Counting sort of the train keypoints by cell: cellStart[c]..cellStart[c + 1]
+    // indexes into cellItems, no per-cell containers
+    std::vector<int> cellStart(gridCols * gridRows + 1, 0);
+    for (const auto &kp : trainKeypoints)
+        ++cellStart[cellOf(kp.pt) + 1];
+    for (size_t c = 1; c < cellStart.size(); ++c)
+        cellStart[c] += cellStart[c - 1];
+
+    std::vector<int> cellItems(trainKeypoints.size());
+    std::vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+    for (size_t j = 0; j < trainKeypoints.size(); ++j)
+        cellItems[fill[cellOf(trainKeypoints[j].pt)]++] = static_cast<int>(j);
+
+    const float radiusSq = searchRadius * searchRadius;
+    const int descriptorBytes = queryDescriptors.cols;
+
+    for (size_t i = 0; i < queryKeypoints.size(); ++i)
+    {
+        // Predicted position in the train image
+        const cv::Point2f &p = queryKeypoints[i].pt;
+        cv::Vec3d q = prediction * cv::Vec3d(p.x, p.y, 1.0);
+        if (std::abs(q[2]) < 1e-9)
+            continue;
+        cv::Point2f predicted(static_cast<float>(q[0] / q[2]), static_cast<float>(q[1] / q[2]));
+
+        int x0 = std::max(0, static_cast<int>(std::floor((predicted.x - searchRadius - minX) / cellSize)));
+        int x1 = std::min(gridCols - 1, static_cast<int>(std::floor((predicted.x + searchRadius - minX) / cellSize)));
+        int y0 = std::max(0, static_cast<int>(std::floor((predicted.y - searchRadius - minY) / cellSize)));
+        int y1 = std::min(gridRows - 1, static_cast<int>(std::floor((predicted.y + searchRadius - minY) / cellSize)));
+
+        const uchar *queryDescriptor = queryDescriptors.ptr<uchar>(static_cast<int>(i));
+        int bestDistance = INT_MAX;
+        int secondDistance = INT_MAX;
+        int bestIndex = -1;
+
+        for (int cy = y0; cy <= y1; ++cy)
+        {
+            for (int cx = x0; cx <= x1; ++cx)
+            {
+                int cell = cy * gridCols + cx;
+                for (int k = cellStart[cell]; k < cellStart[cell + 1]; ++k)
+                {
+                    int j = cellItems[k];
+                    cv::Point2f d = trainKeypoints[j].pt - predicted;
+                    if (d.x * d.x + d.y * d.y > radiusSq)
+                        continue;
+
+                    int distance = cv::hal::normHamming(queryDescriptor, trainDescriptors.ptr<uchar>(j), descriptorBytes);
+                    if (distance < bestDistance)
+                    {
+                        secondDistance = bestDistance;
+                        bestDistance = distance;
+                        bestIndex = j;
+                    }
+                    else if (distance < secondDistance)
+                        secondDistance = distance;
+                }
+            }
+        }
+
+        if (bestIndex < 0)
+            continue;
+        if (ratio > 0 && secondDistance != INT_MAX && bestDistance >= ratio * secondDistance)
+            continue;
+        matches.emplace_back(static_cast<int>(i), bestIndex, static_cast<float>(bestDistance));
+    }
+}
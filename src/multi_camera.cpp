@@ -0,0 +1,151 @@
+#include "../include/multi_camera.hpp"
+#include "../include/lidar.hpp"
+#include "../include/pipeline.hpp"
+#include "../include/profiling.hpp"
+#include <cmath>
+#include <iostream>
+
+MultiCameraPipeline::Camera::Camera(const PipelineParams &params)
+    : params(params), lut(buildHsvLut(params.roadMask)), projection(params.odometry.cameraIntrinsics, params.fusion)
+{
+}
+
+MultiCameraPipeline::MultiCameraPipeline(const std::vector<PipelineParams> &cameraParams, const MultiCameraParams &params, const LidarParams &lidar)
+    : params(params), lidar(lidar)
+{
+    for (const auto &camera : cameraParams)
+        cameras.push_back(std::make_unique<Camera>(camera));
+}
+
+ConeDetectionResult MultiCameraPipeline::process(const std::vector<cv::Mat> &frames)
+{
+    PROFILE_SCOPE("multi_camera.total");
+
+    if (frames.size() != cameras.size())
+    {
+        std::cerr << "Error: Expected " << cameras.size() << " frames, got " << frames.size() << std::endl;
+        return ConeDetectionResult();
+    }
+
+    // One task per camera on the shared pool; OpenCV runs nested parallel
+    // loops inline, so the per-colour work of a camera stays in its task
+    const int frame = Profiler::currentFrame();
+    cv::parallel_for_(cv::Range(0, static_cast<int>(cameras.size())), [&](const cv::Range &range)
+                      {
+        PROFILE_FRAME(frame);
+        for (int i = range.start; i < range.end; ++i)
+        {
+            Camera &camera = *cameras[i];
+            const cv::Mat &img = frames[i];
+            if (img.empty())
+            {
+                camera.detections = ConeDetectionResult();
+                camera.placed = ConeDetectionResult();
+                continue;
+            }
+
+            if (camera.carMaskSize != img.size())
+            {
+                camera.carMasks = getCarMasks(img.size(), camera.params.carMask);
+                camera.carMaskSize = img.size();
+            }
+
+            // The last batch's cones drive the "cones" ROI mode
+            ConeDetectionResult previous = std::move(camera.detections);
+            camera.detections = detectConesFromImage(img, camera.params, camera.lut, camera.carMasks, camera.workspace, &previous);
+            placeOnGround(camera);
+        } }, static_cast<double>(cameras.size()));
+
+    PROFILE_SCOPE("multi_camera.merge");
+    return merge();
+}
+
+// Cone base = bottom center of its box, a point on the ground
+void MultiCameraPipeline::placeOnGround(Camera &camera) const
+{
+    camera.placed = ConeDetectionResult();
+    const std::vector<Cone> *inputs[3] = {&camera.detections.orangeCones, &camera.detections.blueCones, &camera.detections.yellowCones};
+    std::vector<Cone> *outputs[3] = {&camera.placed.orangeCones, &camera.placed.blueCones, &camera.placed.yellowCones};
+
+    for (int colour = 0; colour < 3; ++colour)
+    {
+        for (const auto &cone : *inputs[colour])
+        {
+            cv::Point2f base(cone.boundingBox.x + cone.boundingBox.width * 0.5f, static_cast<float>(cone.boundingBox.y + cone.boundingBox.height));
+            cv::Point3f position;
+            if (!camera.projection.backProjectToGround(base, params.groundZ, position))
+                continue;
+            if (std::hypot(position.x, position.y) > params.maxRange)
+                continue;
+
+            Cone placed = cone;
+            placed.position = position;
+            outputs[colour]->push_back(placed);
+        }
+    }
+}
+
+ConeDetectionResult MultiCameraPipeline::merge() const
+{
+    ConeDetectionResult result;
+    std::vector<Cone> *outputs[3] = {&result.orangeCones, &result.blueCones, &result.yellowCones};
+
+    struct MergedCone
+    {
+        cv::Point3f sum;
+        int count = 0;
+        size_t lastCamera = 0; // Cones of one camera are never merged with each other
+        cv::Point3f mean() const { return sum * (1.0f / count); }
+    };
+
+    for (int colour = 0; colour < 3; ++colour)
+    {
+        std::vector<MergedCone> merged;
+        for (size_t c = 0; c < cameras.size(); ++c)
+        {
+            const ConeDetectionResult &placed = cameras[c]->placed;
+            const std::vector<Cone> *inputs[3] = {&placed.orangeCones, &placed.blueCones, &placed.yellowCones};
+            for (const auto &cone : *inputs[colour])
+            {
+                int best = -1;
+                float bestDistance = params.mergeDistance;
+                for (size_t m = 0; m < merged.size(); ++m)
+                {
+                    if (merged[m].lastCamera == c)
+                        continue;
+                    cv::Point3f mean = merged[m].mean();
+                    float distance = std::hypot(mean.x - cone.position.x, mean.y - cone.position.y);
+                    if (distance < bestDistance)
+                    {
+                        best = static_cast<int>(m);
+                        bestDistance = distance;
+                    }
+                }
+
+                if (best < 0)
+                {
+                    merged.emplace_back();
+                    best = static_cast<int>(merged.size()) - 1;
+                }
+                merged[best].sum = merged[best].sum + cone.position;
+                merged[best].count++;
+                merged[best].lastCamera = c;
+            }
+        }
+
+        // Same canvas as the LIDAR cones: one cone width around the base
+        const float coneWidth = cameras.empty() ? 0.23f : cameras.front()->params.fusion.coneWidth;
+        const int half = std::max(1, cvRound(0.5f * coneWidth * lidar.birdsEyePixelsPerMetre));
+        for (const auto &m : merged)
+        {
+            Cone cone;
+            cone.position = m.mean();
+            cv::Point2f center = lidarToBirdsEye(cone.position.x, cone.position.y, lidar);
+            cone.center = cv::Point(cvRound(center.x), cvRound(center.y));
+            cone.boundingBox = cv::Rect(cone.center.x - half, cone.center.y - half, 2 * half, 2 * half);
+            outputs[colour]->push_back(cone);
+        }
+    }
+
+    return result;
+}
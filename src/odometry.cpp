@@ -1,67 +1,276 @@
+#include "../include/odometry.hpp"
 #include "../include/detection.hpp"
 #include "../include/params.hpp"
+#include "../include/profiling.hpp"
+#include "../include/debug_sink.hpp"
+#include <algorithm>
 
-cv::Mat calcOdometry(const cv::Mat &prevFrame, const cv::Mat &currFrame, cv::Mat negMask, const OdometryParams &params)
+VisualOdometry::VisualOdometry(const OdometryParams &params)
+    : params(params),
+      orb(cv::ORB::create(params.orbFeatures)),
+      backend(parseMatcherBackend(params.matcher)),
+      filter(parseMatchFilter(params.matchFilter)),
+      intrinsics(params.cameraIntrinsics.toMat())
 {
-    // Detect ORB keypoints and descriptors
-    cv::Ptr<cv::ORB> orb = cv::ORB::create();
-    std::vector<cv::KeyPoint> keypointsPrev, keypointsCurr;
-    cv::Mat descriptorsPrev, descriptorsCurr;
+    // LSH with 12 tables, 20-bit keys and multi-probe level 2, the usual settings for ORB
+    if (backend == MATCHER_FLANN_LSH)
+        matcher = cv::makePtr<cv::FlannBasedMatcher>(cv::makePtr<cv::flann::LshIndexParams>(12, 20, 2));
+    else
+        matcher = cv::makePtr<cv::BFMatcher>(cv::NORM_HAMMING);
+}
 
-    orb->detectAndCompute(prevFrame, ~negMask, keypointsPrev, descriptorsPrev);
-    orb->detectAndCompute(currFrame, ~negMask, keypointsCurr, descriptorsCurr);
+void VisualOdometry::reset()
+{
+    prev = FrameFeatures();
+    curr = FrameFeatures();
+    last = OdometryResult();
+    lastRotation = cv::Matx33d::eye();
+    lastTranslation = cv::Vec3d();
+    hasPrior = false;
+}
 
-    // Brute force matcher with Hamming distance
-    cv::BFMatcher matcher(cv::NORM_HAMMING);
-    std::vector<cv::DMatch> matches;
-    matcher.match(descriptorsPrev, descriptorsCurr, matches);
+// Grid matches with the ratio test or the cross check done in the grid too;
+// the reverse search uses the inverse prediction
+void VisualOdometry::matchGrid(const cv::Matx33d &prediction, std::vector<cv::DMatch> &matches) const
+{
+    float ratio = filter == MATCH_FILTER_RATIO ? params.ratioThreshold : 0.0f;
+    matchInGrid(prev.keypoints, prev.descriptors, curr.keypoints, curr.descriptors,
+                prediction, params.gridCellSize, params.gridSearchRadius, matches, ratio);
+
+    if (filter == MATCH_FILTER_CROSS_CHECK)
+    {
+        std::vector<cv::DMatch> backward;
+        matchInGrid(curr.keypoints, curr.descriptors, prev.keypoints, prev.descriptors,
+                    prediction.inv(), params.gridCellSize, params.gridSearchRadius, backward);
+        keepMutualMatches(matches, backward);
+    }
+}
 
-    // Filter good matches based on distance
+// Brute force or FLANN-LSH over all descriptors, with the configured filter
+void VisualOdometry::matchExhaustive(std::vector<cv::DMatch> &matches)
+{
+    if (!matcher)
+        matcher = cv::makePtr<cv::BFMatcher>(cv::NORM_HAMMING);
+
+    if (filter == MATCH_FILTER_RATIO)
+    {
+        std::vector<std::vector<cv::DMatch>> knnMatches;
+        matcher->knnMatch(prev.descriptors, curr.descriptors, knnMatches, 2);
+        keepRatioMatches(knnMatches, params.ratioThreshold, matches);
+        return;
+    }
+
+    matcher->match(prev.descriptors, curr.descriptors, matches);
+    if (filter == MATCH_FILTER_CROSS_CHECK)
+    {
+        std::vector<cv::DMatch> backward;
+        matcher->match(curr.descriptors, prev.descriptors, backward);
+        keepMutualMatches(matches, backward);
+    }
+}
+
+void VisualOdometry::matchFeatures(std::vector<cv::DMatch> &matches)
+{
+    PROFILE_SCOPE("odometry.match");
+
+    if (backend == MATCHER_GRID)
+    {
+        // Rotation-only homography from the last motion; translation parallax
+        // is left to the search radius
+        cv::Matx33d prediction = intrinsics * lastRotation * intrinsics.inv();
+        matchGrid(prediction, matches);
+
+        // Large unexpected motion, the prior is useless for this frame
+        if (matches.size() >= static_cast<size_t>(std::max(params.minGridMatches, 0)))
+            return;
+    }
+
+    matchExhaustive(matches);
+}
+
+// The original heuristic: keep matches within a multiple of the best distance
+void VisualOdometry::filterByDistance(const std::vector<cv::DMatch> &matches)
+{
     double maxDist = 0;
     double minDist = 100;
-    for (int i = 0; i < descriptorsPrev.rows; i++)
+    for (const auto &match : matches)
     {
-        double dist = matches[i].distance;
+        double dist = match.distance;
         if (dist < minDist)
             minDist = dist;
         if (dist > maxDist)
             maxDist = dist;
     }
 
-    std::vector<cv::DMatch> goodMatches;
-    for (int i = 0; i < descriptorsPrev.rows; i++)
+    for (const auto &match : matches)
     {
-        if (matches[i].distance <= std::max(params.matchDistanceMultiplier * minDist, params.matchDistanceMinimum))
+        if (match.distance <= std::max(params.matchDistanceMultiplier * minDist, params.matchDistanceMinimum))
         {
-            goodMatches.push_back(matches[i]);
+            last.matches.push_back(match);
         }
     }
+}
+
+// Sampson distance (pixels squared) of a correspondence to the epipolar geometry F
+static double sampsonDistance(const cv::Matx33d &F, const cv::Point2f &p1, const cv::Point2f &p2)
+{
+    cv::Vec3d x1(p1.x, p1.y, 1.0), x2(p2.x, p2.y, 1.0);
+    cv::Vec3d Fx1 = F * x1;
+    cv::Vec3d Ftx2 = F.t() * x2;
+    double e = x2.dot(Fx1);
+    double norm = Fx1[0] * Fx1[0] + Fx1[1] * Fx1[1] + Ftx2[0] * Ftx2[0] + Ftx2[1] * Ftx2[1];
+    return norm > 0 ? e * e / norm : 0.0;
+}
+
+OdometryResult VisualOdometry::process(const cv::Mat &frame, const cv::Mat &featureMask, const cv::UMat &deviceFrame)
+{
+    PROFILE_SCOPE("odometry.total");
+
+    // The current frame becomes the previous one; its features are reused instead of recomputed
+    std::swap(prev, curr);
+    curr.image = frame;
+    {
+        PROFILE_SCOPE("odometry.orb");
+        // Keypoints and descriptors come back to the host either way, the
+        // matchers and the pose solver run there
+        if (deviceFrame.empty())
+            orb->detectAndCompute(frame, featureMask, curr.keypoints, curr.descriptors);
+        else
+            orb->detectAndCompute(deviceFrame, deviceMask.get(featureMask), curr.keypoints, curr.descriptors);
+    }
+
+    last = OdometryResult();
+    if (prev.image.empty() || prev.descriptors.empty() || curr.descriptors.empty())
+        return last;
+
+    // Match with the configured backend; the ratio test and the cross check
+    // filter while matching, the distance heuristic afterwards
+    std::vector<cv::DMatch> matches;
+    matchFeatures(matches);
+    if (filter == MATCH_FILTER_DISTANCE)
+        filterByDistance(matches);
+    else
+        last.matches = std::move(matches);
+
+    // Fast path: too few matches for a reliable pose (the five-point solver
+    // needs five at the very least), don't spend the RANSAC time on them
+    const size_t minMatches = static_cast<size_t>(std::max(5, params.minPoseMatches));
+    if (last.matches.size() < minMatches)
+        return last;
+
+    // Best matches first: PROSAC samples them first, and maxPoseMatches keeps only those
+    std::vector<cv::DMatch> pose = last.matches;
+    bool prosac = params.estimator == "prosac";
+    if (prosac || params.maxPoseMatches > 0)
+    {
+        std::sort(pose.begin(), pose.end(), [](const cv::DMatch &a, const cv::DMatch &b)
+                  { return a.distance < b.distance; });
+        if (params.maxPoseMatches > 0 && pose.size() > static_cast<size_t>(params.maxPoseMatches))
+            pose.resize(std::max(minMatches, static_cast<size_t>(params.maxPoseMatches)));
+    }
 
     // Extract location of good matches
     std::vector<cv::Point2f> pointsPrev;
     std::vector<cv::Point2f> pointsCurr;
-    for (size_t i = 0; i < goodMatches.size(); i++)
+    for (const auto &match : pose)
     {
-        pointsPrev.push_back(keypointsPrev[goodMatches[i].queryIdx].pt);
-        pointsCurr.push_back(keypointsCurr[goodMatches[i].trainIdx].pt);
+        pointsPrev.push_back(prev.keypoints[match.queryIdx].pt);
+        pointsCurr.push_back(curr.keypoints[match.trainIdx].pt);
     }
 
-    // Compute Essential matrix using configured camera intrinsics
-    cv::Mat intrinsics = params.cameraIntrinsics.toMat();
-    cv::Mat essentialMat = cv::findEssentialMat(pointsPrev, pointsCurr, intrinsics, cv::RANSAC, params.ransacConfidence, params.ransacThreshold);
+    // Seeded with the previous motion: matches far off its epipolar lines are
+    // dropped before RANSAC, so a smooth sequence leaves RANSAC a clean set
+    // that it finishes in a few iterations. Skipped when too few survive
+    if (params.priorGateThreshold > 0 && hasPrior)
+    {
+        const cv::Matx33d tx(0, -lastTranslation[2], lastTranslation[1],
+                             lastTranslation[2], 0, -lastTranslation[0],
+                             -lastTranslation[1], lastTranslation[0], 0);
+        const cv::Matx33d Kinv = intrinsics.inv();
+        const cv::Matx33d F = Kinv.t() * tx * lastRotation * Kinv;
+        const double gate = params.priorGateThreshold * params.priorGateThreshold;
 
-    // Recover pose from Essential matrix
-    cv::Mat R, t;
-    auto inliers = cv::recoverPose(essentialMat, pointsPrev, pointsCurr, intrinsics, R, t);
+        std::vector<cv::Point2f> gatedPrev, gatedCurr;
+        for (size_t i = 0; i < pointsPrev.size(); ++i)
+        {
+            if (sampsonDistance(F, pointsPrev[i], pointsCurr[i]) <= gate)
+            {
+                gatedPrev.push_back(pointsPrev[i]);
+                gatedCurr.push_back(pointsCurr[i]);
+            }
+        }
+        if (gatedPrev.size() >= minMatches)
+        {
+            pointsPrev.swap(gatedPrev);
+            pointsCurr.swap(gatedCurr);
+        }
+    }
 
-    std::cout << "Rotation Matrix:\n"
-              << R << std::endl;
-    std::cout << "Translation Vector:\n"
-              << t << std::endl;
+    // Compute Essential matrix using configured camera intrinsics; the
+    // iteration cap bounds the time spent on hard frames
+    cv::Mat K(intrinsics);
+    cv::Mat essentialMat;
+    cv::Mat inlierMask;
+    {
+        PROFILE_SCOPE("odometry.essential_matrix");
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 5)
+        int method = prosac ? cv::USAC_PROSAC : cv::RANSAC;
+        essentialMat = cv::findEssentialMat(pointsPrev, pointsCurr, K, method, params.ransacConfidence, params.ransacThreshold,
+                                            std::max(1, params.ransacMaxIterations), inlierMask);
+#else
+        // No USAC and no iteration cap before OpenCV 4.5
+        essentialMat = cv::findEssentialMat(pointsPrev, pointsCurr, K, cv::RANSAC, params.ransacConfidence, params.ransacThreshold, inlierMask);
+#endif
+    }
+    if (essentialMat.rows < 3)
+        return last;
+
+    // Several solutions come back stacked; recoverPose takes a single 3x3 one
+    if (essentialMat.rows > 3)
+        essentialMat = essentialMat.rowRange(0, 3);
+
+    // Recover pose from Essential matrix, with the RANSAC inliers only
+    PROFILE_SCOPE("odometry.recover_pose");
+    last.inliers = cv::recoverPose(essentialMat, pointsPrev, pointsCurr, K, last.R, last.t, inlierMask);
+
+    // A degenerate E still decomposes, into an arbitrary R and t; without
+    // enough points in front of both cameras the pose is neither reported
+    // nor used as the next frame's prior
+    if (last.inliers < static_cast<int>(minMatches))
+    {
+        last.R.release();
+        last.t.release();
+        return last;
+    }
+
+    last.valid = true;
+    lastRotation = last.R;
+    lastTranslation = last.t;
+    hasPrior = true;
+
+    return last;
+}
+
+cv::Mat VisualOdometry::drawLastMatches() const
+{
+    if (!DEBUG_RENDER() || prev.image.empty() || curr.image.empty())
+        return cv::Mat();
 
     // Draw matches for visualization
     cv::Mat imgMatches;
-    cv::drawMatches(prevFrame, keypointsPrev, currFrame, keypointsCurr, goodMatches, imgMatches);
+    cv::drawMatches(prev.image, prev.keypoints, curr.image, curr.keypoints, last.matches, imgMatches);
 
     return imgMatches;
 }
+
+cv::Mat calcOdometry(const cv::Mat &prevFrame, const cv::Mat &currFrame, const cv::Mat &featureMask, const OdometryParams &params, OdometryResult *result)
+{
+    VisualOdometry odometry(params);
+    odometry.process(prevFrame, featureMask);
+    OdometryResult motion = odometry.process(currFrame, featureMask);
+
+    if (result)
+        *result = motion;
+
+    return odometry.drawLastMatches();
+}
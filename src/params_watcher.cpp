@@ -0,0 +1,53 @@
+#include "../include/params_watcher.hpp"
+#include "../include/pipeline.hpp"
+#include <chrono>
+
+ParamsWatcher::ParamsWatcher(const std::string &configPath, int pollIntervalMs)
+    : configPath(configPath), pollIntervalMs(pollIntervalMs)
+{
+    // The parameters in use were loaded from the file as it is now
+    std::error_code ec;
+    lastSeen = std::filesystem::last_write_time(configPath, ec);
+    if (pollIntervalMs > 0)
+        thread = std::thread(&ParamsWatcher::worker, this);
+}
+
+ParamsWatcher::~ParamsWatcher()
+{
+    if (!thread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    thread.join();
+}
+
+bool ParamsWatcher::poll()
+{
+    std::error_code ec;
+    auto mtime = std::filesystem::last_write_time(configPath, ec);
+    if (ec || mtime == lastSeen)
+        return false;
+    lastSeen = mtime;
+
+    if (!reloadPipelineParams(configPath))
+        return false;
+    ++reloadCount;
+    return true;
+}
+
+void ParamsWatcher::worker()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!wake.wait_for(lock, std::chrono::milliseconds(pollIntervalMs), [this]
+                          { return stopping; }))
+    {
+        // Parsing and rebuilding take a while, don't hold up the destructor
+        lock.unlock();
+        poll();
+        lock.lock();
+    }
+}
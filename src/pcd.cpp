@@ -0,0 +1,280 @@
+#include "../include/pcd.hpp"
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+int PcdHeader::fieldIndex(const std::string &name) const
+{
+    for (size_t i = 0; i < fields.size(); ++i)
+    {
+        if (fields[i].name == name)
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
+// Fills fields[i].<member> from the values after the keyword
+template <typename Setter>
+static bool parseFieldValues(std::istringstream &values, std::vector<PcdField> &fields, Setter set)
+{
+    for (auto &field : fields)
+    {
+        std::string value;
+        if (!(values >> value))
+            return false;
+        set(field, value);
+    }
+    return true;
+}
+
+bool parsePcdHeader(const void *buffer, size_t size, PcdHeader &header)
+{
+    header = PcdHeader();
+    const char *text = static_cast<const char *>(buffer);
+    size_t pos = 0;
+
+    while (pos < size)
+    {
+        const char *lineEnd = static_cast<const char *>(std::memchr(text + pos, '\n', size - pos));
+        if (!lineEnd)
+            return false;
+
+        std::string line(text + pos, lineEnd);
+        pos = lineEnd - text + 1;
+
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::istringstream values(line);
+        std::string key;
+        values >> key;
+
+        try
+        {
+            if (key == "VERSION")
+                values >> header.version;
+            else if (key == "FIELDS")
+            {
+                std::string name;
+                while (values >> name)
+                {
+                    PcdField field;
+                    field.name = name;
+                    header.fields.push_back(field);
+                }
+            }
+            else if (key == "SIZE")
+            {
+                if (!parseFieldValues(values, header.fields, [](PcdField &f, const std::string &v)
+                                      { f.size = std::stoi(v); }))
+                    return false;
+            }
+            else if (key == "TYPE")
+            {
+                if (!parseFieldValues(values, header.fields, [](PcdField &f, const std::string &v)
+                                      { f.type = v[0]; }))
+                    return false;
+            }
+            else if (key == "COUNT")
+            {
+                if (!parseFieldValues(values, header.fields, [](PcdField &f, const std::string &v)
+                                      { f.count = std::stoi(v); }))
+                    return false;
+            }
+            else if (key == "WIDTH")
+                values >> header.width;
+            else if (key == "HEIGHT")
+                values >> header.height;
+            else if (key == "POINTS")
+                values >> header.points;
+            else if (key == "DATA")
+            {
+                values >> header.data;
+                header.dataOffset = pos;
+                break;
+            }
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
+    }
+
+    if (header.data.empty() || header.fields.empty())
+        return false;
+
+    if (header.points == 0)
+        header.points = header.width * header.height;
+
+    // Records are the fields back to back, no extra padding
+    size_t offset = 0;
+    for (auto &field : header.fields)
+    {
+        if (field.size <= 0 || field.count <= 0)
+            return false;
+        field.offset = offset;
+        offset += static_cast<size_t>(field.size) * field.count;
+    }
+    header.pointStep = offset;
+    return true;
+}
+
+template <typename T>
+static void attachField(const PcdHeader &header, const uint8_t *data, const char *name, char type, PcdFieldView<T> &view)
+{
+    view = PcdFieldView<T>();
+    int index = header.fieldIndex(name);
+    if (index < 0)
+        return;
+
+    const PcdField &field = header.fields[index];
+    if (field.type != type || field.size != static_cast<int>(sizeof(T)))
+        return;
+
+    view.base = data + field.offset;
+    view.stride = header.pointStep;
+}
+
+bool PointCloudView::attach(const PcdHeader &header, const void *buffer, size_t bufferSize)
+{
+    *this = PointCloudView();
+
+    if (header.data != "binary")
+    {
+        std::cerr << "Error: Unsupported PCD data layout: " << header.data << std::endl;
+        return false;
+    }
+
+    // Trailing bytes after the last record are allowed (our scans have some)
+    if (header.dataOffset > bufferSize || header.points > (bufferSize - header.dataOffset) / header.pointStep)
+    {
+        std::cerr << "Error: PCD file shorter than its header says" << std::endl;
+        return false;
+    }
+
+    const uint8_t *data = static_cast<const uint8_t *>(buffer) + header.dataOffset;
+    attachField(header, data, "x", 'F', x);
+    attachField(header, data, "y", 'F', y);
+    attachField(header, data, "z", 'F', z);
+    attachField(header, data, "intensity", 'F', intensity);
+    attachField(header, data, "tag", 'U', tag);
+    attachField(header, data, "line", 'U', line);
+
+    if (!x.valid() || !y.valid() || !z.valid())
+    {
+        std::cerr << "Error: PCD file has no float x/y/z fields" << std::endl;
+        *this = PointCloudView();
+        return false;
+    }
+
+    size = header.points;
+    return true;
+}
+
+MappedPcdFile::~MappedPcdFile()
+{
+    close();
+}
+
+bool MappedPcdFile::open(const std::string &filepath)
+{
+    close();
+
+    int fd = ::open(filepath.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+        return false;
+
+    // Scans are walked front to back
+    madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+
+    data = mapped;
+    size = st.st_size;
+
+    if (!parsePcdHeader(data, size, pcdHeader) || !cloudView.attach(pcdHeader, data, size))
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedPcdFile::close()
+{
+    if (data)
+        munmap(data, size);
+    data = nullptr;
+    size = 0;
+    pcdHeader = PcdHeader();
+    cloudView = PointCloudView();
+}
+
+static bool isPcdFile(const fs::path &path)
+{
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c)
+                   { return std::tolower(c); });
+    return ext == ".pcd";
+}
+
+bool PcdSource::open(const std::string &source)
+{
+    files.clear();
+    nextFile = 0;
+    index = -1;
+    current.clear();
+
+    std::error_code ec;
+    if (fs::is_directory(source, ec))
+    {
+        for (const auto &entry : fs::directory_iterator(source, ec))
+        {
+            if (entry.is_regular_file() && isPcdFile(entry.path()))
+                files.push_back(entry.path().string());
+        }
+        std::sort(files.begin(), files.end());
+    }
+    else if (fs::is_regular_file(source, ec))
+        files.push_back(source);
+
+    if (files.empty())
+        std::cerr << "Error: No PCD files found: " << source << std::endl;
+    return !files.empty();
+}
+
+bool PcdSource::read(MappedPcdFile &cloud)
+{
+    // Skip unreadable scans instead of stopping the stream
+    while (nextFile < files.size())
+    {
+        current = files[nextFile++];
+        if (cloud.open(current))
+        {
+            ++index;
+            return true;
+        }
+        std::cerr << "Warning: Could not load point cloud: " << current << std::endl;
+    }
+
+    cloud.close();
+    return false;
+}
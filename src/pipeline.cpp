@@ -4,258 +4,589 @@
 #include "../include/track.hpp"
 #include "../include/odometry.hpp"
 #include "../include/params.hpp"
+#include "../include/classifier.hpp"
+#include "../include/cone_io.hpp"
+#include "../include/lidar.hpp"
+#include "../include/profiling.hpp"
+#include "../include/debug_sink.hpp"
+#include "../include/calibration.hpp"
+#include "../include/fusion.hpp"
+#include "../include/workspace.hpp"
+#include "../include/multi_camera.hpp"
+#include "../include/device.hpp"
+#include "../include/trajectory.hpp"
+#include <array>
+#include <atomic>
+#include <memory>
 #include <fstream>
-#include <sstream>
 #include <iostream>
+#include <mutex>
 
-// Global pipeline parameters
-static PipelineParams g_params;
+static std::shared_ptr<PipelineSnapshot> buildSnapshot(const PipelineParams &params, uint64_t version);
 
-// Initialize parameters from config file
-void initializePipelineParams(const std::string &configPath)
+// Latest parameter snapshot, the defaults until parameters are loaded;
+// writers (setPipelineParams and the calibrator) swap in a whole new one.
+// atomic_load/atomic_store on a shared_ptr take a lock inside the standard
+// library, so readers only go there after g_publishCount has moved on
+static std::shared_ptr<const PipelineSnapshot> g_snapshot = buildSnapshot(PipelineParams(), 0);
+
+// Bumped after every swap of g_snapshot, calibrated tables included
+static std::atomic<uint64_t> g_publishCount(0);
+
+// Serializes writers, so a calibrated table can't overwrite newer parameters
+static std::mutex g_publishMutex;
+
+// Snapshot pinned by a SnapshotScope on this thread, if any
+static thread_local std::shared_ptr<const PipelineSnapshot> t_pinned;
+
+// The latest snapshot as this thread last saw it, and the publish count it
+// was loaded at
+static thread_local std::shared_ptr<const PipelineSnapshot> t_latest;
+static thread_local uint64_t t_latestCount = 0;
+
+// Detection and track buffers, one set per thread running the stages (the
+// pipelined executor runs detection and track building on different threads)
+static thread_local DetectionWorkspace t_workspace;
+
+// LIDAR detector of this thread: it keeps its buffers between scans, so it
+// is never shared. Rebuilt when a snapshot with other LIDAR settings comes in
+struct ThreadLidarDetector
+{
+    std::shared_ptr<const PipelineSnapshot> snapshot; // What the detector was built with
+    std::unique_ptr<LidarConeDetector> detector;
+};
+static thread_local ThreadLidarDetector t_lidar;
+
+// The pinned snapshot, else the latest one. Lock-free unless a new snapshot
+// was published since this thread last looked
+static std::shared_ptr<const PipelineSnapshot> currentSnapshot()
 {
-    g_params = PipelineParams::loadFromFile(configPath);
+    if (t_pinned)
+        return t_pinned;
+
+    // The count is bumped after the store, so a snapshot loaded after seeing
+    // it is at least that new; a newer one only means one more reload later
+    uint64_t count = g_publishCount.load(std::memory_order_acquire);
+    if (!t_latest || t_latestCount != count)
+    {
+        t_latest = std::atomic_load(&g_snapshot);
+        t_latestCount = count;
+    }
+    return t_latest;
 }
 
-// Get current parameters
-const PipelineParams &getPipelineParams()
+// Swaps in `snapshot`; the old one is handed back so the caller drops it
+// outside the lock (it may hold the last reference to a calibrator, whose
+// thread can be waiting for the lock in its publish callback)
+static std::shared_ptr<const PipelineSnapshot> publishSnapshot(std::shared_ptr<const PipelineSnapshot> snapshot)
 {
-    return g_params;
+    std::shared_ptr<const PipelineSnapshot> previous = std::atomic_load(&g_snapshot);
+    std::atomic_store(&g_snapshot, std::move(snapshot));
+    g_publishCount.fetch_add(1, std::memory_order_release);
+    return previous;
 }
 
-// JSON serialization helpers
-void saveConeDetectionToJson(const ConeDetectionResult &result, const std::string &filepath)
+// A calibrated table for the snapshot version it was fitted under; dropped
+// if the parameters have changed since
+static void publishCalibratedLut(uint64_t version, std::shared_ptr<const HsvLut> lut)
 {
-    std::ofstream file(filepath);
-    if (!file.is_open())
+    std::shared_ptr<const PipelineSnapshot> previous;
     {
-        std::cerr << "Error: Could not open file for writing: " << filepath << std::endl;
-        return;
+        std::lock_guard<std::mutex> lock(g_publishMutex);
+        std::shared_ptr<const PipelineSnapshot> current = std::atomic_load(&g_snapshot);
+        if (current->version != version)
+            return;
+
+        auto snapshot = std::make_shared<PipelineSnapshot>(*current);
+        snapshot->lut = std::move(lut);
+        previous = publishSnapshot(std::move(snapshot));
     }
+}
 
-    file << "{\n";
-
-    // Save orange cones
-    file << "  \"orangeCones\": [\n";
-    for (size_t i = 0; i < result.orangeCones.size(); ++i)
-    {
-        const auto &cone = result.orangeCones[i];
-        file << "    {";
-        file << "\"x\": " << cone.center.x << ", ";
-        file << "\"y\": " << cone.center.y << ", ";
-        file << "\"bbox_x\": " << cone.boundingBox.x << ", ";
-        file << "\"bbox_y\": " << cone.boundingBox.y << ", ";
-        file << "\"bbox_width\": " << cone.boundingBox.width << ", ";
-        file << "\"bbox_height\": " << cone.boundingBox.height;
-        file << "}";
-        if (i < result.orangeCones.size() - 1)
-            file << ",";
-        file << "\n";
+// Everything derived from `params`, built before it is published
+static std::shared_ptr<PipelineSnapshot> buildSnapshot(const PipelineParams &params, uint64_t version)
+{
+    auto snapshot = std::make_shared<PipelineSnapshot>();
+    snapshot->params = params;
+    snapshot->version = version;
+    snapshot->lut = std::make_shared<const HsvLut>(buildHsvLut(params.roadMask));
+    if (params.calibration.enabled)
+    {
+        snapshot->calibrator = std::make_shared<ColourCalibrator>(params.calibration, params.roadMask, [version](std::shared_ptr<const HsvLut> lut)
+                                                                  { publishCalibratedLut(version, std::move(lut)); });
     }
-    file << "  ],\n";
-
-    // Save blue cones
-    file << "  \"blueCones\": [\n";
-    for (size_t i = 0; i < result.blueCones.size(); ++i)
-    {
-        const auto &cone = result.blueCones[i];
-        file << "    {";
-        file << "\"x\": " << cone.center.x << ", ";
-        file << "\"y\": " << cone.center.y << ", ";
-        file << "\"bbox_x\": " << cone.boundingBox.x << ", ";
-        file << "\"bbox_y\": " << cone.boundingBox.y << ", ";
-        file << "\"bbox_width\": " << cone.boundingBox.width << ", ";
-        file << "\"bbox_height\": " << cone.boundingBox.height;
-        file << "}";
-        if (i < result.blueCones.size() - 1)
-            file << ",";
-        file << "\n";
+    return snapshot;
+}
+
+// Initialize parameters from config file
+void initializePipelineParams(const std::string &configPath)
+{
+    setPipelineParams(PipelineParams::loadFromFile(configPath));
+}
+
+// Replace the parameters at runtime and rebuild everything derived from them
+void setPipelineParams(const PipelineParams &params)
+{
+    // Rasterize the new car polygon for the resolutions in use now, not on the next frame
+    prewarmCarMasks(params.carMask);
+
+    std::shared_ptr<const PipelineSnapshot> previous;
+    {
+        std::lock_guard<std::mutex> lock(g_publishMutex);
+        std::shared_ptr<const PipelineSnapshot> current = std::atomic_load(&g_snapshot);
+        previous = publishSnapshot(buildSnapshot(params, current->version + 1));
     }
-    file << "  ],\n";
-
-    // Save yellow cones
-    file << "  \"yellowCones\": [\n";
-    for (size_t i = 0; i < result.yellowCones.size(); ++i)
-    {
-        const auto &cone = result.yellowCones[i];
-        file << "    {";
-        file << "\"x\": " << cone.center.x << ", ";
-        file << "\"y\": " << cone.center.y << ", ";
-        file << "\"bbox_x\": " << cone.boundingBox.x << ", ";
-        file << "\"bbox_y\": " << cone.boundingBox.y << ", ";
-        file << "\"bbox_width\": " << cone.boundingBox.width << ", ";
-        file << "\"bbox_height\": " << cone.boundingBox.height;
-        file << "}";
-        if (i < result.yellowCones.size() - 1)
-            file << ",";
-        file << "\n";
+
+    // The retired calibrator's thread is stopped here rather than by its
+    // destructor: the last snapshot holding it may be dropped by that very
+    // thread (in its publish callback), and it can't join itself
+    if (previous->calibrator)
+        previous->calibrator->stop();
+
+    if (params.acceleration.backend == "opencl" && !useDevice(params.acceleration))
+        std::cerr << "Warning: No OpenCL device available, running on the CPU" << std::endl;
+}
+
+bool reloadPipelineParams(const std::string &configPath)
+{
+    PipelineParams params;
+    if (!PipelineParams::tryLoadFromFile(configPath, params))
+    {
+        std::cerr << "Keeping the current parameters" << std::endl;
+        return false;
     }
-    file << "  ]\n";
 
-    file << "}\n";
-    file.close();
+    setPipelineParams(params);
+    std::cout << "Reloaded parameters from: " << configPath << std::endl;
+    return true;
+}
 
-    std::cout << "Saved cone detection results to: " << filepath << std::endl;
+std::shared_ptr<const PipelineSnapshot> getPipelineSnapshot()
+{
+    return currentSnapshot();
 }
 
-// Simple JSON parser for cone data
-ConeDetectionResult loadConeDetectionFromJson(const std::string &filepath)
+PipelineParams getPipelineParams()
 {
-    ConeDetectionResult result;
-    std::ifstream file(filepath);
+    return currentSnapshot()->params;
+}
 
-    if (!file.is_open())
+SnapshotScope::SnapshotScope(std::shared_ptr<const PipelineSnapshot> snapshot)
+    : previous(std::move(t_pinned))
+{
+    t_pinned = std::move(snapshot);
+}
+
+SnapshotScope::~SnapshotScope()
+{
+    t_pinned = std::move(previous);
+}
+
+static bool sameIntrinsics(const CameraIntrinsics &a, const CameraIntrinsics &b)
+{
+    return a.fx == b.fx && a.fy == b.fy && a.cx == b.cx && a.cy == b.cy;
+}
+
+void refreshStages(const PipelineParams &previous, const PipelineParams &params,
+                   ConeTracker *tracker, CenterlineBuilder *centerline, VisualOdometry *odometry, Trajectory *trajectory)
+{
+    if (tracker && PipelineParams::sectionChanged(previous, params, "tracker"))
+        *tracker = ConeTracker(params.tracker);
+    if (centerline && PipelineParams::sectionChanged(previous, params, "centerline"))
+        *centerline = CenterlineBuilder(params.centerline);
+    if (odometry && PipelineParams::sectionChanged(previous, params, "odometry"))
+        *odometry = VisualOdometry(params.odometry);
+    if (trajectory && (PipelineParams::sectionChanged(previous, params, "trajectory") ||
+                       !sameIntrinsics(previous.odometry.cameraIntrinsics, params.odometry.cameraIntrinsics)))
+        *trajectory = Trajectory(params.trajectory, params.odometry.cameraIntrinsics);
+}
+
+// This thread's LIDAR detector for `snapshot`
+static LidarConeDetector &lidarDetector(const std::shared_ptr<const PipelineSnapshot> &snapshot)
+{
+    if (t_lidar.snapshot != snapshot)
     {
-        std::cerr << "Error: Could not open file for reading: " << filepath << std::endl;
-        return result;
+        if (!t_lidar.detector || PipelineParams::sectionChanged(t_lidar.snapshot->params, snapshot->params, "lidar"))
+            t_lidar.detector = std::make_unique<LidarConeDetector>(snapshot->params.lidar);
+        t_lidar.snapshot = snapshot;
     }
+    return *t_lidar.detector;
+}
 
-    std::string line;
-    std::vector<Cone> *currentCones = nullptr;
+// Writes an image drawn for inspection and says where; empty images come
+// from rendering being off (headless build or --headless), which is said
+// too, so no stale file is taken for this run's output
+static bool saveDebugImage(const cv::Mat &image, const std::string &path, const std::string &what)
+{
+    if (image.empty())
+    {
+        if (!DEBUG_RENDER())
+            std::cout << "Rendering is off, no " << what << " written to: " << path << std::endl;
+        else
+            std::cerr << "Warning: Nothing to draw, no " << what << " written to: " << path << std::endl;
+        return false;
+    }
+    if (!cv::imwrite(path, image))
+    {
+        std::cerr << "Error: Could not write " << what << " to: " << path << std::endl;
+        return false;
+    }
+    std::cout << "Saved " << what << " to: " << path << std::endl;
+    return true;
+}
 
-    while (std::getline(file, line))
+// Cones found inside a window back to full-frame coordinates
+static void offsetCones(std::vector<Cone> &cones, const cv::Point &offset)
+{
+    for (auto &cone : cones)
     {
-        // Simple parsing - look for cone type arrays
-        if (line.find("\"orangeCones\"") != std::string::npos)
+        cone.center += offset;
+        cone.boundingBox += offset;
+    }
+}
+
+// Device copy of `img` for the OpenCL backend: the caller's if it has one,
+// otherwise uploaded into the workspace; empty on the CPU backend
+static cv::UMat deviceFrame(const cv::Mat &img, const cv::UMat &deviceImg, const AccelerationParams &params, DeviceWorkspace &device)
+{
+    if (!useDevice(params))
+        return cv::UMat();
+    if (!deviceImg.empty())
+        return deviceImg;
+
+    PROFILE_SCOPE("detect.upload");
+    cv::UMat frame = device.buffer(DeviceWorkspace::BUFFER_FRAME, img.size(), img.type());
+    img.copyTo(frame);
+    return frame;
+}
+
+// Colour classification and cone extraction inside `rect` only: no copies,
+// just views into the frame and car mask; cones come back in frame coordinates.
+// With a device frame the masks are built on the device (views of it too)
+static void detectConesInRect(const cv::Mat &img, const cv::UMat &deviceImg, const cv::Rect &rect, const CarMasks &carMasks, const HsvLut &lut,
+                              const PipelineParams &params, DetectionWorkspace &buffers, ConeDetectionResult &result)
+{
+    FrameWorkspace &workspace = buffers.frame;
+    ColourMasks masks;
+    if (deviceImg.empty())
+    {
+        // Convert to HSV color space
+        cv::Mat hsvImage = workspace.buffer(FrameWorkspace::BUFFER_HSV, rect.size(), CV_8UC3);
         {
-            currentCones = &result.orangeCones;
+            PROFILE_SCOPE("detect.hsv_convert");
+            cv::cvtColor(img(rect), hsvImage, cv::COLOR_BGR2HSV);
         }
-        else if (line.find("\"blueCones\"") != std::string::npos)
+
+        // Classify road and cone colours in a single pass, without the car
+        masks = detectColours(hsvImage, lut, carMasks.car(rect), params.colorDetection, workspace);
+    }
+    else
+    {
+        DeviceWorkspace &device = buffers.device;
+        cv::UMat hsvImage = device.buffer(DeviceWorkspace::BUFFER_HSV, rect.size(), CV_8UC3);
         {
-            currentCones = &result.blueCones;
+            PROFILE_SCOPE("detect.hsv_convert");
+            cv::cvtColor(deviceImg(rect), hsvImage, cv::COLOR_BGR2HSV);
         }
-        else if (line.find("\"yellowCones\"") != std::string::npos)
+        masks = detectColours(hsvImage, lut, device.car.get(carMasks.car)(rect), params.colorDetection, device, workspace);
+    }
+
+    // Identify cones using configured parameters; orange keeps its own
+    // horizontal threshold and area limit, blue and yellow use the shared ones
+    const ConeDetectionParams &cd = params.coneDetection;
+    struct ColourJob
+    {
+        const cv::Mat &mask;
+        int vThreshold, hThreshold, maxArea;
+        std::vector<Cone> &out;
+    };
+    const ColourJob jobs[3] = {
+        {masks.orange, cd.orange.verticalMergeThreshold, cd.orange.horizontalMergeThreshold, cd.orange.maxBoundingBoxArea, result.orangeCones},
+        {masks.blue, cd.blue.verticalMergeThreshold, cd.horizontalMergeThreshold, cd.maxBoundingBoxArea, result.blueCones},
+        {masks.yellow, cd.yellow.verticalMergeThreshold, cd.horizontalMergeThreshold, cd.maxBoundingBoxArea, result.yellowCones}};
+
+    // One task per colour, each with its own buffers and output vector
+    std::array<FrameWorkspace, 3> &colourWorkspaces = buffers.colours;
+    const int frame = Profiler::currentFrame();
+    auto extract = [&](const cv::Range &range)
+    {
+        PROFILE_FRAME(frame);
+        for (int c = range.start; c < range.end; ++c)
         {
-            currentCones = &result.yellowCones;
+            FrameWorkspace &colourWorkspace = colourWorkspaces[c];
+            std::vector<Cone> &cones = colourWorkspace.cones;
+            identifyCones(jobs[c].mask, jobs[c].vThreshold, jobs[c].hThreshold, jobs[c].maxArea, cd.minBoundingBoxArea, colourWorkspace, cones);
+            offsetCones(cones, rect.tl());
+            jobs[c].out.insert(jobs[c].out.end(), cones.begin(), cones.end());
         }
-        else if (currentCones && line.find("\"x\":") != std::string::npos)
-        {
-            // Parse cone data
-            Cone cone;
-            std::istringstream iss(line);
-            std::string token;
-
-            // Extract values using simple string parsing
-            size_t pos;
+    };
+    if (params.colorDetection.parallelColours)
+        cv::parallel_for_(cv::Range(0, 3), extract, 3);
+    else
+        extract(cv::Range(0, 3));
+}
 
-            // Get x
-            pos = line.find("\"x\": ");
-            if (pos != std::string::npos)
-            {
-                cone.center.x = std::stoi(line.substr(pos + 5));
-            }
+// Windows grown by `margin` and joined while they overlap, so the parts of
+// one cone (stripes split a cone into several) end up in a single window
+static void mergeWindows(std::vector<cv::Rect> &windows, int margin, const cv::Rect &bounds)
+{
+    for (auto &window : windows)
+        window = cv::Rect(window.x - margin, window.y - margin, window.width + 2 * margin, window.height + 2 * margin) & bounds;
 
-            // Get y
-            pos = line.find("\"y\": ");
-            if (pos != std::string::npos)
+    bool merged = true;
+    while (merged)
+    {
+        merged = false;
+        for (size_t i = 0; i < windows.size() && !merged; ++i)
+        {
+            for (size_t j = i + 1; j < windows.size(); ++j)
             {
-                cone.center.y = std::stoi(line.substr(pos + 5));
+                if ((windows[i] & windows[j]).area() > 0)
+                {
+                    windows[i] |= windows[j];
+                    windows.erase(windows.begin() + j);
+                    merged = true;
+                    break;
+                }
             }
+        }
+    }
+}
 
-            // Get bbox_x
-            pos = line.find("\"bbox_x\": ");
-            if (pos != std::string::npos)
-            {
-                cone.boundingBox.x = std::stoi(line.substr(pos + 10));
-            }
+// Coarse-to-fine step 1 in `roi`: classification, cleanup and contours on a
+// subsampled copy (nearest neighbour, so only the sampled pixels are read
+// and no colours get mixed at cone edges), with the cleanup and the largest
+// box scaled to the level. Every candidate box then goes back to full
+// resolution with a margin, and normal detection runs in those windows only,
+// so cone boxes, centers and area limits are the full-resolution ones. The
+// coarse pass stays on the host (it only reads the sampled pixels); the
+// windows use the device frame if there is one.
+static void detectConesCoarseToFine(const cv::Mat &img, const cv::UMat &deviceImg, const cv::Rect &roi, const CarMasks &carMasks, const HsvLut &lut,
+                                    const PipelineParams &params, DetectionWorkspace &buffers, ConeDetectionResult &result)
+{
+    FrameWorkspace &workspace = buffers.frame;
+    const int scale = 1 << std::clamp(params.pyramid.level, 0, 4);
+    const cv::Size coarseSize((roi.width + scale - 1) / scale, (roi.height + scale - 1) / scale);
 
-            // Get bbox_y
-            pos = line.find("\"bbox_y\": ");
-            if (pos != std::string::npos)
+    std::vector<cv::Rect> windows;
+    {
+        PROFILE_SCOPE("detect.coarse");
+
+        cv::Mat coarse = workspace.buffer(FrameWorkspace::BUFFER_COARSE, coarseSize, CV_8UC3);
+        cv::Mat coarseCar = workspace.buffer(FrameWorkspace::BUFFER_COARSE_CAR, coarseSize, CV_8UC1);
+        cv::resize(img(roi), coarse, coarseSize, 0, 0, cv::INTER_NEAREST);
+        cv::resize(carMasks.car(roi), coarseCar, coarseSize, 0, 0, cv::INTER_NEAREST);
+
+        cv::Mat hsvImage = workspace.buffer(FrameWorkspace::BUFFER_HSV, coarseSize, CV_8UC3);
+        cv::cvtColor(coarse, hsvImage, cv::COLOR_BGR2HSV);
+
+        // Iterations and kernel scaled down, rounding up so a set step stays on
+        ColorDetectionParams cleanup = params.colorDetection;
+        cleanup.erosionIterations = (cleanup.erosionIterations + scale - 1) / scale;
+        cleanup.dilationIterations = (cleanup.dilationIterations + scale - 1) / scale;
+        cleanup.morphKernelSize = std::max(1, (cleanup.morphKernelSize + scale - 1) / scale);
+        ColourMasks masks = detectColours(hsvImage, lut, coarseCar, cleanup, workspace);
+
+        // No minimum area or moments here, far cones are only a few coarse
+        // pixels; boxes much larger than a cone can be are dropped already
+        const double sx = static_cast<double>(roi.width) / coarseSize.width;
+        const double sy = static_cast<double>(roi.height) / coarseSize.height;
+        const ConeDetectionParams &cd = params.coneDetection;
+        const std::pair<const cv::Mat *, int> colours[3] = {
+            {&masks.orange, cd.orange.maxBoundingBoxArea}, {&masks.blue, cd.maxBoundingBoxArea}, {&masks.yellow, cd.maxBoundingBoxArea}};
+        for (const auto &colour : colours)
+        {
+            cv::findContours(*colour.first, workspace.contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+            for (const auto &contour : workspace.contours)
             {
-                cone.boundingBox.y = std::stoi(line.substr(pos + 10));
+                cv::Rect box = cv::boundingRect(contour);
+                cv::Rect window(roi.x + static_cast<int>(box.x * sx), roi.y + static_cast<int>(box.y * sy),
+                                static_cast<int>(std::ceil(box.width * sx)), static_cast<int>(std::ceil(box.height * sy)));
+                if (window.area() <= 2 * colour.second)
+                    windows.push_back(window);
             }
+        }
+        mergeWindows(windows, params.pyramid.refineMargin, roi);
+    }
 
-            // Get bbox_width
-            pos = line.find("\"bbox_width\": ");
-            if (pos != std::string::npos)
-            {
-                cone.boundingBox.width = std::stoi(line.substr(pos + 14));
-            }
+    PROFILE_SCOPE("detect.refine");
+    size_t pixels = 0;
+    for (const auto &window : windows)
+    {
+        detectConesInRect(img, deviceImg, window, carMasks, lut, params, buffers, result);
+        pixels += window.area();
+    }
+    DEBUG_LOG("\tCoarse-to-fine: " << windows.size() << " windows, " << pixels << " of " << roi.area() << " pixels at full resolution");
+}
 
-            // Get bbox_height
-            pos = line.find("\"bbox_height\": ");
-            if (pos != std::string::npos)
-            {
-                cone.boundingBox.height = std::stoi(line.substr(pos + 15));
-            }
+// Refine orange cones (keep only closest N as configured)
+static void keepClosestOrangeCones(ConeDetectionResult &result, const ConeColorParams &orange)
+{
+    if (orange.keepClosestN > 0)
+    {
+        std::sort(result.orangeCones.begin(), result.orangeCones.end(), [](const Cone &a, const Cone &b)
+                  { return a.center.y > b.center.y; });
 
-            currentCones->push_back(cone);
-        }
+        if (result.orangeCones.size() > (size_t)orange.keepClosestN)
+            result.orangeCones.resize(orange.keepClosestN);
     }
+}
 
-    file.close();
+// Step 1 with everything passed in, for callers with their own parameters
+ConeDetectionResult detectConesFromImage(const cv::Mat &img, const PipelineParams &params, const HsvLut &lut, const CarMasks &carMasks,
+                                         DetectionWorkspace &workspace, const ConeDetectionResult *previousCones, const cv::UMat &deviceImg)
+{
+    PROFILE_SCOPE("detect.total");
 
-    std::cout << "Loaded cone detection results from: " << filepath << std::endl;
-    std::cout << "  Orange cones: " << result.orangeCones.size() << std::endl;
-    std::cout << "  Blue cones: " << result.blueCones.size() << std::endl;
-    std::cout << "  Yellow cones: " << result.yellowCones.size() << std::endl;
+    ConeDetectionResult result;
+
+    if (img.empty())
+        return result;
+
+    cv::UMat device = deviceFrame(img, deviceImg, params.acceleration, workspace.device);
+    cv::Rect roi = getDetectionRoi(img.size(), params.roi, previousCones);
+    if (params.pyramid.level > 0)
+        detectConesCoarseToFine(img, device, roi, carMasks, lut, params, workspace, result);
+    else
+        detectConesInRect(img, device, roi, carMasks, lut, params, workspace, result);
 
+    keepClosestOrangeCones(result, params.coneDetection.orange);
     return result;
 }
 
-// Step 1: Detect cones from an image
+// Step 1: Detect cones from an already decoded frame
+ConeDetectionResult detectConesFromImage(const cv::Mat &img, const ConeDetectionResult *previousCones, const cv::UMat &deviceImg)
+{
+    if (img.empty())
+        return ConeDetectionResult();
+
+    std::shared_ptr<const PipelineSnapshot> snapshot = currentSnapshot();
+    CarMasks carMasks = getCarMasks(img.size(), snapshot->params.carMask);
+    return detectConesFromImage(img, snapshot->params, *snapshot->lut, carMasks, t_workspace, previousCones, deviceImg);
+}
+
+// Step 1 restricted to a few windows of the frame
+ConeDetectionResult detectConesInWindows(const cv::Mat &img, const std::vector<cv::Rect> &windows, const cv::UMat &deviceImg)
+{
+    PROFILE_SCOPE("detect.total");
+
+    ConeDetectionResult result;
+
+    if (img.empty())
+        return result;
+
+    std::shared_ptr<const PipelineSnapshot> snapshot = currentSnapshot();
+    const PipelineParams &params = snapshot->params;
+    CarMasks carMasks = getCarMasks(img.size(), params.carMask);
+    cv::UMat device = deviceFrame(img, deviceImg, params.acceleration, t_workspace.device);
+    for (const auto &window : windows)
+        detectConesInRect(img, device, window & cv::Rect(cv::Point(0, 0), img.size()), carMasks, *snapshot->lut, params, t_workspace, result);
+
+    keepClosestOrangeCones(result, params.coneDetection.orange);
+    return result;
+}
+
+// Step 1 with tracking: full-frame detection every few frames, seeded with
+// the predicted cones, and only windows around the predictions in between
+ConeDetectionResult detectConesTracked(ConeTracker &tracker, const cv::Mat &img, const cv::UMat &deviceImg)
+{
+    tracker.predict();
+
+    bool full = tracker.needsFullDetection();
+    ConeDetectionResult detections;
+    if (full)
+    {
+        ConeDetectionResult predicted = tracker.predictedCones();
+        detections = detectConesFromImage(img, &predicted, deviceImg);
+    }
+    else
+        detections = detectConesInWindows(img, tracker.searchWindows(img.size()), deviceImg);
+
+    return tracker.update(detections, full);
+}
+
+void calibrateColours(const cv::Mat &img, const ConeDetectionResult &cones)
+{
+    std::shared_ptr<const PipelineSnapshot> snapshot = currentSnapshot();
+    if (snapshot->calibrator)
+        snapshot->calibrator->addSamples(img, cones);
+}
+
+// Step 1: Detect cones from an image file
 ConeDetectionResult detectConesFromImage(
     const std::string &imagePath,
-    const std::string &outputJsonPath)
+    const std::string &outputJsonPath,
+    const std::string &outputBinaryPath)
 {
     std::cout << "\n=== STEP 1: DETECTING CONES ===" << std::endl;
     std::cout << "Input image: " << imagePath << std::endl;
 
-    ConeDetectionResult result;
-
     // Load image
     cv::Mat img = cv::imread(imagePath);
     if (img.empty())
     {
         std::cerr << "Error: Could not load image: " << imagePath << std::endl;
-        return result;
+        return ConeDetectionResult();
     }
 
-    // Convert to HSV color space
-    cv::Mat hsvImage;
-    cv::cvtColor(img, hsvImage, cv::COLOR_BGR2HSV);
-
-    // Create masks using configured parameters
-    cv::Mat carMask = createCarMask(img);
-    cv::Mat roadMask = detectColour(hsvImage, {"Road", {{g_params.roadMask.hsvLower, g_params.roadMask.hsvUpper}}}, carMask, false, true, g_params.colorDetection);
-
-    // Detect different colored cones using configured parameters
-    cv::Mat orangeMask = detectColour(hsvImage, getColourMask(ORANGE), carMask | roadMask, true, false, g_params.colorDetection);
-    cv::Mat blueMask = detectColour(hsvImage, getColourMask(BLUE), carMask | roadMask, true, false, g_params.colorDetection);
-    cv::Mat yellowMask = detectColour(hsvImage, getColourMask(YELLOW), carMask | roadMask, true, false, g_params.colorDetection);
-
-    // Identify cones using configured parameters
-    result.orangeCones = identifyCones(orangeMask, img,
-                                       g_params.coneDetection.orange.verticalMergeThreshold,
-                                       g_params.coneDetection.orange.horizontalMergeThreshold,
-                                       g_params.coneDetection.orange.maxBoundingBoxArea,
-                                       g_params.coneDetection.minBoundingBoxArea);
-
-    result.blueCones = identifyCones(blueMask, img,
-                                     g_params.coneDetection.blue.verticalMergeThreshold,
-                                     g_params.coneDetection.horizontalMergeThreshold,
-                                     g_params.coneDetection.maxBoundingBoxArea,
-                                     g_params.coneDetection.minBoundingBoxArea);
-
-    result.yellowCones = identifyCones(yellowMask, img,
-                                       g_params.coneDetection.yellow.verticalMergeThreshold,
-                                       g_params.coneDetection.horizontalMergeThreshold,
-                                       g_params.coneDetection.maxBoundingBoxArea,
-                                       g_params.coneDetection.minBoundingBoxArea);
-
-    // Refine orange cones (keep only closest N as configured)
-    if (g_params.coneDetection.orange.keepClosestN > 0)
-    {
-        std::sort(result.orangeCones.begin(), result.orangeCones.end(), [](const Cone &a, const Cone &b)
-                  { return a.center.y > b.center.y; });
+    ConeDetectionResult result = detectConesFromImage(img);
+
+    // Save results to JSON for the UI, and in binary for the next step
+    saveConeDetectionToJson(result, outputJsonPath);
+    if (!outputBinaryPath.empty())
+        saveConeDetectionToBinary(result, outputBinaryPath);
+
+    std::cout << "Detected:" << std::endl;
+    std::cout << "  Orange cones: " << result.orangeCones.size() << std::endl;
+    std::cout << "  Blue cones: " << result.blueCones.size() << std::endl;
+    std::cout << "  Yellow cones: " << result.yellowCones.size() << std::endl;
+
+    return result;
+}
+
+// LIDAR step 1 on an already mapped scan
+ConeDetectionResult detectConesFromPointCloud(const PointCloudView &cloud)
+{
+    return lidarDetector(currentSnapshot()).detect(cloud);
+}
+
+// LIDAR step 1: Detect cones from a PCD file
+ConeDetectionResult detectConesFromPointCloud(
+    const std::string &pcdPath,
+    const std::string &outputJsonPath,
+    const std::string &outputBinaryPath,
+    const std::string &outputImagePath)
+{
+    std::cout << "\n=== LIDAR: DETECTING CONES ===" << std::endl;
+    std::cout << "Input scan: " << pcdPath << std::endl;
 
-        if (result.orangeCones.size() > (size_t)g_params.coneDetection.orange.keepClosestN)
-            result.orangeCones.resize(g_params.coneDetection.orange.keepClosestN);
+    MappedPcdFile cloud;
+    if (!cloud.open(pcdPath))
+    {
+        std::cerr << "Error: Could not load point cloud: " << pcdPath << std::endl;
+        return ConeDetectionResult();
     }
 
-    // Save results to JSON
-    saveConeDetectionToJson(result, outputJsonPath);
+    // One snapshot for the scan and its obstacle points
+    std::shared_ptr<const PipelineSnapshot> snapshot = currentSnapshot();
+    LidarConeDetector &detector = lidarDetector(snapshot);
+    ConeDetectionResult result = detector.detect(cloud.view());
+
+    if (!outputJsonPath.empty())
+        saveConeDetectionToJson(result, outputJsonPath);
+    if (!outputBinaryPath.empty())
+        saveConeDetectionToBinary(result, outputBinaryPath);
+
+    // Top-down view: above-ground points in grey, cones and track lines on top
+    if (!outputImagePath.empty())
+    {
+        cv::Mat canvas(lidarBirdsEyeSize, CV_8UC3, cv::Scalar(0, 0, 0));
+        for (const auto &p : detector.obstaclePoints())
+            cv::circle(canvas, lidarToBirdsEye(p.x, p.y, snapshot->params.lidar), 1, cv::Scalar(128, 128, 128), -1);
+
+        cv::Mat outputImage = drawTrackLinesFromCones(canvas, result);
+        saveDebugImage(outputImage, outputImagePath, "LIDAR image");
+    }
 
     std::cout << "Detected:" << std::endl;
     std::cout << "  Orange cones: " << result.orangeCones.size() << std::endl;
@@ -265,35 +596,145 @@ ConeDetectionResult detectConesFromImage(
     return result;
 }
 
-// Step 2: Draw track lines using pre-detected cones
-cv::Mat drawTrackLinesFromCones(
+// Fusion: LIDAR cones coloured from patches of an already decoded frame
+ConeDetectionResult fuseConesFromImageAndPointCloud(const cv::Mat &img, const PointCloudView &cloud)
+{
+    std::shared_ptr<const PipelineSnapshot> snapshot = currentSnapshot();
+    const PipelineParams &params = snapshot->params;
+    ConeDetectionResult lidarCones = lidarDetector(snapshot).detect(cloud);
+    if (img.empty())
+        return ConeDetectionResult();
+
+    LidarCameraProjection projection(params.odometry.cameraIntrinsics, params.fusion);
+    CarMasks carMasks = getCarMasks(img.size(), params.carMask);
+    return fuseLidarCones(img, lidarCones, projection, *snapshot->lut, carMasks.car, params.fusion);
+}
+
+// Fusion from an image and a PCD file
+ConeDetectionResult fuseConesFromImageAndPointCloud(
     const std::string &imagePath,
-    const std::string &inputJsonPath,
+    const std::string &pcdPath,
+    const std::string &outputJsonPath,
     const std::string &outputImagePath)
 {
-    std::cout << "\n=== STEP 2: DRAWING TRACK LINES ===" << std::endl;
+    std::cout << "\n=== FUSION: COLOURING LIDAR CONES ===" << std::endl;
     std::cout << "Input image: " << imagePath << std::endl;
-    std::cout << "Input cones JSON: " << inputJsonPath << std::endl;
+    std::cout << "Input scan: " << pcdPath << std::endl;
 
-    // Load image
     cv::Mat img = cv::imread(imagePath);
-    if (img.empty())
+    MappedPcdFile cloud;
+    if (img.empty() || !cloud.open(pcdPath))
     {
-        std::cerr << "Error: Could not load image: " << imagePath << std::endl;
-        return cv::Mat();
+        std::cerr << "Error: Could not load the image or the point cloud" << std::endl;
+        return ConeDetectionResult();
     }
 
-    // Load cone detection results from JSON
-    ConeDetectionResult cones = loadConeDetectionFromJson(inputJsonPath);
+    ConeDetectionResult result = fuseConesFromImageAndPointCloud(img, cloud.view());
+
+    if (!outputJsonPath.empty())
+        saveConeDetectionToJson(result, outputJsonPath);
+
+    if (!outputImagePath.empty())
+    {
+        cv::Mat outputImage = drawTrackLinesFromCones(img, result);
+        saveDebugImage(outputImage, outputImagePath, "fusion image");
+    }
+
+    std::cout << "Fused:" << std::endl;
+    std::cout << "  Orange cones: " << result.orangeCones.size() << std::endl;
+    std::cout << "  Blue cones: " << result.blueCones.size() << std::endl;
+    std::cout << "  Yellow cones: " << result.yellowCones.size() << std::endl;
+
+    return result;
+}
 
-    // Draw track lines using configured parameters
-    cv::Mat outputImage;
-    img.copyTo(outputImage);
+// Multi-camera step 1 from image files
+ConeDetectionResult detectConesFromCameras(
+    const std::vector<std::string> &imagePaths,
+    const std::string &outputJsonPath,
+    const std::string &outputImagePath)
+{
+    std::cout << "\n=== MULTI-CAMERA: DETECTING CONES ===" << std::endl;
 
-    outputImage = connectCones(outputImage, cones.blueCones, cv::Scalar(255, 0, 0),
-                               g_params.trackDrawing.maxConeDistance, g_params.trackDrawing.verticalPenaltyFactor);
-    outputImage = connectCones(outputImage, cones.yellowCones, cv::Scalar(0, 255, 255),
-                               g_params.trackDrawing.maxConeDistance, g_params.trackDrawing.verticalPenaltyFactor);
+    std::shared_ptr<const PipelineSnapshot> snapshot = currentSnapshot();
+    const PipelineParams &params = snapshot->params;
+    const std::vector<std::string> &configs = params.multiCamera.cameras;
+    if (!configs.empty() && configs.size() != imagePaths.size())
+    {
+        std::cerr << "Error: " << configs.size() << " camera configs but " << imagePaths.size() << " images" << std::endl;
+        return ConeDetectionResult();
+    }
+
+    std::vector<PipelineParams> cameras;
+    std::vector<cv::Mat> frames;
+    for (size_t i = 0; i < imagePaths.size(); ++i)
+    {
+        std::cout << "Camera " << i << ": " << imagePaths[i];
+        if (!configs.empty())
+            std::cout << " (" << configs[i] << ")";
+        std::cout << std::endl;
+
+        // A camera without its own intrinsics and extrinsics would put its
+        // cones in the wrong place on the ground plane
+        cameras.push_back(params);
+        if (!configs.empty() && !PipelineParams::tryLoadFromFile(configs[i], cameras.back()))
+        {
+            std::cerr << "Error: Could not load config of camera " << i << ": " << configs[i] << std::endl;
+            return ConeDetectionResult();
+        }
+        frames.push_back(cv::imread(imagePaths[i]));
+        if (frames.back().empty())
+        {
+            std::cerr << "Error: Could not load image: " << imagePaths[i] << std::endl;
+            return ConeDetectionResult();
+        }
+    }
+
+    MultiCameraPipeline pipeline(cameras, params.multiCamera, params.lidar);
+    ConeDetectionResult result = pipeline.process(frames);
+
+    if (!outputJsonPath.empty())
+        saveConeDetectionToJson(result, outputJsonPath);
+
+    if (!outputImagePath.empty())
+    {
+        cv::Mat canvas(lidarBirdsEyeSize, CV_8UC3, cv::Scalar(0, 0, 0));
+        cv::Mat outputImage = drawTrackLinesFromCones(canvas, result);
+        saveDebugImage(outputImage, outputImagePath, "multi-camera image");
+    }
+
+    std::cout << "Detected (merged):" << std::endl;
+    std::cout << "  Orange cones: " << result.orangeCones.size() << std::endl;
+    std::cout << "  Blue cones: " << result.blueCones.size() << std::endl;
+    std::cout << "  Yellow cones: " << result.yellowCones.size() << std::endl;
+
+    return result;
+}
+
+// Step 2 without drawing: ordered blue and yellow edges
+TrackEdges buildTrackEdges(const ConeDetectionResult &cones, int imageWidth)
+{
+    std::shared_ptr<const PipelineSnapshot> snapshot = currentSnapshot();
+    const TrackDrawingParams &drawing = snapshot->params.trackDrawing;
+    TrackEdges edges;
+    connectCones(cones.blueCones, imageWidth, drawing.maxConeDistance, drawing.verticalPenaltyFactor, t_workspace.frame, edges.blue);
+    connectCones(cones.yellowCones, imageWidth, drawing.maxConeDistance, drawing.verticalPenaltyFactor, t_workspace.frame, edges.yellow);
+    return edges;
+}
+
+// Step 2: Draw already built edges on a copy of the frame
+cv::Mat drawTrackLines(const cv::Mat &img, const ConeDetectionResult &cones, const TrackEdges &edges, const Centerline *centerline)
+{
+    if (img.empty() || !DEBUG_RENDER())
+        return cv::Mat();
+
+    PROFILE_SCOPE("track.render");
+
+    cv::Mat outputImage = img.clone();
+    drawTrackEdge(outputImage, cones.blueCones, edges.blue, cv::Scalar(255, 0, 0));
+    drawTrackEdge(outputImage, cones.yellowCones, edges.yellow, cv::Scalar(0, 255, 255));
+    if (centerline)
+        drawCenterline(outputImage, *centerline);
 
     // Draw orange cones individually (they are on opposite sides, so don't connect them)
     for (const auto &cone : cones.orangeCones)
@@ -302,18 +743,82 @@ cv::Mat drawTrackLinesFromCones(
         cv::circle(outputImage, cone.center, 3, cv::Scalar(0, 165, 255), -1);
     }
 
+    return outputImage;
+}
+
+// Step 2: Draw track lines on an already decoded frame
+cv::Mat drawTrackLinesFromCones(const cv::Mat &img, const ConeDetectionResult &cones)
+{
+    PROFILE_SCOPE("track.total");
+
+    // Nothing but the image comes out of here, so without rendering skip it all
+    if (img.empty() || !DEBUG_RENDER())
+        return cv::Mat();
+
+    return drawTrackLines(img, cones, buildTrackEdges(cones, img.cols));
+}
+
+// Step 2: Draw track lines using pre-detected cones
+cv::Mat drawTrackLinesFromCones(
+    const std::string &imagePath,
+    const std::string &inputConesPath,
+    const std::string &outputImagePath)
+{
+    std::cout << "\n=== STEP 2: DRAWING TRACK LINES ===" << std::endl;
+    std::cout << "Input image: " << imagePath << std::endl;
+    std::cout << "Input cones: " << inputConesPath << std::endl;
+
+    // Load image
+    cv::Mat img = cv::imread(imagePath);
+    if (img.empty())
+    {
+        std::cerr << "Error: Could not load image: " << imagePath << std::endl;
+        return cv::Mat();
+    }
+
+    // Load cone detection results, binary handoff when available
+    bool binary = inputConesPath.size() >= 4 && inputConesPath.compare(inputConesPath.size() - 4, 4, ".bin") == 0;
+    ConeDetectionResult cones = binary ? loadConeDetectionFromBinary(inputConesPath) : loadConeDetectionFromJson(inputConesPath);
+
+    cv::Mat outputImage = drawTrackLinesFromCones(img, cones);
+
     // Save output image
-    cv::imwrite(outputImagePath, outputImage);
-    std::cout << "Saved track lines image to: " << outputImagePath << std::endl;
+    saveDebugImage(outputImage, outputImagePath, "track lines image");
 
     return outputImage;
 }
 
+// Step 3: Calculate odometry between two already decoded frames
+cv::Mat calculateOdometry(const cv::Mat &img1, const cv::Mat &img2, OdometryResult *result)
+{
+    if (img1.empty() || img2.empty())
+        return cv::Mat();
+
+    // Features are only detected outside the car
+    std::shared_ptr<const PipelineSnapshot> snapshot = currentSnapshot();
+    CarMasks carMasks = getCarMasks(img1.size(), snapshot->params.carMask);
+
+    // Calculate odometry using configured parameters
+    return calcOdometry(img1, img2, carMasks.valid, snapshot->params.odometry, result);
+}
+
+// Step 3: Calculate odometry against the previous frame of a sequence
+OdometryResult calculateOdometry(VisualOdometry &odometry, const cv::Mat &frame, const cv::UMat &deviceFrame)
+{
+    if (frame.empty())
+        return OdometryResult();
+
+    std::shared_ptr<const PipelineSnapshot> snapshot = currentSnapshot();
+    CarMasks carMasks = getCarMasks(frame.size(), snapshot->params.carMask);
+    return odometry.process(frame, carMasks.valid, deviceFrame.empty() ? uploadFrame(frame, snapshot->params.acceleration) : deviceFrame);
+}
+
 // Step 3: Calculate odometry between two frames
 cv::Mat calculateOdometry(
     const std::string &image1Path,
     const std::string &image2Path,
-    const std::string &outputImagePath)
+    const std::string &outputImagePath,
+    OdometryResult *result)
 {
     std::cout << "\n=== STEP 3: CALCULATING ODOMETRY ===" << std::endl;
     std::cout << "Frame 1: " << image1Path << std::endl;
@@ -329,15 +834,71 @@ cv::Mat calculateOdometry(
         return cv::Mat();
     }
 
-    // Create car mask for the first image
-    cv::Mat carMask = createCarMask(img1);
+    OdometryResult motion;
+    cv::Mat odometryResult = calculateOdometry(img1, img2, &motion);
 
-    // Calculate odometry using configured parameters
-    cv::Mat odometryResult = calcOdometry(img1, img2, carMask, g_params.odometry);
+    if (motion.valid)
+    {
+        std::cout << "Rotation Matrix:\n"
+                  << motion.R << std::endl;
+        std::cout << "Translation Vector:\n"
+                  << motion.t << std::endl;
+    }
+    else
+        std::cerr << "Error: no reliable pose" << std::endl;
+
+    if (result)
+        *result = motion;
 
     // Save output image
-    cv::imwrite(outputImagePath, odometryResult);
-    std::cout << "Saved odometry visualization to: " << outputImagePath << std::endl;
+    saveDebugImage(odometryResult, outputImagePath, "odometry visualization");
 
     return odometryResult;
 }
+
+// LIDAR step 3 on an already mapped scan
+OdometryResult calculateOdometry(LidarOdometry &odometry, const PointCloudView &cloud)
+{
+    return odometry.process(cloud);
+}
+
+// LIDAR step 3: Calculate odometry between two PCD files
+OdometryResult calculateLidarOdometry(const std::string &scan1Path, const std::string &scan2Path)
+{
+    std::cout << "\n=== LIDAR: CALCULATING ODOMETRY ===" << std::endl;
+    std::cout << "Scan 1: " << scan1Path << std::endl;
+    std::cout << "Scan 2: " << scan2Path << std::endl;
+
+    MappedPcdFile scan1, scan2;
+    if (!scan1.open(scan1Path) || !scan2.open(scan2Path))
+    {
+        std::cerr << "Error: Could not load one or both scans" << std::endl;
+        return OdometryResult();
+    }
+
+    LidarOdometry odometry(currentSnapshot()->params.lidarOdometry);
+    calculateOdometry(odometry, scan1.view());
+    OdometryResult motion = calculateOdometry(odometry, scan2.view());
+
+    const auto &iterations = odometry.lastIterations();
+    for (size_t i = 0; i < iterations.size(); ++i)
+    {
+        std::cout << "  Iteration " << i << ": " << iterations[i].milliseconds << " ms, "
+                  << iterations[i].correspondences << " correspondences within "
+                  << iterations[i].correspondenceDistance << " m, rmse "
+                  << iterations[i].rmse << " m" << std::endl;
+    }
+
+    if (!motion.valid)
+    {
+        std::cerr << "Error: ICP did not converge" << std::endl;
+        return motion;
+    }
+
+    std::cout << "Rotation Matrix:\n"
+              << motion.R << std::endl;
+    std::cout << "Translation Vector (m):\n"
+              << motion.t << std::endl;
+
+    return motion;
+}
@@ -0,0 +1,180 @@
+#include "../include/profiling.hpp"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+void LatencyHistogram::add(double microseconds)
+{
+    int bucket = 0;
+    if (microseconds >= 1.0)
+        bucket = std::min(bucketCount - 1, 1 + static_cast<int>(std::log2(microseconds) * bucketsPerOctave));
+
+    ++buckets[bucket];
+    minValue = samples ? std::min(minValue, microseconds) : microseconds;
+    maxValue = samples ? std::max(maxValue, microseconds) : microseconds;
+    sum += microseconds;
+    ++samples;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+    if (other.samples == 0)
+        return;
+
+    for (int bucket = 0; bucket < bucketCount; ++bucket)
+        buckets[bucket] += other.buckets[bucket];
+    minValue = samples ? std::min(minValue, other.minValue) : other.minValue;
+    maxValue = samples ? std::max(maxValue, other.maxValue) : other.maxValue;
+    sum += other.sum;
+    samples += other.samples;
+}
+
+double LatencyHistogram::percentile(double p) const
+{
+    if (samples == 0)
+        return 0.0;
+
+    size_t rank = static_cast<size_t>(std::ceil(std::clamp(p, 0.0, 1.0) * samples));
+    rank = std::max<size_t>(rank, 1);
+
+    size_t seen = 0;
+    for (int bucket = 0; bucket < bucketCount; ++bucket)
+    {
+        seen += buckets[bucket];
+        if (seen >= rank)
+        {
+            // Upper edge of the bucket, clamped to what was actually seen
+            double upper = bucket == 0 ? 1.0 : std::exp2(static_cast<double>(bucket) / bucketsPerOctave);
+            return std::clamp(upper, minValue, maxValue);
+        }
+    }
+    return maxValue;
+}
+
+json LatencyHistogram::toJson() const
+{
+    json j;
+    j["count"] = samples;
+    j["mean_us"] = mean();
+    j["p50_us"] = percentile(0.50);
+    j["p95_us"] = percentile(0.95);
+    j["p99_us"] = percentile(0.99);
+    j["max_us"] = maxValue;
+    return j;
+}
+
+Profiler &Profiler::instance()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+int &Profiler::currentFrame()
+{
+    thread_local int frame = -1;
+    return frame;
+}
+
+// This thread's buffer, registered on its first timer. The registry keeps
+// it after the thread exits, so stage threads still show up in the reports
+Profiler::ThreadTimings &Profiler::threadTimings()
+{
+    thread_local std::shared_ptr<ThreadTimings> timings;
+    if (!timings)
+    {
+        timings = std::make_shared<ThreadTimings>();
+        std::lock_guard<std::mutex> lock(mutex);
+        threads.push_back(timings);
+    }
+    return *timings;
+}
+
+void Profiler::record(const char *name, double microseconds)
+{
+    int frame = currentFrame();
+    ThreadTimings &timings = threadTimings();
+
+    std::lock_guard<std::mutex> lock(timings.mutex);
+    timings.histograms[name].add(microseconds);
+    if (frame >= 0)
+        timings.frames.push_back({frame, name, microseconds});
+}
+
+json Profiler::takeFrameReport(int frameIndex)
+{
+    // Summed when a timer runs several times per frame or on several threads
+    std::map<std::string, double> totals;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto &timings : threads)
+        {
+            std::lock_guard<std::mutex> threadLock(timings->mutex);
+            auto &frames = timings->frames;
+            for (const auto &timing : frames)
+            {
+                if (timing.frame == frameIndex)
+                    totals[timing.name] += timing.microseconds;
+            }
+            frames.erase(std::remove_if(frames.begin(), frames.end(), [frameIndex](const FrameTiming &timing)
+                                        { return timing.frame == frameIndex; }),
+                         frames.end());
+        }
+    }
+
+    json j;
+    j["frame"] = frameIndex;
+    for (const auto &timing : totals)
+        j[timing.first] = timing.second;
+    return j;
+}
+
+json Profiler::report() const
+{
+    // Threads (and translation units) can hold the same name under different
+    // pointers, so the histograms are merged by name
+    std::map<std::string, LatencyHistogram> merged;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto &timings : threads)
+        {
+            std::lock_guard<std::mutex> threadLock(timings->mutex);
+            for (const auto &entry : timings->histograms)
+                merged[entry.first].merge(entry.second);
+        }
+    }
+
+    json j = json::object();
+    for (const auto &entry : merged)
+        j[entry.first] = entry.second.toJson();
+    return j;
+}
+
+bool Profiler::saveReport(const std::string &filepath) const
+{
+    std::ofstream file(filepath);
+    if (!file.is_open())
+    {
+        std::cerr << "Error: Could not open file for writing: " << filepath << std::endl;
+        return false;
+    }
+    file << report().dump(2) << "\n";
+
+    std::cout << "Saved timing report to: " << filepath << std::endl;
+    return true;
+}
+
+void Profiler::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    // Buffers only the registry still holds belong to threads that have exited
+    threads.erase(std::remove_if(threads.begin(), threads.end(), [](const std::shared_ptr<ThreadTimings> &timings)
+                                 { return timings.use_count() == 1; }),
+                  threads.end());
+    for (const auto &timings : threads)
+    {
+        std::lock_guard<std::mutex> threadLock(timings->mutex);
+        timings->histograms.clear();
+        timings->frames.clear();
+    }
+}
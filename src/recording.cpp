@@ -0,0 +1,380 @@
+#include "../include/recording.hpp"
+#include "../include/cone_io.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static size_t padding(size_t size)
+{
+    return (8 - size % 8) % 8;
+}
+
+LogImageEncoding parseLogImageEncoding(const std::string &name)
+{
+    if (name == "raw")
+        return LOG_IMAGE_RAW;
+    if (name == "jpg" || name == "jpeg")
+        return LOG_IMAGE_JPEG;
+    if (name != "png")
+        std::cerr << "Warning: Unknown frame encoding '" << name << "', using png" << std::endl;
+    return LOG_IMAGE_PNG;
+}
+
+LogWriter::~LogWriter()
+{
+    close();
+}
+
+bool LogWriter::open(const std::string &filepath)
+{
+    close();
+
+    file.open(filepath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cerr << "Error: Could not open file for writing: " << filepath << std::endl;
+        return false;
+    }
+
+    path = filepath;
+    failed = false;
+    index.clear();
+
+    LogFileHeader header;
+    std::memcpy(header.magic, "DLOG", 4);
+    header.version = logFormatVersion;
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    offset = sizeof(header);
+    return true;
+}
+
+// Header, then `prefix` and `payload` back to back as one payload
+bool LogWriter::writeRecord(LogRecordType type, int frame, int64_t timestampNs, const void *prefix, size_t prefixSize, const void *payload, size_t size)
+{
+    if (!file.is_open())
+        return false;
+
+    LogRecordHeader header = {static_cast<uint32_t>(type), frame, timestampNs, prefixSize + size};
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    if (prefixSize)
+        file.write(static_cast<const char *>(prefix), prefixSize);
+    if (size)
+        file.write(static_cast<const char *>(payload), size);
+
+    const char zeros[8] = {};
+    file.write(zeros, padding(header.size));
+
+    if (!file)
+    {
+        failed = true;
+        return false;
+    }
+
+    index.push_back({header.type, frame, timestampNs, offset + sizeof(header), header.size});
+    offset += sizeof(header) + header.size + padding(header.size);
+    return true;
+}
+
+bool LogWriter::writeFrame(int frame, int64_t timestampNs, const cv::Mat &image, LogImageEncoding encoding)
+{
+    if (image.empty())
+        return false;
+
+    LogImageHeader header = {image.rows, image.cols, image.type(), encoding};
+    if (encoding == LOG_IMAGE_RAW)
+    {
+        // Rows of a view aren't contiguous
+        cv::Mat pixels = image.isContinuous() ? image : image.clone();
+        return writeRecord(LOG_FRAME, frame, timestampNs, &header, sizeof(header), pixels.data, pixels.total() * pixels.elemSize());
+    }
+
+    if (!cv::imencode(encoding == LOG_IMAGE_JPEG ? ".jpg" : ".png", image, scratch))
+    {
+        std::cerr << "Error: Could not encode frame " << frame << std::endl;
+        return false;
+    }
+    return writeRecord(LOG_FRAME, frame, timestampNs, &header, sizeof(header), scratch.data(), scratch.size());
+}
+
+bool LogWriter::writeScan(int frame, int64_t timestampNs, const void *pcd, size_t size)
+{
+    return writeRecord(LOG_SCAN, frame, timestampNs, nullptr, 0, pcd, size);
+}
+
+bool LogWriter::writeCones(int frame, int64_t timestampNs, const ConeDetectionResult &cones, LogRecordType type)
+{
+    scratch.resize(packedConeDetectionSize(cones));
+    packConeDetection(cones, scratch.data(), scratch.size());
+    return writeRecord(type, frame, timestampNs, nullptr, 0, scratch.data(), scratch.size());
+}
+
+bool LogWriter::writePose(int frame, int64_t timestampNs, const TrajectoryPoint &pose)
+{
+    PackedPose packed = {};
+    packed.valid = pose.valid ? 1 : 0;
+    packed.timestamp = pose.timestamp;
+    packed.scale = pose.scale;
+    for (int i = 0; i < 9; ++i)
+        packed.R[i] = pose.pose.R.val[i];
+    for (int i = 0; i < 3; ++i)
+        packed.t[i] = pose.pose.t[i];
+    return writeRecord(LOG_POSE, frame, timestampNs, nullptr, 0, &packed, sizeof(packed));
+}
+
+bool LogWriter::close()
+{
+    if (!file.is_open())
+        return !failed;
+
+    LogFileFooter footer;
+    std::memcpy(footer.magic, "DIDX", 4);
+    footer.entries = static_cast<uint32_t>(index.size());
+    footer.indexOffset = offset;
+    if (!index.empty())
+        file.write(reinterpret_cast<const char *>(index.data()), index.size() * sizeof(LogIndexEntry));
+    file.write(reinterpret_cast<const char *>(&footer), sizeof(footer));
+    if (!file)
+        failed = true;
+    file.close();
+
+    if (failed)
+        std::cerr << "Error: Could not write log: " << path << std::endl;
+    return !failed;
+}
+
+MappedLog::~MappedLog()
+{
+    close();
+}
+
+bool MappedLog::open(const std::string &filepath)
+{
+    close();
+
+    int fd = ::open(filepath.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "Error: Could not open log: " << filepath << std::endl;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(LogFileHeader)))
+    {
+        ::close(fd);
+        std::cerr << "Error: Not a log file: " << filepath << std::endl;
+        return false;
+    }
+
+    void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+        return false;
+
+    data = mapped;
+    size = st.st_size;
+
+    const LogFileHeader *header = static_cast<const LogFileHeader *>(data);
+    if (std::memcmp(header->magic, "DLOG", 4) != 0 || header->version != logFormatVersion)
+    {
+        std::cerr << "Error: Not a log file (or another version): " << filepath << std::endl;
+        close();
+        return false;
+    }
+
+    if (!readIndex())
+    {
+        std::cerr << "Warning: Log has no index, reading the records one by one: " << filepath << std::endl;
+        walkRecords();
+    }
+
+    buildFrameTable();
+    return true;
+}
+
+void MappedLog::close()
+{
+    if (data)
+        munmap(data, size);
+    data = nullptr;
+    size = 0;
+    index.clear();
+    frameTable.clear();
+}
+
+// Index and footer at the end of a completely written log
+bool MappedLog::readIndex()
+{
+    if (size < sizeof(LogFileHeader) + sizeof(LogFileFooter))
+        return false;
+
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    LogFileFooter footer;
+    std::memcpy(&footer, bytes + size - sizeof(footer), sizeof(footer));
+    if (std::memcmp(footer.magic, "DIDX", 4) != 0)
+        return false;
+
+    size_t indexBytes = static_cast<size_t>(footer.entries) * sizeof(LogIndexEntry);
+    if (footer.indexOffset < sizeof(LogFileHeader) || footer.indexOffset + indexBytes + sizeof(footer) != size)
+        return false;
+
+    index.resize(footer.entries);
+    if (indexBytes)
+        std::memcpy(index.data(), bytes + footer.indexOffset, indexBytes);
+
+    // Every entry has to point inside the records
+    for (const auto &entry : index)
+    {
+        if (entry.offset < sizeof(LogFileHeader) || entry.offset > footer.indexOffset || entry.size > footer.indexOffset - entry.offset)
+        {
+            index.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+// Rebuilds the index from the record headers, up to the last complete record
+void MappedLog::walkRecords()
+{
+    index.clear();
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    size_t position = sizeof(LogFileHeader);
+    while (position + sizeof(LogRecordHeader) <= size)
+    {
+        LogRecordHeader header;
+        std::memcpy(&header, bytes + position, sizeof(header));
+        size_t start = position + sizeof(header);
+        if (header.type < LOG_FRAME || header.type > LOG_POSE || header.size > size - start)
+            break;
+
+        index.push_back({header.type, header.frame, header.timestampNs, start, header.size});
+        position = start + header.size + padding(header.size);
+    }
+}
+
+void MappedLog::buildFrameTable()
+{
+    std::map<int, LogFrame> frames;
+    for (const auto &entry : index)
+    {
+        auto inserted = frames.emplace(entry.frame, LogFrame());
+        LogFrame &frame = inserted.first->second;
+        if (inserted.second)
+        {
+            frame.frame = entry.frame;
+            frame.timestampNs = entry.timestampNs;
+        }
+
+        // The last record of a type wins
+        switch (entry.type)
+        {
+        case LOG_FRAME:
+            frame.image = &entry;
+            break;
+        case LOG_SCAN:
+            frame.scan = &entry;
+            break;
+        case LOG_CONES:
+            frame.cones = &entry;
+            break;
+        case LOG_LIDAR_CONES:
+            frame.lidarCones = &entry;
+            break;
+        case LOG_POSE:
+            frame.pose = &entry;
+            break;
+        }
+    }
+
+    frameTable.clear();
+    frameTable.reserve(frames.size());
+    for (const auto &frame : frames)
+        frameTable.push_back(frame.second);
+}
+
+const LogFrame *MappedLog::findFrame(int frame) const
+{
+    auto it = std::lower_bound(frameTable.begin(), frameTable.end(), frame, [](const LogFrame &f, int value)
+                               { return f.frame < value; });
+    return it != frameTable.end() && it->frame == frame ? &*it : nullptr;
+}
+
+const uint8_t *MappedLog::payload(const LogIndexEntry &entry) const
+{
+    return static_cast<const uint8_t *>(data) + entry.offset;
+}
+
+bool MappedLog::readImage(const LogIndexEntry &entry, cv::Mat &image) const
+{
+    image.release();
+    if (entry.type != LOG_FRAME || entry.size < sizeof(LogImageHeader))
+        return false;
+
+    LogImageHeader header;
+    std::memcpy(&header, payload(entry), sizeof(header));
+    const uint8_t *pixels = payload(entry) + sizeof(header);
+    size_t bytes = entry.size - sizeof(header);
+
+    if (header.encoding == LOG_IMAGE_RAW)
+    {
+        // The header must describe exactly the stored bytes before a Mat is
+        // made of it; a bad type would otherwise trip an OpenCV assertion
+        if (header.rows <= 0 || header.cols <= 0 || header.type < 0 || header.type > CV_MAKETYPE(CV_16F, CV_CN_MAX))
+            return false;
+        if (static_cast<size_t>(header.rows) * static_cast<size_t>(header.cols) * CV_ELEM_SIZE(header.type) != bytes)
+            return false;
+        image = cv::Mat(header.rows, header.cols, header.type, const_cast<uint8_t *>(pixels));
+        return true;
+    }
+
+    image = cv::imdecode(cv::Mat(1, static_cast<int>(bytes), CV_8U, const_cast<uint8_t *>(pixels)), cv::IMREAD_UNCHANGED);
+    return !image.empty();
+}
+
+bool MappedLog::readScan(const LogIndexEntry &entry, PointCloudView &cloud) const
+{
+    cloud = PointCloudView();
+    if (entry.type != LOG_SCAN)
+        return false;
+
+    PcdHeader header;
+    return parsePcdHeader(payload(entry), entry.size, header) && cloud.attach(header, payload(entry), entry.size);
+}
+
+bool MappedLog::readCones(const LogIndexEntry &entry, ConeDetectionResult &cones) const
+{
+    cones = ConeDetectionResult();
+    if (entry.type != LOG_CONES && entry.type != LOG_LIDAR_CONES)
+        return false;
+
+    ConeDetectionView view;
+    if (!view.attach(payload(entry), entry.size))
+        return false;
+    cones = view.toResult();
+    return true;
+}
+
+bool MappedLog::readPose(const LogIndexEntry &entry, TrajectoryPoint &pose) const
+{
+    pose = TrajectoryPoint();
+    if (entry.type != LOG_POSE || entry.size < sizeof(PackedPose))
+        return false;
+
+    PackedPose packed;
+    std::memcpy(&packed, payload(entry), sizeof(packed));
+    pose.frameIndex = entry.frame;
+    pose.timestamp = packed.timestamp;
+    pose.scale = packed.scale;
+    pose.valid = packed.valid != 0;
+    for (int i = 0; i < 9; ++i)
+        pose.pose.R.val[i] = packed.R[i];
+    for (int i = 0; i < 3; ++i)
+        pose.pose.t[i] = packed.t[i];
+    return true;
+}
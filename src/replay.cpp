@@ -0,0 +1,382 @@
+#include "../include/replay.hpp"
+#include "../include/pipeline.hpp"
+#include "../include/lidar.hpp"
+#include "../include/trajectory.hpp"
+#include "../include/profiling.hpp"
+#include "../include/debug_sink.hpp"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+int recordLog(FrameSource &source, const std::string &logPath, const RecordOptions &options)
+{
+    PcdSource scans;
+    bool haveScans = !options.scanSource.empty() && scans.open(options.scanSource);
+    if (!source.isOpened() && !haveScans)
+        return 0;
+
+    LogWriter writer;
+    if (!writer.open(logPath))
+        return -1;
+
+    LogImageEncoding encoding = parseLogImageEncoding(getPipelineParams().replay.frameEncoding);
+    auto start = std::chrono::steady_clock::now();
+    cv::Mat frame;
+    MappedPcdFile cloud;
+    bool moreFrames = source.isOpened();
+    int recorded = 0;
+
+    while (options.maxFrames < 0 || recorded < options.maxFrames)
+    {
+        // Frame N and scan N go in with the same frame number
+        bool haveFrame = moreFrames && source.read(frame);
+        bool haveScan = haveScans && scans.read(cloud);
+        moreFrames = haveFrame;
+        haveScans = haveScan;
+        if (!haveFrame && !haveScan)
+            break;
+
+        int64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        if (haveFrame)
+            writer.writeFrame(recorded, timestamp, frame, encoding);
+        if (haveScan)
+            writer.writeScan(recorded, timestamp, cloud.bytes(), cloud.byteSize());
+        ++recorded;
+    }
+
+    size_t records = writer.recordCount();
+    if (!writer.close())
+        return -1;
+
+    std::cout << "Recorded " << recorded << " frames (" << records << " records) to: " << logPath << std::endl;
+    return recorded;
+}
+
+// Outputs of one frame, filled by the segment that owns it
+struct ReplayFrame
+{
+    ConeDetectionResult cones;
+    ConeDetectionResult lidarCones;
+    TrajectoryPoint pose; // From the start of the segment until the segments are chained
+    bool hasImage = false;
+    bool hasScan = false;
+};
+
+// Frames [first, last) of `frames` with stage objects of their own, starting
+// one frame early for odometry; only the segment's own frames are stored
+static void replaySegment(const MappedLog &log, const std::vector<const LogFrame *> &frames, int first, int last,
+                          const PipelineParams &params, std::vector<ReplayFrame> &results)
+{
+    // Poses carry the recorded capture times, counted from the first frame
+    const int64_t startNs = frames.front()->timestampNs;
+
+    ConeTracker tracker(params.tracker);
+    CenterlineBuilder centerline(params.centerline);
+    VisualOdometry odometry(params.odometry);
+    Trajectory trajectory(params.trajectory, params.odometry.cameraIntrinsics);
+    LidarConeDetector lidar(params.lidar); // Per segment, like the other stages
+
+    ConeDetectionResult prevCones; // Steers the "cones" ROI mode
+    cv::Size prevSize;
+    cv::Mat frame;
+
+    for (int i = std::max(0, first - 1); i < last; ++i)
+    {
+        PROFILE_SCOPE("replay.frame");
+        const LogFrame &entry = *frames[i];
+        ReplayFrame out;
+
+        bool decoded = false;
+        if (entry.image)
+        {
+            PROFILE_SCOPE("frame.decode");
+            decoded = log.readImage(*entry.image, frame);
+            if (!decoded)
+                std::cerr << "Warning: Could not read frame " << entry.frame << " from the log" << std::endl;
+        }
+
+        if (decoded)
+        {
+            // Resolution changes break the match, start a new sequence
+            if (!prevSize.empty() && prevSize != frame.size())
+            {
+                tracker.reset();
+                odometry.reset();
+            }
+            prevSize = frame.size();
+
+            out.cones = params.tracker.enabled ? detectConesTracked(tracker, frame) : detectConesFromImage(frame, &prevCones);
+            {
+                PROFILE_SCOPE("track.total");
+                TrackEdges edges = buildTrackEdges(out.cones, frame.cols);
+                centerline.update(out.cones, edges);
+            }
+            OdometryResult motion = calculateOdometry(odometry, frame);
+            double timestamp = std::max(0.0, static_cast<double>(entry.image->timestampNs - startNs) * 1e-9);
+            out.pose = trajectory.update(entry.frame, motion, out.cones, timestamp);
+            out.hasImage = true;
+            prevCones = out.cones;
+        }
+        else
+        {
+            out.pose = trajectory.current();
+        }
+
+        PointCloudView cloud;
+        if (entry.scan && log.readScan(*entry.scan, cloud))
+        {
+            PROFILE_SCOPE("lidar.detect");
+            out.lidarCones = lidar.detect(cloud);
+            out.hasScan = true;
+        }
+
+        if (i >= first)
+            results[i] = std::move(out);
+    }
+}
+
+// Greedy nearest-center pairing of same-colour cones; returns the cones of
+// either side left without a partner within `tolerance` pixels
+static int unmatchedCones(const std::vector<Cone> &a, const std::vector<Cone> &b, float tolerance)
+{
+    std::vector<bool> used(b.size(), false);
+    int unmatched = 0;
+    for (const auto &cone : a)
+    {
+        int best = -1;
+        double bestDistance = tolerance;
+        for (size_t j = 0; j < b.size(); ++j)
+        {
+            double distance = cv::norm(cone.center - b[j].center);
+            if (!used[j] && distance <= bestDistance)
+            {
+                best = static_cast<int>(j);
+                bestDistance = distance;
+            }
+        }
+        if (best < 0)
+            ++unmatched;
+        else
+            used[best] = true;
+    }
+    return unmatched + static_cast<int>(std::count(used.begin(), used.end(), false));
+}
+
+// {"orange": n, "blue": n, "yellow": n} of the unmatched cones, null if all pair up
+static json diffCones(const ConeDetectionResult &replayed, const ConeDetectionResult &baseline, float tolerance)
+{
+    int orange = unmatchedCones(replayed.orangeCones, baseline.orangeCones, tolerance);
+    int blue = unmatchedCones(replayed.blueCones, baseline.blueCones, tolerance);
+    int yellow = unmatchedCones(replayed.yellowCones, baseline.yellowCones, tolerance);
+    if (orange + blue + yellow == 0)
+        return json();
+    return {{"orange", orange}, {"blue", blue}, {"yellow", yellow}};
+}
+
+// Differences of every frame against the baseline log, written to diff.json
+static void diffAgainstBaseline(const std::vector<const LogFrame *> &frames, const std::vector<ReplayFrame> &results,
+                                const MappedLog &baseline, const ReplayParams &params, const std::string &path, ReplayReport &report)
+{
+    json differences = json::array();
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        const LogFrame *expected = baseline.findFrame(frames[i]->frame);
+        if (!expected)
+            continue;
+
+        const ReplayFrame &result = results[i];
+        json difference;
+        bool compared = false;
+        ConeDetectionResult cones;
+        if (result.hasImage && expected->cones && baseline.readCones(*expected->cones, cones))
+        {
+            compared = true;
+            json d = diffCones(result.cones, cones, params.coneTolerance);
+            if (!d.is_null())
+                difference["cones"] = d;
+        }
+        if (result.hasScan && expected->lidarCones && baseline.readCones(*expected->lidarCones, cones))
+        {
+            compared = true;
+            json d = diffCones(result.lidarCones, cones, params.coneTolerance);
+            if (!d.is_null())
+                difference["lidarCones"] = d;
+        }
+        TrajectoryPoint pose;
+        if (result.hasImage && expected->pose && baseline.readPose(*expected->pose, pose))
+        {
+            compared = true;
+            double error = cv::norm(result.pose.pose.t - pose.pose.t);
+            if (error > params.poseTolerance || result.pose.valid != pose.valid)
+                difference["poseError"] = error;
+        }
+
+        if (!compared)
+            continue;
+        report.comparedFrames++;
+        if (!difference.empty())
+        {
+            difference["frame"] = frames[i]->frame;
+            differences.push_back(difference);
+            report.differingFrames++;
+        }
+    }
+
+    std::ofstream file(path);
+    if (file.is_open())
+        file << json({{"compared", report.comparedFrames}, {"differing", report.differingFrames}, {"frames", differences}}).dump(2) << "\n";
+    else
+        std::cerr << "Error: Could not open file for writing: " << path << std::endl;
+
+    std::cout << "Baseline: " << report.differingFrames << " of " << report.comparedFrames << " frames differ";
+    if (report.differingFrames)
+        std::cout << " (see " << path << ")";
+    std::cout << std::endl;
+}
+
+static bool writeOutputLog(const std::vector<const LogFrame *> &frames, const std::vector<ReplayFrame> &results, const std::string &path)
+{
+    LogWriter writer;
+    if (!writer.open(path))
+        return false;
+
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        const LogFrame &entry = *frames[i];
+        const ReplayFrame &result = results[i];
+        if (result.hasImage)
+        {
+            writer.writeCones(entry.frame, entry.timestampNs, result.cones);
+            writer.writePose(entry.frame, entry.timestampNs, result.pose);
+        }
+        if (result.hasScan)
+            writer.writeCones(entry.frame, entry.timestampNs, result.lidarCones, LOG_LIDAR_CONES);
+    }
+
+    if (!writer.close())
+        return false;
+    std::cout << "Saved replay outputs to: " << path << std::endl;
+    return true;
+}
+
+// Puts OpenCV's thread count back when the replay returns
+struct ThreadCountScope
+{
+    int previous = cv::getNumThreads();
+    ~ThreadCountScope() { cv::setNumThreads(previous); }
+};
+
+ReplayReport replayLog(const MappedLog &log, const ReplayOptions &options)
+{
+    ReplayReport report;
+
+    // Frame numbers with sensor data; output-only ones are left out
+    std::vector<const LogFrame *> frames;
+    for (const auto &frame : log.frames())
+    {
+        if ((frame.image || frame.scan) && (options.maxFrames < 0 || static_cast<int>(frames.size()) < options.maxFrames))
+            frames.push_back(&frame);
+    }
+    if (frames.empty())
+    {
+        std::cerr << "Error: Log has no frames or scans to replay" << std::endl;
+        return report;
+    }
+
+    std::shared_ptr<const PipelineSnapshot> snapshot = getPipelineSnapshot();
+    const PipelineParams &params = snapshot->params;
+    ThreadCountScope threadCount;
+    if (params.replay.threads > 0)
+        cv::setNumThreads(params.replay.threads);
+
+    const int count = static_cast<int>(frames.size());
+    const int segmentLength = params.replay.segmentLength > 0 ? std::min(params.replay.segmentLength, count) : count;
+    report.frames = count;
+    report.segments = (count + segmentLength - 1) / segmentLength;
+
+    std::cout << "\n=== REPLAY: " << count << " frames in " << report.segments << " segments on "
+              << cv::getNumThreads() << " threads ===" << std::endl;
+
+    DebugSink::instance().setRendering(false);
+    DebugSink::instance().setLogging(false);
+    Profiler::instance().reset();
+
+    std::vector<ReplayFrame> results(frames.size());
+    auto start = std::chrono::steady_clock::now();
+    cv::parallel_for_(cv::Range(0, report.segments), [&](const cv::Range &range)
+                      {
+        SnapshotScope pin(snapshot);
+        for (int s = range.start; s < range.end; ++s)
+            replaySegment(log, frames, s * segmentLength, std::min(count, (s + 1) * segmentLength), params, results); }, report.segments);
+
+    // Each segment started from the pose of the frame before it, which the
+    // previous segment has (already chained) in world coordinates
+    for (int s = 1; s < report.segments; ++s)
+    {
+        const int first = s * segmentLength;
+        const Pose origin = results[first - 1].pose.pose;
+        for (int i = first; i < std::min(count, first + segmentLength); ++i)
+        {
+            Pose &pose = results[i].pose.pose;
+            pose.t = origin.t + origin.R * pose.t;
+            pose.R = origin.R * pose.R;
+        }
+    }
+
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    report.framesPerSecond = report.seconds > 0 ? count / report.seconds : 0.0;
+
+    std::error_code ec;
+    fs::create_directories(options.outputDir, ec);
+
+    json stages = Profiler::instance().report();
+    std::cout << "Processed " << count << " frames in " << report.seconds << " s (" << report.framesPerSecond << " frames/s)" << std::endl;
+    for (const auto &stage : stages.items())
+    {
+        std::cout << "  " << stage.key() << ": p50 " << stage.value()["p50_us"].get<double>() << " us, p95 "
+                  << stage.value()["p95_us"].get<double>() << " us (" << stage.value()["count"].get<size_t>() << " calls)" << std::endl;
+    }
+
+    if (!options.outputLog.empty())
+        writeOutputLog(frames, results, options.outputLog);
+
+    if (!options.baselineLog.empty())
+    {
+        MappedLog baseline;
+        if (baseline.open(options.baselineLog))
+            diffAgainstBaseline(frames, results, baseline, params.replay, options.outputDir + "/diff.json", report);
+    }
+
+    json j;
+    j["frames"] = report.frames;
+    j["segments"] = report.segments;
+    j["segmentLength"] = segmentLength;
+    j["threads"] = cv::getNumThreads();
+    j["seconds"] = report.seconds;
+    j["framesPerSecond"] = report.framesPerSecond;
+    if (!options.baselineLog.empty())
+    {
+        j["baseline"] = options.baselineLog;
+        j["comparedFrames"] = report.comparedFrames;
+        j["differingFrames"] = report.differingFrames;
+    }
+    j["stages"] = stages;
+
+    std::string reportPath = options.outputDir + "/replay_report.json";
+    std::ofstream file(reportPath);
+    if (file.is_open())
+    {
+        file << j.dump(2) << "\n";
+        std::cout << "Saved replay report to: " << reportPath << std::endl;
+    }
+    else
+    {
+        std::cerr << "Error: Could not open file for writing: " << reportPath << std::endl;
+    }
+
+    return report;
+}
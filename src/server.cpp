@@ -0,0 +1,261 @@
+#include "../include/server.hpp"
+#include "../include/pipeline.hpp"
+#include "../include/params.hpp"
+#include "../include/profiling.hpp"
+#include "../include/params_watcher.hpp"
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+
+namespace fs = std::filesystem;
+
+// Default inputs/outputs, same as the one-shot CLI
+static const std::string inputImage = "data/frame_1.png";
+static const std::string inputImage2 = "data/frame_2.png";
+static const std::string conesJsonPath = "output/detected_cones.json";
+static const std::string conesBinaryPath = "output/detected_cones.bin";
+static const std::string trackImagePath = "output/detected_cones.png";
+static const std::string odometryImagePath = "output/odometry_matches.png";
+
+namespace
+{
+    // Decoded images, reloaded only when the file changes on disk
+    class ImageCache
+    {
+    public:
+        const cv::Mat &get(const std::string &path)
+        {
+            std::error_code ec;
+            auto mtime = fs::last_write_time(path, ec);
+
+            auto it = entries.find(path);
+            if (it != entries.end() && !ec && it->second.mtime == mtime)
+                return it->second.image;
+
+            Entry entry;
+            entry.image = cv::imread(path);
+            entry.mtime = mtime;
+            if (entry.image.empty())
+                std::cerr << "Error: Could not load image: " << path << std::endl;
+
+            Entry &slot = entries[path];
+            slot = entry;
+            return slot.image;
+        }
+
+    private:
+        struct Entry
+        {
+            cv::Mat image;
+            fs::file_time_type mtime;
+        };
+        std::map<std::string, Entry> entries;
+    };
+
+    // Redirects std::cout/std::cerr into a buffer for the lifetime of the object
+    class CaptureConsole
+    {
+    public:
+        CaptureConsole()
+            : coutBuf(std::cout.rdbuf(buffer.rdbuf())),
+              cerrBuf(std::cerr.rdbuf(buffer.rdbuf()))
+        {
+        }
+        ~CaptureConsole()
+        {
+            std::cout.rdbuf(coutBuf);
+            std::cerr.rdbuf(cerrBuf);
+        }
+        std::string text() const { return buffer.str(); }
+
+    private:
+        std::ostringstream buffer;
+        std::streambuf *coutBuf;
+        std::streambuf *cerrBuf;
+    };
+
+    struct ServerState
+    {
+        ImageCache images;
+        ConeDetectionResult cones; // Last detection, used by the track step without a file round-trip
+        bool haveCones = false;
+    };
+}
+
+static json matToJson(const cv::Mat &m)
+{
+    json rows = json::array();
+    cv::Mat d;
+    if (!m.empty())
+        m.convertTo(d, CV_64F);
+    for (int r = 0; r < d.rows; ++r)
+    {
+        json row = json::array();
+        for (int c = 0; c < d.cols; ++c)
+            row.push_back(d.at<double>(r, c));
+        rows.push_back(row);
+    }
+    return rows;
+}
+
+static void runSteps(ServerState &state, const std::string &step, json &response)
+{
+    bool all = step == "all";
+    std::error_code ec;
+    fs::create_directories("output", ec);
+
+    if (all || step == "detect" || step == "1")
+    {
+        std::cout << "\n=== STEP 1: DETECTING CONES ===" << std::endl;
+        state.cones = detectConesFromImage(state.images.get(inputImage));
+        state.haveCones = true;
+
+        saveConeDetectionToJson(state.cones, conesJsonPath);
+        saveConeDetectionToBinary(state.cones, conesBinaryPath);
+
+        std::cout << "Detected:" << std::endl;
+        std::cout << "  Orange cones: " << state.cones.orangeCones.size() << std::endl;
+        std::cout << "  Blue cones: " << state.cones.blueCones.size() << std::endl;
+        std::cout << "  Yellow cones: " << state.cones.yellowCones.size() << std::endl;
+        response["outputs"]["cones_json"] = conesJsonPath;
+    }
+
+    if (all || step == "track" || step == "2")
+    {
+        std::cout << "\n=== STEP 2: DRAWING TRACK LINES ===" << std::endl;
+        if (!state.haveCones)
+        {
+            state.cones = loadConeDetectionFromBinary(conesBinaryPath);
+            state.haveCones = true;
+        }
+
+        // Edges and centerline go into the response, the image is only for display
+        const cv::Mat &img = state.images.get(inputImage);
+        TrackEdges edges = buildTrackEdges(state.cones, img.cols);
+        CenterlineBuilder builder(getPipelineParams().centerline);
+        const Centerline &centerline = builder.update(state.cones, edges);
+        response["centerline"] = centerlineToJson(centerline);
+
+        cv::Mat trackImage = drawTrackLines(img, state.cones, edges, &centerline);
+        if (!trackImage.empty())
+        {
+            cv::imwrite(trackImagePath, trackImage);
+            std::cout << "Saved track lines image to: " << trackImagePath << std::endl;
+            response["outputs"]["track_image"] = trackImagePath;
+        }
+    }
+
+    if (all || step == "odometry" || step == "3")
+    {
+        std::cout << "\n=== STEP 3: CALCULATING ODOMETRY ===" << std::endl;
+        OdometryResult motion;
+        cv::Mat odometryImage = calculateOdometry(state.images.get(inputImage), state.images.get(inputImage2), &motion);
+
+        if (motion.valid)
+        {
+            std::cout << "Rotation Matrix:\n"
+                      << motion.R << std::endl;
+            std::cout << "Translation Vector:\n"
+                      << motion.t << std::endl;
+        }
+        else
+            std::cerr << "Error: no reliable pose" << std::endl;
+
+        if (!odometryImage.empty())
+        {
+            cv::imwrite(odometryImagePath, odometryImage);
+            std::cout << "Saved odometry visualization to: " << odometryImagePath << std::endl;
+            response["outputs"]["odometry_image"] = odometryImagePath;
+        }
+        response["odometry"]["valid"] = motion.valid;
+        response["odometry"]["R"] = matToJson(motion.R);
+        response["odometry"]["t"] = matToJson(motion.t);
+    }
+}
+
+int runPipelineServer(const std::string &configPath, std::istream &in, std::ostream &out)
+{
+    // stdout carries the protocol, so startup chatter goes to stderr
+    {
+        std::streambuf *coutBuf = std::cout.rdbuf(std::cerr.rdbuf());
+        initializePipelineParams(configPath);
+        std::cout.rdbuf(coutBuf);
+    }
+
+    // Picks up edits of the config file at the start of each request, not on
+    // a thread: stdout carries the protocol and the console is captured per request
+    std::unique_ptr<ParamsWatcher> watcher;
+    if (getPipelineParams().hotReload.watchConfig)
+        watcher = std::make_unique<ParamsWatcher>(configPath, 0);
+
+    ServerState state;
+    std::string line;
+
+    while (std::getline(in, line))
+    {
+        if (line.empty())
+            continue;
+
+        auto start = std::chrono::steady_clock::now();
+        json response;
+        bool quit = false;
+
+        // Timings are reported per request
+        Profiler::instance().reset();
+
+        {
+            CaptureConsole console;
+            try
+            {
+                json request = json::parse(line);
+                std::string cmd = request.value("cmd", "");
+
+                if (watcher && watcher->poll())
+                    state.haveCones = false;
+
+                if (request.contains("params"))
+                {
+                    setPipelineParams(PipelineParams::fromJson(request["params"]));
+                    // Cones detected with the old parameters are stale now
+                    state.haveCones = false;
+                }
+
+                if (cmd == "reload")
+                {
+                    if (!reloadPipelineParams(configPath))
+                        throw std::runtime_error("could not reload " + configPath);
+                    state.haveCones = false;
+                }
+                else if (cmd == "run")
+                {
+                    SnapshotScope pin(getPipelineSnapshot());
+                    runSteps(state, request.value("step", "all"), response);
+                }
+                else if (cmd == "quit")
+                    quit = true;
+                else if (cmd != "set_params" && cmd != "ping")
+                    throw std::runtime_error("unknown command: " + cmd);
+
+                response["ok"] = true;
+            }
+            catch (const std::exception &e)
+            {
+                response["ok"] = false;
+                response["error"] = e.what();
+            }
+            response["log"] = console.text();
+        }
+
+        response["elapsed_ms"] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        response["timing"] = Profiler::instance().report();
+        out << response.dump() << std::endl;
+
+        if (quit)
+            break;
+    }
+
+    return 0;
+}
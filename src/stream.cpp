@@ -0,0 +1,270 @@
+#include "../include/stream.hpp"
+#include "../include/pipeline.hpp"
+#include "../include/executor.hpp"
+#include "../include/trajectory.hpp"
+#include "../include/profiling.hpp"
+#include "../include/debug_sink.hpp"
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+static bool isImageFile(const fs::path &path)
+{
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c)
+                   { return std::tolower(c); });
+    return ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp";
+}
+
+bool FrameSource::open(const std::string &source)
+{
+    files.clear();
+    nextFile = 0;
+    index = -1;
+    fromFiles = false;
+
+    // Directory of frames
+    std::error_code ec;
+    if (fs::is_directory(source, ec))
+    {
+        for (const auto &entry : fs::directory_iterator(source, ec))
+        {
+            if (entry.is_regular_file() && isImageFile(entry.path()))
+                files.push_back(entry.path().string());
+        }
+        std::sort(files.begin(), files.end());
+        fromFiles = true;
+
+        if (files.empty())
+            std::cerr << "Error: No images found in directory: " << source << std::endl;
+        return !files.empty();
+    }
+
+    // Camera device index
+    if (!source.empty() && std::all_of(source.begin(), source.end(), ::isdigit))
+        capture.open(std::stoi(source));
+    else
+        capture.open(source);
+
+    if (!capture.isOpened())
+        std::cerr << "Error: Could not open frame source: " << source << std::endl;
+    return capture.isOpened();
+}
+
+bool FrameSource::isOpened() const
+{
+    return fromFiles ? !files.empty() : capture.isOpened();
+}
+
+bool FrameSource::read(cv::Mat &frame)
+{
+    if (fromFiles)
+    {
+        // Skip unreadable files instead of stopping the stream
+        while (nextFile < files.size())
+        {
+            frame = cv::imread(files[nextFile++]);
+            if (!frame.empty())
+            {
+                ++index;
+                return true;
+            }
+            std::cerr << "Warning: Could not load image: " << files[nextFile - 1] << std::endl;
+        }
+        return false;
+    }
+
+    if (!capture.isOpened() || !capture.read(frame) || frame.empty())
+        return false;
+
+    ++index;
+    return true;
+}
+
+static std::string framePath(const StreamOptions &options, int index, const std::string &suffix)
+{
+    std::ostringstream name;
+    name << options.outputDir << "/frame_" << std::setw(6) << std::setfill('0') << index << suffix;
+    return name.str();
+}
+
+// Reads the next frame, timing the decode as part of that frame
+static bool readFrame(FrameSource &source, cv::Mat &frame)
+{
+    PROFILE_FRAME(source.frameIndex() + 1);
+    PROFILE_SCOPE("frame.decode");
+    return source.read(frame);
+}
+
+// Per-frame JSON lines written with --save
+struct FrameLogs
+{
+    std::ofstream timing;
+    std::ofstream centerline;
+};
+
+// Per-frame console summary and optional image/timing/centerline dump, shared by both modes
+static void reportFrame(const StreamOptions &options, const FrameResult &result, FrameLogs &logs)
+{
+    // Always taken so the per-frame timings don't pile up in the profiler
+    json timing = Profiler::instance().takeFrameReport(result.index);
+    if (logs.timing.is_open())
+        logs.timing << timing.dump() << "\n";
+    if (logs.centerline.is_open())
+        logs.centerline << json({{"frame", result.index}, {"points", centerlineToJson(result.centerline)}}).dump() << "\n";
+
+    const cv::Vec3d &t = result.pose.pose.t;
+    std::cout << "Frame " << result.index << ": "
+              << result.cones.orangeCones.size() << " orange, "
+              << result.cones.blueCones.size() << " blue, "
+              << result.cones.yellowCones.size() << " yellow cones, "
+              << "pose (" << t[0] << ", " << t[1] << ", " << t[2] << ")"
+              << (result.pose.valid ? "" : " [held]") << std::endl;
+
+    if (options.saveOutputs)
+    {
+        if (!result.trackImage.empty())
+            cv::imwrite(framePath(options, result.index, "_track.png"), result.trackImage);
+        if (!result.odometryImage.empty())
+            cv::imwrite(framePath(options, result.index, "_odometry.png"), result.odometryImage);
+    }
+}
+
+static int runSerial(FrameSource &source, const StreamOptions &options, std::vector<TrajectoryPoint> &trajectoryPoints, FrameLogs &logs)
+{
+    // Both buffers are swapped rather than copied, so every frame is decoded
+    // exactly once and shared by detection, track drawing and odometry;
+    // prevFrame also keeps the buffer the odometry still references alive
+    cv::Mat frame, prevFrame;
+    ConeDetectionResult prevCones; // Steers the "cones" ROI mode
+    std::shared_ptr<const PipelineSnapshot> stages = getPipelineSnapshot(); // What the stage objects were built with
+    ConeTracker tracker(stages->params.tracker);
+    CenterlineBuilder centerline(stages->params.centerline);
+    VisualOdometry odometry(stages->params.odometry);
+    Trajectory trajectory(stages->params.trajectory, stages->params.odometry.cameraIntrinsics);
+    int processed = 0;
+
+    while (options.maxFrames < 0 || processed < options.maxFrames)
+    {
+        if (!readFrame(source, frame))
+            break;
+
+        FrameResult result;
+        result.index = source.frameIndex();
+        result.frame = frame;
+        {
+            PROFILE_FRAME(result.index);
+
+            // The newest parameters, kept by every step of this frame
+            std::shared_ptr<const PipelineSnapshot> snapshot = getPipelineSnapshot();
+            SnapshotScope pin(snapshot);
+            const PipelineParams &params = snapshot->params;
+            if (snapshot->version != stages->version)
+            {
+                refreshStages(stages->params, params, &tracker, &centerline, &odometry, &trajectory);
+                stages = snapshot;
+            }
+
+            // Resolution changes break the match, start a new sequence
+            bool resized = !prevFrame.empty() && prevFrame.size() != frame.size();
+            if (resized)
+                tracker.reset();
+            result.deviceFrame = uploadFrame(frame, params.acceleration);
+            result.cones = params.tracker.enabled ? detectConesTracked(tracker, frame, result.deviceFrame) : detectConesFromImage(frame, &prevCones, result.deviceFrame);
+            calibrateColours(frame, result.cones);
+            {
+                PROFILE_SCOPE("track.total");
+                result.edges = buildTrackEdges(result.cones, frame.cols);
+                result.centerline = centerline.update(result.cones, result.edges);
+                result.trackImage = drawTrackLines(frame, result.cones, result.edges, &result.centerline);
+            }
+
+            if (resized)
+                odometry.reset();
+            result.odometry = calculateOdometry(odometry, frame, result.deviceFrame);
+            result.odometryImage = odometry.drawLastMatches();
+            result.pose = trajectory.update(result.index, result.odometry, result.cones);
+        }
+
+        reportFrame(options, result, logs);
+        trajectoryPoints.push_back(result.pose);
+
+        prevCones = result.cones;
+        std::swap(prevFrame, frame);
+        ++processed;
+    }
+
+    return processed;
+}
+
+static int runPipelined(FrameSource &source, const StreamOptions &options, std::vector<TrajectoryPoint> &trajectoryPoints, FrameLogs &logs)
+{
+    // Called on the odometry thread once all stages are done with the frame
+    PipelinedExecutor executor(getPipelineParams().executor, [&](FrameResult &result)
+                               {
+        reportFrame(options, result, logs);
+        trajectoryPoints.push_back(result.pose); });
+
+    int processed = 0;
+    while (options.maxFrames < 0 || processed < options.maxFrames)
+    {
+        // A fresh buffer per frame: the previous ones are still in flight
+        cv::Mat frame;
+        if (!readFrame(source, frame))
+            break;
+
+        executor.submit(source.frameIndex(), std::move(frame));
+        ++processed;
+    }
+
+    executor.finish();
+    return processed;
+}
+
+int runStreamingPipeline(FrameSource &source, const StreamOptions &options)
+{
+    if (!source.isOpened())
+        return 0;
+
+    if (options.saveOutputs)
+    {
+        std::error_code ec;
+        fs::create_directories(options.outputDir, ec);
+    }
+
+    std::cout << "\n=== STREAMING PIPELINE" << (options.pipelined ? " (PIPELINED)" : "") << " ===" << std::endl;
+
+    FrameLogs logs;
+    if (options.saveOutputs)
+    {
+        logs.timing.open(options.outputDir + "/timing_frames.jsonl");
+        logs.centerline.open(options.outputDir + "/centerline.jsonl");
+    }
+
+    Profiler::instance().reset();
+
+    if (options.headless)
+    {
+        DebugSink::instance().setRendering(false);
+        DebugSink::instance().setLogging(false);
+    }
+
+    std::vector<TrajectoryPoint> trajectoryPoints;
+    int processed = options.pipelined ? runPipelined(source, options, trajectoryPoints, logs) : runSerial(source, options, trajectoryPoints, logs);
+
+    std::cout << "Processed " << processed << " frames" << std::endl;
+
+    if (options.saveOutputs)
+    {
+        saveTrajectoryToJson(trajectoryPoints, options.outputDir + "/trajectory.json");
+        Profiler::instance().saveReport(options.outputDir + "/timing_report.json");
+    }
+
+    return processed;
+}
@@ -1,62 +1,105 @@
 #include "../include/track.hpp"
 #include "../include/detection.hpp"
+#include "../include/workspace.hpp"
+#include "../include/profiling.hpp"
 
-cv::Mat connectCones(const cv::Mat &image, std::vector<Cone> &cones, cv::Scalar lineColor, int maxDistance, float verticalPenaltyFactor)
+// Use a combination of Euclidean distance and vertical distance
+// Penalizing vertical distance helps with eliminating wrong detections
+// This helps avoid zigzag when there's a curve on the track
+// Main issue with this is if we ever have a view where subsequent cones are very different in vertical distance somehow
+static double chainDistance(const cv::Point &from, const cv::Point &to, float verticalPenaltyFactor)
 {
-    cv::Mat output;
-    image.copyTo(output);
-
-    // Start from the bottom cone closest to the middle of the image
-    // Copy the cones so we can modify the list; this whole thing can probably be optimized if we have memory/performance issues
-    auto remainingCones = cones;
-    std::sort(remainingCones.begin(), remainingCones.end(), [image](const Cone &a, const Cone &b)
-              { return (a.center.y > b.center.y) ||
-                       (a.center.y == b.center.y && std::abs(a.center.x - image.cols / 2) < std::abs(b.center.x - image.cols / 2)); });
+    return cv::norm(to - from) + std::abs(to.y - from.y) * verticalPenaltyFactor;
+}
 
-    auto firstCone = remainingCones.front();
+std::vector<int> connectCones(const std::vector<Cone> &cones, int imageWidth, int maxDistance, float verticalPenaltyFactor)
+{
+    FrameWorkspace workspace;
+    std::vector<int> edge;
+    connectCones(cones, imageWidth, maxDistance, verticalPenaltyFactor, workspace, edge);
+    return edge;
+}
 
-    cv::rectangle(output, firstCone.boundingBox, cv::Scalar(0, 255, 0), 2);
-    cv::circle(output, firstCone.center, 3, lineColor, -1);
+void connectCones(const std::vector<Cone> &cones, int imageWidth, int maxDistance, float verticalPenaltyFactor, FrameWorkspace &workspace, std::vector<int> &edge)
+{
+    PROFILE_SCOPE("track.connect_cones");
 
-    cv::Point previousPoint = firstCone.center;
+    edge.clear();
+    if (cones.empty())
+        return;
 
-    std::vector<Cone> trackEdgeCones;
+    // Start from the bottom cone closest to the middle of the image; this
+    // order also breaks distance ties, as the sorted scan used to
+    std::vector<int> &order = workspace.order;
+    order.resize(cones.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = static_cast<int>(i);
+    std::sort(order.begin(), order.end(), [&](int a, int b)
+              {
+        const cv::Point &ca = cones[a].center, &cb = cones[b].center;
+        if (ca.y != cb.y)
+            return ca.y > cb.y;
+        return std::abs(ca.x - imageWidth / 2) < std::abs(cb.x - imageWidth / 2); });
 
-    while (!remainingCones.empty())
+    std::vector<int> &rank = workspace.rank;
+    rank.resize(cones.size());
+    cv::Point maxCorner(0, 0);
+    for (size_t i = 0; i < order.size(); ++i)
     {
-        // Find the next closest cone
-        auto it = std::min_element(remainingCones.begin(), remainingCones.end(), [previousPoint, verticalPenaltyFactor](const Cone &a, const Cone &b)
-                                   {
-                                    // Use a combination of Euclidean distance and vertical distance
-                                    // Penalizing vertical distance helps with eliminating wrong detections
-                                    // This helps avoid zigzag when there's a curve on the track
-                                    // Main issue with this is if we ever have a view where subsequent cones are very different in vertical distance somehow
-                                       double distA = cv::norm(a.center - previousPoint) + std::abs(a.center.y - previousPoint.y) * verticalPenaltyFactor;
-                                       double distB = cv::norm(b.center - previousPoint) + std::abs(b.center.y - previousPoint.y) * verticalPenaltyFactor;
-                                       return distA < distB; });
+        rank[order[i]] = static_cast<int>(i);
+        maxCorner.x = std::max(maxCorner.x, cones[i].center.x);
+        maxCorner.y = std::max(maxCorner.y, cones[i].center.y);
+    }
 
-        // If it's too far, stop
-        double distance = cv::norm(it->center - previousPoint) + std::abs(it->center.y - previousPoint.y) * verticalPenaltyFactor;
-        if (distance > maxDistance)
-            break;
+    // The chain distance is never below the Euclidean one, so every candidate
+    // within maxDistance is in the 3x3 cells around the last cone
+    ConeGrid &grid = workspace.trackGrid;
+    grid.reset(cv::Size(maxCorner.x + 1, maxCorner.y + 1), maxDistance, maxDistance);
+    for (size_t i = 0; i < cones.size(); ++i)
+        grid.insert(grid.cellOf(cones[i].center), static_cast<int>(i));
 
-        if (it == remainingCones.end())
-            break;
+    std::vector<bool> &used = workspace.used;
+    used.assign(cones.size(), false);
+    int current = order.front();
+    used[current] = true;
+    edge.push_back(current);
 
-        // Draw line to the next cone
-        cv::line(output, previousPoint, it->center, lineColor, 2);
-        cv::rectangle(output, it->boundingBox, cv::Scalar(0, 255, 0), 2);
-        cv::circle(output, it->center, 3, lineColor, -1);
+    while (true)
+    {
+        const cv::Point &previousPoint = cones[current].center;
+        int next = -1;
+        double bestDistance = 0.0;
+        grid.forNeighbours(previousPoint, [&](int i)
+                           {
+            if (used[i])
+                return;
+            double distance = chainDistance(previousPoint, cones[i].center, verticalPenaltyFactor);
+            if (next < 0 || distance < bestDistance || (distance == bestDistance && rank[i] < rank[next]))
+            {
+                next = i;
+                bestDistance = distance;
+            } });
 
-        // Add to the track cones
-        trackEdgeCones.push_back(*it);
+        // If it's too far, stop
+        if (next < 0 || bestDistance > maxDistance)
+            break;
 
-        previousPoint = it->center;
-        remainingCones.erase(it);
+        used[next] = true;
+        edge.push_back(next);
+        current = next;
     }
 
     // This also helps clean up the wrongly detected cones, as they don't fit the chain.
-    cones = trackEdgeCones;
+}
 
-    return output;
+void drawTrackEdge(cv::Mat &image, const std::vector<Cone> &cones, const std::vector<int> &edge, cv::Scalar lineColor)
+{
+    for (size_t i = 0; i < edge.size(); ++i)
+    {
+        const Cone &cone = cones[edge[i]];
+        if (i > 0)
+            cv::line(image, cones[edge[i - 1]].center, cone.center, lineColor, 2);
+        cv::rectangle(image, cone.boundingBox, cv::Scalar(0, 255, 0), 2);
+        cv::circle(image, cone.center, 3, lineColor, -1);
+    }
 }
@@ -0,0 +1,147 @@
+#include "../include/trajectory.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+Trajectory::Trajectory(const TrajectoryParams &params, const CameraIntrinsics &intrinsics)
+    : params(params),
+      intrinsics(intrinsics)
+{
+}
+
+void Trajectory::reset()
+{
+    last = TrajectoryPoint();
+    prevCones = ConeDetectionResult();
+    prevScale = 1.0;
+}
+
+// Cones of one colour seen in both frames, matched by nearest image position
+static void collectDepthChanges(const std::vector<Cone> &prev, const std::vector<Cone> &curr, const CameraIntrinsics &intrinsics, double coneHeight, std::vector<double> &changes)
+{
+    // Cones move towards the bottom of the image as we drive, allow for that
+    const double maxPixelDistance = 60.0;
+
+    for (const auto &cone : curr)
+    {
+        const Cone *best = nullptr;
+        double bestDistance = maxPixelDistance;
+        for (const auto &candidate : prev)
+        {
+            double distance = cv::norm(cone.center - candidate.center);
+            if (distance < bestDistance)
+            {
+                bestDistance = distance;
+                best = &candidate;
+            }
+        }
+
+        if (!best || cone.boundingBox.height <= 0 || best->boundingBox.height <= 0)
+            continue;
+
+        double depthPrev = intrinsics.fy * coneHeight / best->boundingBox.height;
+        double depthCurr = intrinsics.fy * coneHeight / cone.boundingBox.height;
+        changes.push_back(std::abs(depthPrev - depthCurr));
+    }
+}
+
+double estimateScaleFromCones(const ConeDetectionResult &prev, const ConeDetectionResult &curr, const CameraIntrinsics &intrinsics, double coneHeight)
+{
+    std::vector<double> changes;
+    collectDepthChanges(prev.blueCones, curr.blueCones, intrinsics, coneHeight, changes);
+    collectDepthChanges(prev.yellowCones, curr.yellowCones, intrinsics, coneHeight, changes);
+    collectDepthChanges(prev.orangeCones, curr.orangeCones, intrinsics, coneHeight, changes);
+
+    if (changes.empty())
+        return 0.0;
+
+    // Median, a single bad bounding box shouldn't move the estimate
+    std::nth_element(changes.begin(), changes.begin() + changes.size() / 2, changes.end());
+    return changes[changes.size() / 2];
+}
+
+double Trajectory::estimateScale(int frameIndex, double timestamp, const ConeDetectionResult &cones)
+{
+    // Constant speed from the config: nothing feeds in measured wheel speed.
+    // The time since the previous frame, nominal if the clock didn't move
+    if (params.scaleSource == "wheel")
+    {
+        double interval = last.frameIndex >= 0 ? timestamp - last.timestamp : 0.0;
+        if (interval <= 0.0)
+        {
+            int frames = last.frameIndex >= 0 ? std::max(1, frameIndex - last.frameIndex) : 1;
+            interval = params.frameInterval * frames;
+        }
+        return params.wheelSpeed * interval;
+    }
+
+    if (params.scaleSource == "cones")
+    {
+        // No cone pairs up: assume constant speed
+        double scale = estimateScaleFromCones(prevCones, cones, intrinsics, params.coneHeight);
+        return scale > 0.0 ? scale : prevScale;
+    }
+
+    // Unit translation per frame, direction only
+    return 1.0;
+}
+
+const TrajectoryPoint &Trajectory::update(int frameIndex, const OdometryResult &odometry, const ConeDetectionResult &cones, double timestamp)
+{
+    if (timestamp < 0.0)
+        timestamp = frameIndex * params.frameInterval;
+    double scale = estimateScale(frameIndex, timestamp, cones);
+
+    TrajectoryPoint point;
+    point.frameIndex = frameIndex;
+    point.timestamp = timestamp;
+    point.pose = last.pose;
+
+    if (odometry.valid && !odometry.R.empty() && !odometry.t.empty())
+    {
+        // recoverPose maps points from the previous camera frame to the current one:
+        // x_curr = R * x_prev + t, so the camera moved by the inverse of that
+        cv::Matx33d R = odometry.R;
+        cv::Vec3d t = odometry.t;
+        cv::Matx33d Rt = R.t();
+
+        point.pose.t = last.pose.t + last.pose.R * (Rt * (-t)) * scale;
+        point.pose.R = last.pose.R * Rt;
+        point.scale = scale;
+        point.valid = true;
+        prevScale = scale;
+    }
+
+    last = point;
+    prevCones = cones;
+
+    return last;
+}
+
+void saveTrajectoryToJson(const std::vector<TrajectoryPoint> &points, const std::string &filepath)
+{
+    json j = json::array();
+    for (const auto &point : points)
+    {
+        json p;
+        p["frame"] = point.frameIndex;
+        p["timestamp"] = point.timestamp;
+        p["valid"] = point.valid;
+        p["scale"] = point.scale;
+        p["t"] = {point.pose.t[0], point.pose.t[1], point.pose.t[2]};
+        p["R"] = json::array();
+        for (int r = 0; r < 3; ++r)
+            p["R"].push_back(json::array({point.pose.R(r, 0), point.pose.R(r, 1), point.pose.R(r, 2)}));
+        j.push_back(p);
+    }
+
+    std::ofstream file(filepath);
+    if (!file.is_open())
+    {
+        std::cerr << "Error: Could not open file for writing: " << filepath << std::endl;
+        return;
+    }
+    file << j.dump(2);
+
+    std::cout << "Saved trajectory to: " << filepath << std::endl;
+}
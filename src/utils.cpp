@@ -1,4 +1,6 @@
 #include "../include/utils.hpp"
+#include <algorithm>
+#include <mutex>
 
 ColourMaskConfig getColourMask(Colours colour)
 {
@@ -17,19 +19,74 @@ ColourMaskConfig getColourMask(Colours colour)
 }
 
 cv::Mat createCarMask(const cv::Mat &image)
+{
+    return createCarMask(image.size(), CarMaskParams());
+}
+
+cv::Mat createCarMask(const cv::Size &size, const CarMaskParams &params)
 {
     // The car is approximated as this polygon in the lower half of the image;
     // If I were to do this for real, I'd probably use a more sophisticated polygon and we'd require a stable camera mount
-    cv::Mat mask = cv::Mat::zeros(image.size(), CV_8UC1);
-    cv::Point pts[8] = {
-        cv::Point(image.cols * 0.05, image.rows),
-        cv::Point(image.cols * 0.1, image.rows * 0.9),
-        cv::Point(image.cols * 0.28, image.rows * 0.9),
-        cv::Point(image.cols * 0.38, image.rows * 0.68),
-        cv::Point(image.cols * 0.62, image.rows * 0.68),
-        cv::Point(image.cols * 0.72, image.rows * 0.9),
-        cv::Point(image.cols * 0.9, image.rows * 0.9),
-        cv::Point(image.cols * 0.95, image.rows)};
-    cv::fillConvexPoly(mask, pts, 8, cv::Scalar(255));
+    cv::Mat mask = cv::Mat::zeros(size, CV_8UC1);
+    std::vector<cv::Point> pts;
+    pts.reserve(params.polygon.size());
+    for (const auto &pt : params.polygon)
+        pts.emplace_back(size.width * pt.x, size.height * pt.y);
+
+    if (!pts.empty())
+        cv::fillConvexPoly(mask, pts.data(), (int)pts.size(), cv::Scalar(255));
     return mask;
 }
+
+namespace
+{
+    struct CarMaskCacheEntry
+    {
+        cv::Size size;
+        std::vector<cv::Point2f> polygon;
+        CarMasks masks;
+    };
+
+    std::mutex g_carMaskMutex;
+    std::vector<CarMaskCacheEntry> g_carMaskCache;
+}
+
+CarMasks getCarMasks(const cv::Size &size, const CarMaskParams &params)
+{
+    std::lock_guard<std::mutex> lock(g_carMaskMutex);
+
+    for (const auto &entry : g_carMaskCache)
+    {
+        if (entry.size == size && entry.polygon == params.polygon)
+            return entry.masks;
+    }
+
+    // A handful of resolutions at most; start over if the polygon keeps changing
+    if (g_carMaskCache.size() >= 8)
+        g_carMaskCache.clear();
+
+    CarMaskCacheEntry entry;
+    entry.size = size;
+    entry.polygon = params.polygon;
+    entry.masks.car = createCarMask(size, params);
+    entry.masks.valid = ~entry.masks.car;
+    g_carMaskCache.push_back(entry);
+
+    return entry.masks;
+}
+
+void prewarmCarMasks(const CarMaskParams &params)
+{
+    std::vector<cv::Size> sizes;
+    {
+        std::lock_guard<std::mutex> lock(g_carMaskMutex);
+        for (const auto &entry : g_carMaskCache)
+        {
+            if (std::find(sizes.begin(), sizes.end(), entry.size) == sizes.end())
+                sizes.push_back(entry.size);
+        }
+    }
+
+    for (const auto &size : sizes)
+        getCarMasks(size, params);
+}
@@ -0,0 +1,46 @@
+#include "../include/workspace.hpp"
+#include <algorithm>
+
+// `size` view of `mat`, which is only reallocated to grow or change type
+static cv::Mat growingView(cv::Mat &mat, const cv::Size &size, int type)
+{
+    if (mat.type() != type || mat.cols < size.width || mat.rows < size.height)
+        mat.create(std::max(mat.rows, size.height), std::max(mat.cols, size.width), type);
+    return mat(cv::Rect(0, 0, size.width, size.height));
+}
+
+static cv::UMat growingView(cv::UMat &mat, const cv::Size &size, int type)
+{
+    if (mat.type() != type || mat.cols < size.width || mat.rows < size.height)
+        mat.create(std::max(mat.rows, size.height), std::max(mat.cols, size.width), type);
+    return mat(cv::Rect(0, 0, size.width, size.height));
+}
+
+cv::Mat FrameWorkspace::buffer(Buffer which, const cv::Size &size, int type)
+{
+    return growingView(storage[which], size, type);
+}
+
+void FrameWorkspace::reserveTiles(int count)
+{
+    if (tiles.size() < static_cast<size_t>(count))
+        tiles.resize(count);
+}
+
+cv::Mat FrameWorkspace::tile(int index, const cv::Size &size, int type)
+{
+    return growingView(tiles[index], size, type);
+}
+
+const cv::Mat &FrameWorkspace::ellipseKernel(int size)
+{
+    auto it = kernels.find(size);
+    if (it == kernels.end())
+        it = kernels.emplace(size, cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(size, size))).first;
+    return it->second;
+}
+
+cv::UMat DeviceWorkspace::buffer(Buffer which, const cv::Size &size, int type)
+{
+    return growingView(storage[which], size, type);
+}
@@ -0,0 +1,111 @@
+#include "test_utils.hpp"
+#include "../include/centerline.hpp"
+
+// The incremental centerline must always equal a rebuild from scratch
+
+static Cone coneAt(int x, int y)
+{
+    Cone cone;
+    cone.center = cv::Point(x, y);
+    cone.boundingBox = cv::Rect(x - 5, y - 10, 10, 20);
+    return cone;
+}
+
+// Straight blue and yellow edges, both ordered from the car outwards
+static void straightTrack(ConeDetectionResult &cones, TrackEdges &edges)
+{
+    for (int i = 0; i < 6; ++i)
+    {
+        cones.blueCones.push_back(coneAt(100, 500 - 80 * i));
+        cones.yellowCones.push_back(coneAt(300, 500 - 80 * i));
+        edges.blue.push_back(i);
+        edges.yellow.push_back(i);
+    }
+}
+
+static bool sameCenterline(const Centerline &a, const Centerline &b)
+{
+    if (a.points.size() != b.points.size())
+        return false;
+    for (size_t i = 0; i < a.points.size(); ++i)
+    {
+        if (a.points[i].position != b.points[i].position || a.points[i].width != b.points[i].width ||
+            a.points[i].curvature != b.points[i].curvature)
+            return false;
+    }
+    return true;
+}
+
+// The last yellow cone swings next to the first blue one: the far segment
+// (4) becomes its closest, though segment 0 and its neighbours didn't move
+static void testFarSegmentMovesCloser()
+{
+    ConeDetectionResult cones;
+    TrackEdges edges;
+    straightTrack(cones, edges);
+
+    CenterlineBuilder incremental;
+    incremental.update(cones, edges);
+
+    cones.yellowCones[5] = coneAt(110, 505);
+    const Centerline &updated = incremental.update(cones, edges);
+
+    CenterlineBuilder rebuilt;
+    CHECK(sameCenterline(updated, rebuilt.update(cones, edges)));
+}
+
+// Unchanged edges reuse every midpoint and give the same line
+static void testUnchangedEdgesReuse()
+{
+    ConeDetectionResult cones;
+    TrackEdges edges;
+    straightTrack(cones, edges);
+
+    CenterlineBuilder incremental;
+    Centerline first = incremental.update(cones, edges);
+    const Centerline &second = incremental.update(cones, edges);
+    CHECK(second.recomputed == 0);
+    CHECK(sameCenterline(first, second));
+}
+
+// The first blue cone has no yellow partner, then the last blue cone goes
+// and the first one moves in: the point count is the same but every point
+// after the first sits one index earlier, so no curvature can be copied
+static void testDroppedMidpointShiftsIndices()
+{
+    const int offsets[] = {0, 20, 30, 80, 100};
+    ConeDetectionResult cones;
+    TrackEdges edges;
+    cones.blueCones.push_back(coneAt(-400, 500));
+    edges.blue.push_back(0);
+    for (int i = 1; i < 5; ++i)
+    {
+        cones.blueCones.push_back(coneAt(100 + offsets[i], 500 - 80 * i));
+        cones.yellowCones.push_back(coneAt(300 + offsets[i], 500 - 80 * i));
+        edges.blue.push_back(i);
+        edges.yellow.push_back(i - 1);
+    }
+
+    CenterlineBuilder incremental;
+    CHECK(incremental.update(cones, edges).points.size() == 4);
+
+    cones.blueCones[0] = coneAt(100, 500);
+    cones.blueCones.pop_back();
+    edges.blue.pop_back();
+    const Centerline &updated = incremental.update(cones, edges);
+    CHECK(updated.points.size() == 4);
+
+    CenterlineBuilder rebuilt;
+    CHECK(sameCenterline(updated, rebuilt.update(cones, edges)));
+}
+
+int main()
+{
+    testFarSegmentMovesCloser();
+    testUnchangedEdgesReuse();
+    testDroppedMidpointShiftsIndices();
+
+    if (testFailures() == 0)
+        std::cout << "centerline_test: all checks passed" << std::endl;
+    return testFailures();
+}
@@ -0,0 +1,35 @@
+#ifndef TEST_UTILS_HPP
+#define TEST_UTILS_HPP
+
+#include <opencv2/opencv.hpp>
+#include <iostream>
+
+// Minimal checks for the regression tests: a failed CHECK is printed and
+// counted, and main returns the count, so ctest sees any failure
+inline int &testFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                                         \
+    do                                                                                           \
+    {                                                                                            \
+        if (!(condition))                                                                        \
+        {                                                                                        \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK failed: " #condition << std::endl; \
+            ++testFailures();                                                                    \
+        }                                                                                        \
+    } while (0)
+
+// Same size and not a single differing pixel
+inline bool sameImage(const cv::Mat &a, const cv::Mat &b)
+{
+    if (a.size() != b.size() || a.type() != b.type())
+        return false;
+    cv::Mat diff;
+    cv::compare(a, b, diff, cv::CMP_NE);
+    return cv::countNonZero(diff.reshape(1)) == 0;
+}
+
+#endif // TEST_UTILS_HPP
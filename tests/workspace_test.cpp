@@ -0,0 +1,129 @@
+#include "test_utils.hpp"
+#include "../include/classifier.hpp"
+#include "../include/pipeline.hpp"
+#include "../include/workspace.hpp"
+
+// Workspace buffers are views into storage that only grows: whatever a large
+// frame leaves behind must not leak into a smaller frame's masks or cones
+
+static ColourMaskConfig hueRange(const std::string &name, int low, int high)
+{
+    return {name, {{cv::Scalar(low, 100, 100), cv::Scalar(high, 255, 255)}}};
+}
+
+// Blue, orange and yellow cone ranges only, no road
+static HsvLut coneLut()
+{
+    HsvLut lut;
+    addColourToLut(lut, hueRange("orange", 5, 15), LABEL_ORANGE);
+    addColourToLut(lut, hueRange("blue", 100, 120), LABEL_BLUE);
+    addColourToLut(lut, hueRange("yellow", 25, 35), LABEL_YELLOW);
+    return lut;
+}
+
+// Mostly no cone colour, with blobs touching the right and bottom edges
+static cv::Mat smallHsvFrame()
+{
+    cv::Mat hsv(150, 200, CV_8UC3, cv::Scalar(60, 200, 200));
+    cv::rectangle(hsv, cv::Rect(180, 40, 20, 30), cv::Scalar(110, 200, 200), -1);
+    cv::rectangle(hsv, cv::Rect(60, 135, 25, 15), cv::Scalar(10, 200, 200), -1);
+    cv::rectangle(hsv, cv::Rect(90, 60, 12, 12), cv::Scalar(30, 200, 200), -1);
+    return hsv;
+}
+
+static bool sameMasks(const ColourMasks &a, const ColourMasks &b)
+{
+    return sameImage(a.orange, b.orange) && sameImage(a.blue, b.blue) && sameImage(a.yellow, b.yellow);
+}
+
+static bool sameCones(const std::vector<Cone> &a, const std::vector<Cone> &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        if (a[i].center != b[i].center || a[i].boundingBox != b[i].boundingBox)
+            return false;
+    }
+    return true;
+}
+
+static void testMasksAfterLargerFrame(const ColorDetectionParams &params)
+{
+    const HsvLut lut = coneLut();
+    const cv::Mat small = smallHsvFrame();
+    const cv::Mat smallNeg = cv::Mat::zeros(small.size(), CV_8UC1);
+
+    // A large frame that is one blue blob leaves every buffer set
+    FrameWorkspace reused;
+    cv::Mat large(480, 640, CV_8UC3, cv::Scalar(110, 200, 200));
+    detectColours(large, lut, cv::Mat::zeros(large.size(), CV_8UC1), params, reused);
+    ColourMasks afterLarge = detectColours(small, lut, smallNeg, params, reused);
+
+    FrameWorkspace fresh;
+    ColourMasks expected = detectColours(small, lut, smallNeg, params, fresh);
+    CHECK(sameMasks(afterLarge, expected));
+}
+
+// Tiled cleanup matches the untiled one, also on reused buffers
+static void testTiledCleanup()
+{
+    const HsvLut lut = coneLut();
+    cv::Mat hsv;
+    cv::resize(smallHsvFrame(), hsv, cv::Size(800, 600), 0, 0, cv::INTER_NEAREST);
+    const cv::Mat neg = cv::Mat::zeros(hsv.size(), CV_8UC1);
+
+    ColorDetectionParams untiled;
+    untiled.morphologyTiles = 1;
+    FrameWorkspace plain;
+    ColourMasks expected = detectColours(hsv, lut, neg, untiled, plain);
+
+    ColorDetectionParams tiled;
+    tiled.morphologyTiles = 4;
+    FrameWorkspace reused;
+    cv::Mat large(1080, 1920, CV_8UC3, cv::Scalar(110, 200, 200));
+    detectColours(large, lut, cv::Mat::zeros(large.size(), CV_8UC1), tiled, reused);
+    CHECK(sameMasks(detectColours(hsv, lut, neg, tiled, reused), expected));
+}
+
+// Whole step 1 on a small frame after a large one, against a fresh workspace
+static void testDetectionAfterLargerFrame()
+{
+    PipelineParams params;
+    params.roi.mode = "none";
+    const HsvLut lut = buildHsvLut(params.roadMask);
+
+    cv::Mat small;
+    cv::cvtColor(smallHsvFrame(), small, cv::COLOR_HSV2BGR);
+    cv::Mat large(480, 640, CV_8UC3, cv::Scalar(255, 0, 0));
+    cv::rectangle(large, cv::Rect(0, 0, 640, 480), cv::Scalar(0, 140, 255), 40);
+
+    DetectionWorkspace reused;
+    detectConesFromImage(large, params, lut, getCarMasks(large.size(), params.carMask), reused);
+    CarMasks carMasks = getCarMasks(small.size(), params.carMask);
+    ConeDetectionResult afterLarge = detectConesFromImage(small, params, lut, carMasks, reused);
+
+    DetectionWorkspace fresh;
+    ConeDetectionResult expected = detectConesFromImage(small, params, lut, carMasks, fresh);
+    CHECK(sameCones(afterLarge.orangeCones, expected.orangeCones));
+    CHECK(sameCones(afterLarge.blueCones, expected.blueCones));
+    CHECK(sameCones(afterLarge.yellowCones, expected.yellowCones));
+}
+
+int main()
+{
+    ColorDetectionParams params;
+    params.morphologyTiles = 1;
+    testMasksAfterLargerFrame(params);
+
+    params.erosionIterations = 0;
+    params.dilationIterations = 3;
+    testMasksAfterLargerFrame(params);
+
+    testTiledCleanup();
+    testDetectionAfterLargerFrame();
+
+    if (testFailures() == 0)
+        std::cout << "workspace_test: all checks passed" << std::endl;
+    return testFailures();
+}